@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+  Loopback test server for the OpenOCD jtag_vpi interface driver.
+
+  The server implements the jtag_vpi protocol, including the transfer size
+  negotiation of "jtag_vpi set_xfer_size", with TDO wired to TDI: every scan
+  reads back the bits it shifted. It prints the traffic of each connection
+  when it closes, which makes it handy to measure the protocol overhead of
+  the driver, with and without "jtag_vpi pipeline".
+
+  To compile run:
+  gcc -Wall -O2 -std=gnu99 -o jtag_vpi_loopback jtag_vpi_loopback.c
+
+  Usage example, serving on the default jtag_vpi port, allowing transfers
+  of up to 16 KiB:
+  ./jtag_vpi_loopback 5555 16384
+
+  On host run:
+  openocd -c "adapter driver jtag_vpi; jtag_vpi set_xfer_size 16384"
+
+  As TDO is wired to TDI, the chain looks empty to the scan chain
+  examination. The server is meant to exercise the transport: any scan, e.g.
+  from "irscan" and "drscan" on a TAP declared with "jtag newtap", returns
+  the bits it shifted.
+*/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define XFERT_MAX_SIZE		512
+
+#define CMD_RESET		0
+#define CMD_TMS_SEQ		1
+#define CMD_SCAN_CHAIN		2
+#define CMD_SCAN_CHAIN_FLIP_TMS	3
+#define CMD_STOP_SIMU		4
+#define CMD_SET_XFER_SIZE	5
+
+/* Packet layout: cmd, buffer_out[xfer], buffer_in[xfer], length, nb_bits */
+#define PACKET_SIZE(xfer)	(2 * (xfer) + 3 * 4)
+#define PACKET_OUT(xfer)	4
+#define PACKET_IN(xfer)		((xfer) + 4)
+#define PACKET_LENGTH(xfer)	(2 * (xfer) + 4)
+#define PACKET_NB_BITS(xfer)	(2 * (xfer) + 8)
+
+static uint32_t get_le32(const uint8_t *buf)
+{
+	return buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+static void put_le32(uint8_t *buf, uint32_t value)
+{
+	for (unsigned int i = 0; i < 4; i++)
+		buf[i] = value >> (8 * i);
+}
+
+/*
+ * Buffered connection: pipelined packets are read many at a time, and the
+ * responses are only written once no more input is waiting.
+ */
+static struct {
+	int fd;
+	uint8_t *in, *out;
+	size_t in_size, in_pos, in_len;
+	size_t out_size, out_len;
+} conn;
+
+static int conn_flush(void)
+{
+	size_t done = 0;
+
+	while (done < conn.out_len) {
+		ssize_t n = write(conn.fd, conn.out + done, conn.out_len - done);
+		if (n <= 0)
+			return -1;
+		done += n;
+	}
+	conn.out_len = 0;
+	return 0;
+}
+
+static int conn_read(uint8_t *buf, size_t len)
+{
+	while (len) {
+		if (conn.in_pos == conn.in_len) {
+			if (conn_flush() < 0)
+				return -1;
+			ssize_t n = read(conn.fd, conn.in, conn.in_size);
+			if (n <= 0)
+				return -1;
+			conn.in_pos = 0;
+			conn.in_len = n;
+		}
+		size_t chunk = conn.in_len - conn.in_pos;
+		if (chunk > len)
+			chunk = len;
+		memcpy(buf, conn.in + conn.in_pos, chunk);
+		conn.in_pos += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+static int conn_write(const uint8_t *buf, size_t len)
+{
+	if (conn.out_len + len > conn.out_size && conn_flush() < 0)
+		return -1;
+	if (len > conn.out_size) {
+		ssize_t n = write(conn.fd, buf, len);
+		return n == (ssize_t)len ? 0 : -1;
+	}
+	memcpy(conn.out + conn.out_len, buf, len);
+	conn.out_len += len;
+	return 0;
+}
+
+/* Serve a connection; returns true when asked to stop the simulation */
+static bool serve(unsigned int max_xfer)
+{
+	unsigned long long packets = 0, scans = 0, bits = 0;
+	unsigned int xfer = XFERT_MAX_SIZE;
+	uint8_t *packet = malloc(PACKET_SIZE(max_xfer));
+	bool stop = false;
+	struct timespec start, end;
+
+	if (!packet)
+		return true;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (conn_read(packet, PACKET_SIZE(xfer)) == 0) {
+		uint32_t cmd = get_le32(packet);
+		uint32_t length = get_le32(packet + PACKET_LENGTH(xfer));
+		uint32_t nb_bits = get_le32(packet + PACKET_NB_BITS(xfer));
+
+		packets++;
+		if (cmd == CMD_STOP_SIMU) {
+			stop = true;
+			break;
+		} else if (cmd == CMD_SCAN_CHAIN || cmd == CMD_SCAN_CHAIN_FLIP_TMS) {
+			if (length > xfer || nb_bits > 8 * length) {
+				fprintf(stderr, "Invalid scan of %u bits\n", nb_bits);
+				break;
+			}
+			memcpy(packet + PACKET_IN(xfer), packet + PACKET_OUT(xfer), length);
+			if (conn_write(packet, PACKET_SIZE(xfer)) < 0)
+				break;
+			scans++;
+			bits += nb_bits;
+		} else if (cmd == CMD_SET_XFER_SIZE) {
+			/* answer in the current packet size, then switch */
+			uint32_t size = length < max_xfer ? length : max_xfer;
+			if (size < XFERT_MAX_SIZE)
+				size = XFERT_MAX_SIZE;
+			put_le32(packet + PACKET_LENGTH(xfer), size);
+			if (conn_write(packet, PACKET_SIZE(xfer)) < 0)
+				break;
+			xfer = size;
+			fprintf(stderr, "Transfer size set to %u bytes\n", xfer);
+		} else if (cmd != CMD_RESET && cmd != CMD_TMS_SEQ) {
+			fprintf(stderr, "Unknown command %u received\n", cmd);
+		}
+	}
+	conn_flush();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "Connection closed: %llu packets, %llu scans, %llu bits "
+			"in %.3f s (%.3f Mbit/s)\n", packets, scans, bits, seconds,
+			seconds > 0 ? bits / seconds / 1e6 : 0);
+
+	free(packet);
+	return stop;
+}
+
+int main(int argc, char *argv[])
+{
+	int port = argc > 1 ? atoi(argv[1]) : 5555;
+	unsigned int max_xfer = argc > 2 ? strtoul(argv[2], NULL, 0) : 64 * 1024;
+	int one = 1;
+
+	if (argc > 3 || port <= 0 || max_xfer < XFERT_MAX_SIZE) {
+		fprintf(stderr, "usage: %s [port [max_xfer_size]]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	conn.in_size = conn.out_size = 4 * PACKET_SIZE(max_xfer);
+	if (conn.out_size < 256 * 1024)
+		conn.in_size = conn.out_size = 256 * 1024;
+	conn.in = malloc(conn.in_size);
+	conn.out = malloc(conn.out_size);
+	if (!conn.in || !conn.out)
+		return EXIT_FAILURE;
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+		perror("listen");
+		return EXIT_FAILURE;
+	}
+	fprintf(stderr, "Listening on port %d, transfers of up to %u bytes\n", port, max_xfer);
+
+	bool stop = false;
+	while (!stop) {
+		conn.fd = accept(fd, NULL, NULL);
+		if (conn.fd < 0) {
+			perror("accept");
+			return EXIT_FAILURE;
+		}
+		setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		conn.in_pos = conn.in_len = conn.out_len = 0;
+		stop = serve(max_xfer);
+		close(conn.fd);
+	}
+
+	close(fd);
+	return EXIT_SUCCESS;
+}
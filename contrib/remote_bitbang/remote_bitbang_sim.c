@@ -0,0 +1,497 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+  Reference server for the OpenOCD remote_bitbang interface driver, with a
+  simulated TAP, implementing both the ASCII protocol and its binary
+  extension (see doc/manual/jtag/drivers/remote_bitbang.txt). It also has a
+  client mode measuring the scan throughput of a server with either
+  encoding.
+
+  The simulated TAP has a 5 bit IR, an IDCODE register (IR 0x01, selected
+  after reset) and a BYPASS register (any other IR value).
+
+  To compile run:
+  gcc -Wall -O2 -std=gnu99 -o remote_bitbang_sim remote_bitbang_sim.c
+
+  Usage example, serving on TCP port 3335:
+  ./remote_bitbang_sim 3335
+
+  On host run:
+  openocd -c "adapter driver remote_bitbang; remote_bitbang port 3335; remote_bitbang binary on" \
+	  -c "jtag newtap sim tap -irlen 5 -expected-id 0x10000001"
+
+  To serve with the ASCII protocol only, as an older server would:
+  ./remote_bitbang_sim -a 3335
+
+  To measure the throughput of a server, shifting 8 Mbits:
+  ./remote_bitbang_sim -b localhost 3335 8388608
+*/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define BINARY_VERSION	1
+
+#define IR_LEN			5
+#define IR_IDCODE		0x01
+#define IDCODE			0x10000001
+
+/* Bits per shift request of the benchmark, as OpenOCD sends them */
+#define BENCH_CHUNK		1024
+
+enum tap_state {
+	TEST_LOGIC_RESET, RUN_TEST_IDLE,
+	SELECT_DR_SCAN, CAPTURE_DR, SHIFT_DR, EXIT1_DR, PAUSE_DR, EXIT2_DR, UPDATE_DR,
+	SELECT_IR_SCAN, CAPTURE_IR, SHIFT_IR, EXIT1_IR, PAUSE_IR, EXIT2_IR, UPDATE_IR,
+};
+
+/* next state, for tms 0 and tms 1 */
+static const enum tap_state tap_next[16][2] = {
+	[TEST_LOGIC_RESET] = { RUN_TEST_IDLE, TEST_LOGIC_RESET },
+	[RUN_TEST_IDLE] = { RUN_TEST_IDLE, SELECT_DR_SCAN },
+	[SELECT_DR_SCAN] = { CAPTURE_DR, SELECT_IR_SCAN },
+	[CAPTURE_DR] = { SHIFT_DR, EXIT1_DR },
+	[SHIFT_DR] = { SHIFT_DR, EXIT1_DR },
+	[EXIT1_DR] = { PAUSE_DR, UPDATE_DR },
+	[PAUSE_DR] = { PAUSE_DR, EXIT2_DR },
+	[EXIT2_DR] = { SHIFT_DR, UPDATE_DR },
+	[UPDATE_DR] = { RUN_TEST_IDLE, SELECT_DR_SCAN },
+	[SELECT_IR_SCAN] = { CAPTURE_IR, TEST_LOGIC_RESET },
+	[CAPTURE_IR] = { SHIFT_IR, EXIT1_IR },
+	[SHIFT_IR] = { SHIFT_IR, EXIT1_IR },
+	[EXIT1_IR] = { PAUSE_IR, UPDATE_IR },
+	[PAUSE_IR] = { PAUSE_IR, EXIT2_IR },
+	[EXIT2_IR] = { SHIFT_IR, UPDATE_IR },
+	[UPDATE_IR] = { RUN_TEST_IDLE, SELECT_DR_SCAN },
+};
+
+static struct {
+	enum tap_state state;
+	uint32_t ir, ir_shift;
+	uint32_t dr_shift;
+	unsigned int dr_len;
+	int tck, tms, tdi, tdo;
+} tap;
+
+static void tap_reset(void)
+{
+	tap.state = TEST_LOGIC_RESET;
+	tap.ir = IR_IDCODE;
+}
+
+/* TDO changes on the falling edge of TCK, the TAP moves on the rising edge */
+static void tap_write(int tck, int tms, int tdi)
+{
+	if (tck && !tap.tck) {
+		switch (tap.state) {
+		case TEST_LOGIC_RESET:
+			tap.ir = IR_IDCODE;
+			break;
+		case CAPTURE_DR:
+			if (tap.ir == IR_IDCODE) {
+				tap.dr_shift = IDCODE;
+				tap.dr_len = 32;
+			} else {
+				tap.dr_shift = 0;
+				tap.dr_len = 1;
+			}
+			break;
+		case SHIFT_DR:
+			tap.dr_shift = (tap.dr_shift >> 1) | ((uint32_t)tdi << (tap.dr_len - 1));
+			break;
+		case CAPTURE_IR:
+			tap.ir_shift = 0x01;
+			break;
+		case SHIFT_IR:
+			tap.ir_shift = (tap.ir_shift >> 1) | ((uint32_t)tdi << (IR_LEN - 1));
+			break;
+		case UPDATE_IR:
+			tap.ir = tap.ir_shift;
+			break;
+		default:
+			break;
+		}
+		tap.state = tap_next[tap.state][tms];
+	} else if (!tck && tap.tck) {
+		if (tap.state == SHIFT_DR)
+			tap.tdo = tap.dr_shift & 1;
+		else if (tap.state == SHIFT_IR)
+			tap.tdo = tap.ir_shift & 1;
+	}
+
+	tap.tck = tck;
+	tap.tms = tms;
+	tap.tdi = tdi;
+}
+
+/*
+ * Buffered connection, so that pipelined requests cost one system call per
+ * buffer rather than per character. Output is flushed whenever the input
+ * runs dry, as the client may then be waiting for it.
+ */
+static struct {
+	int fd;
+	uint8_t in[65536], out[65536];
+	size_t in_pos, in_len, out_len;
+} conn;
+
+static int conn_flush(void)
+{
+	size_t done = 0;
+
+	while (done < conn.out_len) {
+		ssize_t n = write(conn.fd, conn.out + done, conn.out_len - done);
+		if (n <= 0)
+			return -1;
+		done += n;
+	}
+	conn.out_len = 0;
+	return 0;
+}
+
+static int conn_putc(uint8_t c)
+{
+	if (conn.out_len == sizeof(conn.out) && conn_flush() < 0)
+		return -1;
+	conn.out[conn.out_len++] = c;
+	return 0;
+}
+
+static int conn_getc(void)
+{
+	if (conn.in_pos == conn.in_len) {
+		if (conn_flush() < 0)
+			return EOF;
+		ssize_t n = read(conn.fd, conn.in, sizeof(conn.in));
+		if (n <= 0)
+			return EOF;
+		conn.in_pos = 0;
+		conn.in_len = n;
+	}
+	return conn.in[conn.in_pos++];
+}
+
+static int conn_get_u32(uint32_t *value)
+{
+	*value = 0;
+	for (unsigned int i = 0; i < 4; i++) {
+		int c = conn_getc();
+		if (c == EOF)
+			return -1;
+		*value |= (uint32_t)c << (8 * i);
+	}
+	return 0;
+}
+
+/* 'S' request: read the payload, shift, answer the TDO bits if asked */
+static int serve_shift(void)
+{
+	int flags = conn_getc();
+	uint32_t count;
+
+	if (flags == EOF || conn_get_u32(&count) < 0)
+		return -1;
+
+	size_t len = (count + 7) / 8;
+	uint8_t *buf = malloc(2 * len);
+	if (!buf)
+		return -1;
+	for (size_t i = 0; i < 2 * len; i++) {
+		int c = conn_getc();
+		if (c == EOF) {
+			free(buf);
+			return -1;
+		}
+		buf[i] = c;
+	}
+
+	const uint8_t *tms = buf, *tdi = buf + len;
+	uint8_t tdo = 0;
+	int retval = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		int tms_bit = (tms[i / 8] >> (i % 8)) & 1;
+		int tdi_bit = (tdi[i / 8] >> (i % 8)) & 1;
+
+		tap_write(0, tms_bit, tdi_bit);
+		if (flags & 1) {
+			tdo |= tap.tdo << (i % 8);
+			if (i % 8 == 7 || i == count - 1) {
+				retval |= conn_putc(tdo);
+				tdo = 0;
+			}
+		}
+		tap_write(1, tms_bit, tdi_bit);
+	}
+
+	free(buf);
+	return retval;
+}
+
+/* 'I' request: run idle clocks */
+static int serve_idle(void)
+{
+	int lines = conn_getc();
+	uint32_t count;
+
+	if (lines == EOF || conn_get_u32(&count) < 0)
+		return -1;
+
+	for (uint32_t i = 0; i < count; i++) {
+		tap_write(0, !!(lines & 2), lines & 1);
+		tap_write(1, !!(lines & 2), lines & 1);
+	}
+	return 0;
+}
+
+static void serve(bool binary)
+{
+	unsigned long long requests = 0;
+
+	tap_reset();
+
+	while (1) {
+		int c = conn_getc();
+		int retval = 0;
+
+		if (c == EOF || c == 'Q') /* Quit */
+			break;
+
+		requests++;
+		if (c == 'b' || c == 'B') /* Blink */
+			continue;
+		else if (c >= 'r' && c <= 'r' + 3) { /* Reset */
+			if ((c - 'r') & 2)
+				tap_reset();
+		} else if (c >= '0' && c <= '0' + 7) { /* Write */
+			int d = c - '0';
+			tap_write(!!(d & 4), !!(d & 2), d & 1);
+		} else if (c == 'R') {
+			retval = conn_putc('0' + tap.tdo);
+		} else if (binary && c == 'X') {
+			retval = conn_putc('X') | conn_putc(BINARY_VERSION);
+		} else if (binary && c == 'S') {
+			retval = serve_shift();
+		} else if (binary && c == 'I') {
+			retval = serve_idle();
+		} else {
+			fprintf(stderr, "Unknown command '%c' received\n", c);
+		}
+
+		if (retval < 0)
+			break;
+	}
+
+	conn_flush();
+	fprintf(stderr, "Connection closed after %llu requests\n", requests);
+}
+
+static int server(const char *port, bool binary)
+{
+	struct addrinfo hints = {
+		.ai_family = AF_INET6,
+		.ai_socktype = SOCK_STREAM,
+		.ai_flags = AI_PASSIVE,
+	};
+	struct addrinfo *res;
+	int one = 1;
+
+	if (getaddrinfo(NULL, port, &hints, &res) != 0) {
+		fprintf(stderr, "Invalid port %s\n", port);
+		return EXIT_FAILURE;
+	}
+
+	int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (fd < 0) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, res->ai_addr, res->ai_addrlen) < 0 || listen(fd, 1) < 0) {
+		perror("bind");
+		return EXIT_FAILURE;
+	}
+	freeaddrinfo(res);
+
+	fprintf(stderr, "Serving %s on port %s\n",
+			binary ? "ASCII and binary requests" : "ASCII requests", port);
+
+	while (1) {
+		conn.fd = accept(fd, NULL, NULL);
+		if (conn.fd < 0) {
+			perror("accept");
+			return EXIT_FAILURE;
+		}
+		setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		conn.in_pos = conn.in_len = conn.out_len = 0;
+		serve(binary);
+		close(conn.fd);
+	}
+}
+
+static int bench_connect(const char *host, const char *port)
+{
+	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+	struct addrinfo *res, *rp;
+	int one = 1;
+
+	if (getaddrinfo(host, port, &hints, &res) != 0) {
+		fprintf(stderr, "Cannot resolve %s:%s\n", host, port);
+		return -1;
+	}
+	for (rp = res; rp; rp = rp->ai_next) {
+		conn.fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+		if (conn.fd < 0)
+			continue;
+		if (connect(conn.fd, rp->ai_addr, rp->ai_addrlen) == 0)
+			break;
+		close(conn.fd);
+	}
+	freeaddrinfo(res);
+	if (!rp) {
+		fprintf(stderr, "Cannot connect to %s:%s\n", host, port);
+		return -1;
+	}
+	setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	conn.in_pos = conn.in_len = conn.out_len = 0;
+	return 0;
+}
+
+/* Shift count bits of tdi, with tms low, reading back tdo */
+static int bench_shift(bool binary, const uint8_t *tdi, uint8_t *tdo, uint32_t count)
+{
+	if (binary) {
+		size_t len = (count + 7) / 8;
+
+		conn_putc('S');
+		conn_putc(1);
+		for (unsigned int i = 0; i < 4; i++)
+			conn_putc(count >> (8 * i));
+		for (size_t i = 0; i < len; i++)
+			conn_putc(0);
+		for (size_t i = 0; i < len; i++)
+			conn_putc(tdi[i]);
+		for (size_t i = 0; i < len; i++) {
+			int c = conn_getc();
+			if (c == EOF)
+				return -1;
+			tdo[i] = c;
+		}
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		int bit = (tdi[i / 8] >> (i % 8)) & 1;
+		conn_putc('0' + bit);
+		conn_putc('R');
+		conn_putc('4' + bit);
+	}
+	memset(tdo, 0, (count + 7) / 8);
+	for (uint32_t i = 0; i < count; i++) {
+		int c = conn_getc();
+		if (c != '0' && c != '1')
+			return -1;
+		tdo[i / 8] |= (c - '0') << (i % 8);
+	}
+	return 0;
+}
+
+/* Scan the IDCODE register through and check it comes back delayed by 32 bits */
+static double bench_run(bool binary, unsigned long bits)
+{
+	/* reset, then through run-test/idle, select-dr-scan and capture-dr to shift-dr */
+	static const char *const to_shift_dr = "2626262626" "04" "26" "04" "04";
+	uint8_t tdi[BENCH_CHUNK / 8], tdo[BENCH_CHUNK / 8], prev[BENCH_CHUNK / 8];
+	struct timespec start, end;
+	bool first = true;
+
+	for (const char *p = to_shift_dr; *p; p++)
+		conn_putc(*p);
+
+	srand(1);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned long done = 0; done < bits; done += BENCH_CHUNK) {
+		for (size_t i = 0; i < sizeof(tdi); i++)
+			tdi[i] = rand();
+		if (bench_shift(binary, tdi, tdo, BENCH_CHUNK) < 0) {
+			fprintf(stderr, "Connection lost\n");
+			return -1;
+		}
+		/* the first 32 bits out are the IDCODE, then the previous tdi bits */
+		uint32_t head = tdo[0] | tdo[1] << 8 | tdo[2] << 16 | (uint32_t)tdo[3] << 24;
+		uint32_t expected = first ? IDCODE : (prev[sizeof(prev) - 4] |
+				prev[sizeof(prev) - 3] << 8 | prev[sizeof(prev) - 2] << 16 |
+				(uint32_t)prev[sizeof(prev) - 1] << 24);
+		if (head != expected || memcmp(tdo + 4, tdi, sizeof(tdo) - 4)) {
+			fprintf(stderr, "Data mismatch after %lu bits\n", done);
+			return -1;
+		}
+		memcpy(prev, tdi, sizeof(prev));
+		first = false;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	return bits / seconds;
+}
+
+static int bench(const char *host, const char *port, unsigned long bits)
+{
+	bits = (bits + BENCH_CHUNK - 1) / BENCH_CHUNK * BENCH_CHUNK;
+
+	for (int binary = 0; binary < 2; binary++) {
+		if (bench_connect(host, port) < 0)
+			return EXIT_FAILURE;
+
+		if (binary) {
+			conn_putc('X');
+			conn_putc('R');
+			if (conn_getc() != 'X') {
+				fprintf(stderr, "Server has no binary extension\n");
+				close(conn.fd);
+				break;
+			}
+			conn_getc();
+			conn_getc();
+		}
+
+		double rate = bench_run(binary, bits);
+		conn_putc('Q');
+		conn_flush();
+		close(conn.fd);
+		if (rate < 0)
+			return EXIT_FAILURE;
+		printf("%-6s %10lu bits  %10.3f Mbit/s\n",
+				binary ? "binary" : "ASCII", bits, rate / 1e6);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-a] port\n"
+			"       %s -b host port bits\n", name, name);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2)
+		return server(argv[1], true);
+	if (argc == 3 && !strcmp(argv[1], "-a"))
+		return server(argv[2], false);
+	if (argc == 5 && !strcmp(argv[1], "-b"))
+		return bench(argv[2], argv[3], strtoul(argv[4], NULL, 0));
+
+	usage(argv[0]);
+	return EXIT_FAILURE;
+}
@@ -40,6 +40,14 @@ static const char hex_digits[] = {
 	'a', 'b', 'c', 'd', 'e', 'f'
 };
 
+/* value + 1 of each hexadecimal digit, 0 for other characters */
+static const uint8_t hex_values[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
 void *buf_cpy(const void *from, void *_to, unsigned size)
 {
 	if (!from || !_to)
@@ -74,7 +82,7 @@ bool buf_cmp(const void *_buf1, const void *_buf2, unsigned size)
 
 	unsigned last = size / 8;
 	if (memcmp(_buf1, _buf2, last) != 0)
-		return false;
+		return true;
 
 	unsigned trailing = size % 8;
 	if (!trailing)
@@ -90,16 +98,51 @@ bool buf_cmp_mask(const void *_buf1, const void *_buf2,
 	if (!_buf1 || !_buf2)
 		return _buf1 != _buf2 || _buf1 != _mask;
 
+	return buf_cmp_mask_offset(_buf1, _buf2, _mask, size) >= 0;
+}
+
+int buf_cmp_mask_offset(const void *_buf1, const void *_buf2,
+	const void *_mask, unsigned size)
+{
+	if (!_buf1 || !_buf2)
+		return (_buf1 == _buf2) ? -1 : 0;
+
 	const uint8_t *buf1 = _buf1, *buf2 = _buf2, *mask = _mask;
 	unsigned last = size / 8;
-	for (unsigned i = 0; i < last; i++) {
-		if (buf_cmp_masked(buf1[i], buf2[i], mask[i]))
-			return true;
+	unsigned i = 0;
+
+	/* skip the matching words, then locate the byte */
+	for (; i + sizeof(uint64_t) <= last; i += sizeof(uint64_t)) {
+		uint64_t a, b, m = UINT64_MAX;
+		memcpy(&a, buf1 + i, sizeof(a));
+		memcpy(&b, buf2 + i, sizeof(b));
+		if (mask)
+			memcpy(&m, mask + i, sizeof(m));
+		if ((a ^ b) & m)
+			break;
 	}
-	unsigned trailing = size % 8;
-	if (!trailing)
-		return false;
-	return buf_cmp_trailing(buf1[last], buf2[last], mask[last], trailing);
+
+	uint8_t diff = 0;
+	for (; i < last && !diff; i++)
+		diff = (buf1[i] ^ buf2[i]) & (mask ? mask[i] : 0xff);
+
+	if (!diff) {
+		unsigned trailing = size % 8;
+		if (!trailing)
+			return -1;
+		diff = (buf1[last] ^ buf2[last]) & (mask ? mask[last] : 0xff)
+			& ((1 << trailing) - 1);
+		if (!diff)
+			return -1;
+		i = last + 1;
+	}
+
+	int offset = (i - 1) * 8;
+	while (!(diff & 1)) {
+		diff >>= 1;
+		offset++;
+	}
+	return offset;
 }
 
 
@@ -118,38 +161,26 @@ void *buf_set_ones(void *_buf, unsigned size)
 	return buf;
 }
 
-void *buf_set_buf(const void *_src, unsigned src_start,
-	void *_dst, unsigned dst_start, unsigned len)
+/* @returns @a n (at most 8) bits of @a src, starting at bit @a sq (< 8) */
+static inline uint8_t buf_get_bits8(const uint8_t *src, unsigned sq, unsigned n)
 {
-	const uint8_t *src = _src;
-	uint8_t *dst = _dst;
-	unsigned i, sb, db, sq, dq, lb, lq;
+	unsigned value = src[0] >> sq;
 
-	sb = src_start / 8;
-	db = dst_start / 8;
-	sq = src_start % 8;
-	dq = dst_start % 8;
-	lb = len / 8;
-	lq = len % 8;
-
-	src += sb;
-	dst += db;
-
-	/* check if both buffers are on byte boundary and
-	 * len is a multiple of 8bit so we can simple copy
-	 * the buffer */
-	if ((sq == 0) && (dq == 0) &&  (lq == 0)) {
-		for (i = 0; i < lb; i++)
-			*dst++ = *src++;
-		return _dst;
-	}
+	if (sq + n > 8)
+		value |= src[1] << (8 - sq);
 
-	/* fallback to slow bit copy */
-	for (i = 0; i < len; i++) {
-		if (((*src >> (sq&7)) & 1) == 1)
-			*dst |= 1 << (dq&7);
+	return value & ((1 << n) - 1);
+}
+
+/* copy one bit at a time, from the first one: for overlapping buffers */
+static void buf_set_buf_bits(const uint8_t *src, unsigned sq,
+	uint8_t *dst, unsigned dq, unsigned len)
+{
+	for (unsigned i = 0; i < len; i++) {
+		if (((*src >> sq) & 1) == 1)
+			*dst |= 1 << dq;
 		else
-			*dst &= ~(1 << (dq&7));
+			*dst &= ~(1 << dq);
 		if (sq++ == 7) {
 			sq = 0;
 			src++;
@@ -159,6 +190,64 @@ void *buf_set_buf(const void *_src, unsigned src_start,
 			dst++;
 		}
 	}
+}
+
+void *buf_set_buf(const void *_src, unsigned src_start,
+	void *_dst, unsigned dst_start, unsigned len)
+{
+	const uint8_t *src = _src;
+	uint8_t *dst = _dst;
+	unsigned sq, dq;
+
+	if (len == 0)
+		return _dst;
+
+	src += src_start / 8;
+	dst += dst_start / 8;
+	sq = src_start % 8;
+	dq = dst_start % 8;
+
+	/* the word and memcpy() copies below need distinct buffers */
+	uintptr_t src_first = (uintptr_t)src, src_end = src_first + (sq + len + 7) / 8;
+	uintptr_t dst_first = (uintptr_t)dst, dst_end = dst_first + (dq + len + 7) / 8;
+	if (src_first < dst_end && dst_first < src_end) {
+		buf_set_buf_bits(src, sq, dst, dq, len);
+		return _dst;
+	}
+
+	/* complete the first destination byte, if it is shared */
+	if (dq) {
+		unsigned n = MIN(8 - dq, len);
+		uint8_t mask = ((1 << n) - 1) << dq;
+
+		*dst = (*dst & ~mask) | ((buf_get_bits8(src, sq, n) << dq) & mask);
+		dst++;
+		sq += n;
+		src += sq / 8;
+		sq %= 8;
+		len -= n;
+	}
+
+	/* the destination is byte aligned from here on */
+	if (sq == 0) {
+		memcpy(dst, src, len / 8);
+		src += len / 8;
+		dst += len / 8;
+		len %= 8;
+	} else {
+		/* each destination word takes the top of a source word and the
+		 * bottom of the next source byte, which holds bits to copy */
+		for (; len >= 64; len -= 64, src += 8, dst += 8)
+			h_u64_to_le(dst, le_to_h_u64(src) >> sq | (uint64_t)src[8] << (64 - sq));
+		for (; len >= 8; len -= 8, src++, dst++)
+			*dst = src[0] >> sq | src[1] << (8 - sq);
+	}
+
+	/* the last destination byte keeps its bits above len */
+	if (len) {
+		uint8_t mask = (1 << len) - 1;
+		*dst = (*dst & ~mask) | buf_get_bits8(src, sq, len);
+	}
 
 	return _dst;
 }
@@ -230,15 +319,42 @@ static void str_radix_guess(const char **_str, unsigned *_str_len,
 	*_radix = radix;
 }
 
+/* str_to_buf() for radix 16, each digit gives 4 bits without arithmetic */
+static int str_to_buf_hex(const char *str, unsigned str_len,
+	uint8_t *buf, unsigned buf_len)
+{
+	unsigned len = strnlen(str, str_len);
+	unsigned buf_bytes = DIV_ROUND_UP(buf_len, 8);
+	unsigned nibble = 0;
+
+	memset(buf, 0, buf_bytes);
+
+	/* least significant digit last, skip characters other than digits */
+	for (unsigned i = len; i-- > 0 && nibble < 2 * buf_bytes; ) {
+		uint8_t value = hex_values[(uint8_t)str[i]];
+		if (!value)
+			continue;
+		buf[nibble / 2] |= (value - 1) << (4 * (nibble % 2));
+		nibble++;
+	}
+
+	/* mask out bits that don't belong to the buffer */
+	if (buf_len % 8)
+		buf[(buf_len / 8)] &= 0xff >> (8 - (buf_len % 8));
+
+	return len;
+}
+
 int str_to_buf(const char *str, unsigned str_len,
 	void *_buf, unsigned buf_len, unsigned radix)
 {
 	str_radix_guess(&str, &str_len, &radix);
 
-	float factor;
 	if (radix == 16)
-		factor = 0.5;	/* log(16) / log(256) = 0.5 */
-	else if (radix == 10)
+		return str_to_buf_hex(str, str_len, _buf, buf_len);
+
+	float factor;
+	if (radix == 10)
 		factor = 0.41524;	/* log(10) / log(256) = 0.41524 */
 	else if (radix == 8)
 		factor = 0.375;	/* log(8) / log(256) = 0.375 */
@@ -304,7 +420,24 @@ void bit_copy_queue_init(struct bit_copy_queue *q)
 int bit_copy_queued(struct bit_copy_queue *q, uint8_t *dst, unsigned dst_offset, const uint8_t *src,
 	unsigned src_offset, unsigned bit_count)
 {
-	struct bit_copy_queue_entry *qe = malloc(sizeof(*qe));
+	struct bit_copy_queue_entry *qe;
+
+	/* extend the last entry when this copy continues it on both sides */
+	if (!list_empty(&q->list)) {
+		qe = list_last_entry(&q->list, struct bit_copy_queue_entry, list);
+		unsigned qe_dst_end = qe->dst_offset + qe->bit_count;
+		unsigned qe_src_end = qe->src_offset + qe->bit_count;
+
+		if (qe->dst + qe_dst_end / 8 == dst + dst_offset / 8
+				&& qe_dst_end % 8 == dst_offset % 8
+				&& qe->src + qe_src_end / 8 == src + src_offset / 8
+				&& qe_src_end % 8 == src_offset % 8) {
+			qe->bit_count += bit_count;
+			return ERROR_OK;
+		}
+	}
+
+	qe = malloc(sizeof(*qe));
 	if (!qe)
 		return ERROR_FAIL;
 
@@ -354,27 +487,29 @@ void bit_copy_discard(struct bit_copy_queue *q)
 size_t unhexify(uint8_t *bin, const char *hex, size_t count)
 {
 	size_t i;
-	char tmp;
 
 	if (!bin || !hex)
 		return 0;
 
-	memset(bin, 0, count);
-
-	for (i = 0; i < 2 * count; i++) {
-		if (hex[i] >= 'a' && hex[i] <= 'f')
-			tmp = hex[i] - 'a' + 10;
-		else if (hex[i] >= 'A' && hex[i] <= 'F')
-			tmp = hex[i] - 'A' + 10;
-		else if (hex[i] >= '0' && hex[i] <= '9')
-			tmp = hex[i] - '0';
-		else
-			return i / 2;
+	for (i = 0; i < count; i++) {
+		uint8_t high = hex_values[(uint8_t)hex[2 * i]];
+		if (!high)
+			break;
+
+		uint8_t low = hex_values[(uint8_t)hex[2 * i + 1]];
+		if (!low) {
+			/* keep the high nibble of an incomplete pair */
+			bin[i++] = (high - 1) << 4;
+			memset(bin + i, 0, count - i);
+			return i - 1;
+		}
 
-		bin[i / 2] |= tmp << (4 * ((i + 1) % 2));
+		bin[i] = (high - 1) << 4 | (low - 1);
 	}
 
-	return i / 2;
+	memset(bin + i, 0, count - i);
+
+	return i;
 }
 
 /**
@@ -392,14 +527,21 @@ size_t unhexify(uint8_t *bin, const char *hex, size_t count)
 size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t length)
 {
 	size_t i;
-	uint8_t tmp;
 
 	if (!length)
 		return 0;
 
-	for (i = 0; i < length - 1 && i < 2 * count; i++) {
-		tmp = (bin[i / 2] >> (4 * ((i + 1) % 2))) & 0x0f;
-		hex[i] = hex_digits[tmp];
+	size_t digits = MIN(2 * count, length - 1);
+
+	for (i = 0; i + 1 < digits; i += 2) {
+		hex[i] = hex_digits[bin[i / 2] >> 4];
+		hex[i + 1] = hex_digits[bin[i / 2] & 0x0f];
+	}
+
+	/* room for the high nibble only */
+	if (i < digits) {
+		hex[i] = hex_digits[bin[i / 2] >> 4];
+		i++;
 	}
 
 	hex[i] = 0;
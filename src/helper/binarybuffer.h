@@ -168,6 +168,17 @@ bool buf_cmp(const void *buf1, const void *buf2, unsigned size);
 bool buf_cmp_mask(const void *buf1, const void *buf2,
 		const void *mask, unsigned size);
 
+/**
+ * Compare the first @c size bits of two buffers, a word at a time.
+ * @param buf1 The first buffer.
+ * @param buf2 The second buffer.
+ * @param mask The bits to compare, or NULL to compare all of them.
+ * @param size The number of bits.
+ * @returns The offset of the first differing bit, or -1 if they match.
+ */
+int buf_cmp_mask_offset(const void *buf1, const void *buf2,
+		const void *mask, unsigned size);
+
 /**
  * Copies @c size bits out of @c from and into @c to.  Any extra
  * bits in the final byte will be set to zero.
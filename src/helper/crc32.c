@@ -13,9 +13,106 @@
 #endif
 
 #include "crc32.h"
+#include "types.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+/*
+ * Slicing-by-8: table k gives the CRC contribution of a byte followed by k
+ * zero bytes, so eight bytes are folded in with eight independent lookups.
+ * The tables are only built for the polynomials in use in the code base,
+ * other polynomials go through the bitwise implementation.
+ */
+static uint32_t crc32_le_tables[8][256];
+static uint32_t crc32_be_tables[8][256];
+
+static void crc32_le_init_tables(void)
+{
+	static bool initialized;
+
+	if (initialized)
+		return;
+
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (unsigned int j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ CRC32_POLY_LE : c >> 1;
+		crc32_le_tables[0][i] = c;
+	}
+	for (unsigned int k = 1; k < 8; k++)
+		for (unsigned int i = 0; i < 256; i++) {
+			uint32_t c = crc32_le_tables[k - 1][i];
+			crc32_le_tables[k][i] = (c >> 8) ^ crc32_le_tables[0][c & 0xff];
+		}
+
+	initialized = true;
+}
+
+static void crc32_be_init_tables(void)
+{
+	static bool initialized;
+
+	if (initialized)
+		return;
+
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t c = i << 24;
+		for (unsigned int j = 0; j < 8; j++)
+			c = (c & 0x80000000) ? (c << 1) ^ CRC32_POLY_BE : c << 1;
+		crc32_be_tables[0][i] = c;
+	}
+	for (unsigned int k = 1; k < 8; k++)
+		for (unsigned int i = 0; i < 256; i++) {
+			uint32_t c = crc32_be_tables[k - 1][i];
+			crc32_be_tables[k][i] = (c << 8) ^ crc32_be_tables[0][c >> 24];
+		}
+
+	initialized = true;
+}
+
+static uint32_t crc32_le_slice8(uint32_t crc, const uint8_t *data, size_t data_len)
+{
+	const uint32_t (*t)[256] = crc32_le_tables;
+
+	crc32_le_init_tables();
+
+	for (; data_len >= 8; data_len -= 8, data += 8) {
+		uint32_t one = le_to_h_u32(data) ^ crc;
+		uint32_t two = le_to_h_u32(data + 4);
+		crc = t[7][one & 0xff] ^ t[6][(one >> 8) & 0xff] ^
+			t[5][(one >> 16) & 0xff] ^ t[4][one >> 24] ^
+			t[3][two & 0xff] ^ t[2][(two >> 8) & 0xff] ^
+			t[1][(two >> 16) & 0xff] ^ t[0][two >> 24];
+	}
+
+	while (data_len--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+
+	return crc;
+}
+
+static uint32_t crc32_be_slice8(uint32_t crc, const uint8_t *data, size_t data_len)
+{
+	const uint32_t (*t)[256] = crc32_be_tables;
+
+	crc32_be_init_tables();
+
+	for (; data_len >= 8; data_len -= 8, data += 8) {
+		uint32_t one = be_to_h_u32(data) ^ crc;
+		uint32_t two = be_to_h_u32(data + 4);
+		crc = t[7][one >> 24] ^ t[6][(one >> 16) & 0xff] ^
+			t[5][(one >> 8) & 0xff] ^ t[4][one & 0xff] ^
+			t[3][two >> 24] ^ t[2][(two >> 16) & 0xff] ^
+			t[1][(two >> 8) & 0xff] ^ t[0][two & 0xff];
+	}
+
+	while (data_len--)
+		crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+
+	return crc;
+}
+
 static uint32_t crc_le_step(uint32_t poly, uint32_t crc, uint32_t data_in,
 		unsigned int data_bits)
 {
@@ -33,6 +130,9 @@ static uint32_t crc_le_step(uint32_t poly, uint32_t crc, uint32_t data_in,
 uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *_data,
 		size_t data_len)
 {
+	if (poly == CRC32_POLY_LE)
+		return crc32_le_slice8(seed, _data, data_len);
+
 	if (((uintptr_t)_data & 0x3) || (data_len & 0x3)) {
 		/* data is unaligned, processing data one byte at a time */
 		const uint8_t *data = _data;
@@ -48,3 +148,20 @@ uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *_data,
 
 	return seed;
 }
+
+uint32_t crc32_be(uint32_t poly, uint32_t seed, const void *_data,
+		size_t data_len)
+{
+	const uint8_t *data = _data;
+
+	if (poly == CRC32_POLY_BE)
+		return crc32_be_slice8(seed, data, data_len);
+
+	for (size_t i = 0; i < data_len; i++) {
+		seed ^= (uint32_t)data[i] << 24;
+		for (unsigned int j = 0; j < 8; j++)
+			seed = (seed & 0x80000000) ? (seed << 1) ^ poly : seed << 1;
+	}
+
+	return seed;
+}
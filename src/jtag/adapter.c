@@ -16,6 +16,7 @@
 #include "minidriver.h"
 #include "interface.h"
 #include "interfaces.h"
+#include "recorder.h"
 #include <transport/transport.h>
 
 /**
@@ -183,6 +184,9 @@ int adapter_init(struct command_context *cmd_ctx)
 
 int adapter_quit(void)
 {
+	if (is_adapter_initialized())
+		jtag_wait_queue_noclear();
+
 	if (is_adapter_initialized() && adapter_driver->quit) {
 		/* close the JTAG interface */
 		int result = adapter_driver->quit();
@@ -200,6 +204,10 @@ int adapter_quit(void)
 		t = n;
 	}
 
+	cmd_queue_free();
+	jtag_scan_checks_free();
+	jtag_recorder_stop();
+
 	return ERROR_OK;
 }
 
@@ -241,7 +249,13 @@ static int adapter_set_speed(int speed)
 {
 	/* this command can be called during CONFIG,
 	 * in which case adapter isn't initialized */
-	return is_adapter_initialized() ? adapter_driver->speed(speed) : ERROR_OK;
+	if (!is_adapter_initialized())
+		return ERROR_OK;
+
+	/* the driver can't be used while a queue is in flight */
+	jtag_wait_queue_noclear();
+
+	return adapter_driver->speed(speed);
 }
 
 int adapter_config_khz(unsigned int khz)
@@ -1173,6 +1187,9 @@ static const struct command_registration adapter_command_handlers[] = {
 			"[-pull-none|-pull-up|-pull-down]"
 			"[-init-inactive|-init-active|-init-input] ]",
 	},
+	{
+		.chain = jtag_recorder_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -19,6 +19,8 @@
 #include "config.h"
 #endif
 
+#include <limits.h>
+
 #include <jtag/jtag.h>
 #include <transport/transport.h>
 #include "commands.h"
@@ -26,12 +28,34 @@
 struct cmd_queue_page {
 	struct cmd_queue_page *next;
 	void *address;
+	size_t size;
 	size_t used;
 };
 
 #define CMD_QUEUE_PAGE_SIZE (1024 * 1024)
-static struct cmd_queue_page *cmd_queue_pages;
-static struct cmd_queue_page *cmd_queue_pages_tail;
+
+/*
+ * The pages of the command queue are kept across jtag_command_queue_reset()
+ * and reused by the next queue, so the arena grows to the high-water mark
+ * of the largest queue instead of hitting the heap on every flush.
+ * tail is the page currently being filled, while last is the last page
+ * of the list.
+ */
+struct cmd_queue_arena {
+	struct cmd_queue_page *pages;
+	struct cmd_queue_page *tail;
+	struct cmd_queue_page *last;
+};
+
+/*
+ * Two arenas, so a queue detached by jtag_command_queue_detach() keeps
+ * its memory while the next queue is built in the other arena.
+ */
+static struct cmd_queue_arena cmd_queue_arenas[2];
+static struct cmd_queue_arena *cmd_queue_arena = &cmd_queue_arenas[0];
+static struct cmd_queue_arena *cmd_queue_arena_detached;
+
+static struct cmd_queue_stats cmd_queue_stats;
 
 struct jtag_command *jtag_command_queue;
 static struct jtag_command **next_command_pointer = &jtag_command_queue;
@@ -65,8 +89,7 @@ void jtag_queue_command(struct jtag_command *cmd)
 
 void *cmd_queue_alloc(size_t size)
 {
-	struct cmd_queue_page **p_page = &cmd_queue_pages;
-	int offset;
+	size_t offset;
 	uint8_t *t;
 
 	/*
@@ -101,52 +124,262 @@ void *cmd_queue_alloc(size_t size)
 	size = (size + ALIGN_SIZE - 1) & (~(ALIGN_SIZE - 1));
 	/* Done... */
 
-	if (*p_page) {
-		p_page = &cmd_queue_pages_tail;
-		if (CMD_QUEUE_PAGE_SIZE - (*p_page)->used < size)
-			p_page = &((*p_page)->next);
-	}
+	struct cmd_queue_arena *arena = cmd_queue_arena;
+	struct cmd_queue_page *page = arena->tail;
+	if (page && page->size - page->used < size)
+		page = page->next;
+	else if (!page)
+		page = arena->pages;
+
+	/* skip retained pages too small for this request, they stay for later */
+	while (page && page->size < size)
+		page = page->next;
 
-	if (!*p_page) {
-		*p_page = malloc(sizeof(struct cmd_queue_page));
-		(*p_page)->used = 0;
+	if (page) {
+		if (page != arena->tail)
+			cmd_queue_stats.page_reuses++;
+	} else {
+		page = malloc(sizeof(struct cmd_queue_page));
+		if (!page)
+			return NULL;
 		size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
 					CMD_QUEUE_PAGE_SIZE : size;
-		(*p_page)->address = malloc(alloc_size);
-		(*p_page)->next = NULL;
-		cmd_queue_pages_tail = *p_page;
+		page->address = malloc(alloc_size);
+		if (!page->address) {
+			free(page);
+			return NULL;
+		}
+		page->size = alloc_size;
+		page->used = 0;
+		page->next = NULL;
+
+		if (arena->last)
+			arena->last->next = page;
+		else
+			arena->pages = page;
+		arena->last = page;
+
+		cmd_queue_stats.pages++;
+		cmd_queue_stats.bytes_allocated += alloc_size;
+		cmd_queue_stats.page_allocs++;
 	}
+	arena->tail = page;
+
+	offset = page->used;
+	page->used += size;
 
-	offset = (*p_page)->used;
-	(*p_page)->used += size;
+	cmd_queue_stats.bytes_used += size;
+	if (cmd_queue_stats.bytes_used > cmd_queue_stats.bytes_used_max)
+		cmd_queue_stats.bytes_used_max = cmd_queue_stats.bytes_used;
 
-	t = (*p_page)->address;
+	t = page->address;
 	return t + offset;
 }
 
-static void cmd_queue_free(void)
+void cmd_queue_free(void)
 {
-	struct cmd_queue_page *page = cmd_queue_pages;
+	for (unsigned int i = 0; i < ARRAY_SIZE(cmd_queue_arenas); i++) {
+		struct cmd_queue_arena *arena = &cmd_queue_arenas[i];
+		struct cmd_queue_page *page = arena->pages;
+
+		while (page) {
+			struct cmd_queue_page *last = page;
+			free(page->address);
+			page = page->next;
+			free(last);
+		}
 
-	while (page) {
-		struct cmd_queue_page *last = page;
-		free(page->address);
-		page = page->next;
-		free(last);
+		arena->pages = NULL;
+		arena->tail = NULL;
+		arena->last = NULL;
 	}
 
-	cmd_queue_pages = NULL;
-	cmd_queue_pages_tail = NULL;
+	cmd_queue_stats.pages = 0;
+	cmd_queue_stats.bytes_allocated = 0;
+	cmd_queue_stats.bytes_used = 0;
+}
+
+/* Rewind all the pages, keeping their memory for the next queue */
+static void cmd_queue_rewind(struct cmd_queue_arena *arena)
+{
+	for (struct cmd_queue_page *page = arena->pages; page; page = page->next)
+		page->used = 0;
+
+	arena->tail = NULL;
+}
+
+void cmd_queue_get_stats(struct cmd_queue_stats *stats)
+{
+	*stats = cmd_queue_stats;
 }
 
 void jtag_command_queue_reset(void)
 {
-	cmd_queue_free();
+	cmd_queue_rewind(cmd_queue_arena);
+	cmd_queue_stats.bytes_used = 0;
+	cmd_queue_stats.resets++;
 
 	jtag_command_queue = NULL;
 	next_command_pointer = &jtag_command_queue;
 }
 
+struct jtag_command *jtag_command_queue_detach(void)
+{
+	assert(!cmd_queue_arena_detached);
+
+	struct jtag_command *cmd = jtag_command_queue;
+
+	cmd_queue_arena_detached = cmd_queue_arena;
+	if (cmd_queue_arena == &cmd_queue_arenas[0])
+		cmd_queue_arena = &cmd_queue_arenas[1];
+	else
+		cmd_queue_arena = &cmd_queue_arenas[0];
+
+	jtag_command_queue_reset();
+
+	return cmd;
+}
+
+void jtag_command_queue_release(void)
+{
+	if (!cmd_queue_arena_detached)
+		return;
+
+	cmd_queue_rewind(cmd_queue_arena_detached);
+	cmd_queue_arena_detached = NULL;
+}
+
+/* @returns true if both IR scans shift the very same bits out */
+static bool jtag_ir_scan_out_equal(const struct scan_command *a,
+		const struct scan_command *b)
+{
+	if (a->num_fields != b->num_fields)
+		return false;
+
+	for (int i = 0; i < a->num_fields; i++) {
+		const struct scan_field *fa = &a->fields[i];
+		const struct scan_field *fb = &b->fields[i];
+
+		if (fa->num_bits != fb->num_bits || !fa->out_value || !fb->out_value)
+			return false;
+		if (buf_cmp(fa->out_value, fb->out_value, fa->num_bits))
+			return false;
+	}
+
+	return true;
+}
+
+void jtag_command_queue_optimize(struct jtag_queue_optimize_stats *stats)
+{
+	struct jtag_command **p_cmd = &jtag_command_queue;
+	struct jtag_command *prev = NULL;
+	/* last IR scan known to be held by the TAPs, NULL if unknown */
+	const struct scan_command *cur_ir_scan = NULL;
+	/* TAP state reached by the commands already processed */
+	tap_state_t state = TAP_INVALID;
+
+	stats->commands = 0;
+	stats->bits = 0;
+
+	while (*p_cmd) {
+		struct jtag_command *cmd = *p_cmd;
+		bool drop = false;
+
+		switch (cmd->type) {
+		case JTAG_SCAN:
+			if (cmd->cmd.scan->ir_scan) {
+				/*
+				 * Re-loading the same instruction is useless, unless
+				 * the caller wants to capture the IR or the scan is
+				 * needed to reach its end state.
+				 */
+				if (cur_ir_scan && state == cmd->cmd.scan->end_state
+						&& !(jtag_scan_type(cmd->cmd.scan) & SCAN_IN)
+						&& jtag_ir_scan_out_equal(cur_ir_scan, cmd->cmd.scan)) {
+					drop = true;
+					stats->bits += jtag_scan_size(cmd->cmd.scan);
+				} else {
+					cur_ir_scan = cmd->cmd.scan;
+				}
+			}
+			state = cmd->cmd.scan->end_state;
+			break;
+
+		case JTAG_RUNTEST:
+			/* RUNTEST ending in IDLE can be extended by the next RUNTEST */
+			if (prev && prev->type == JTAG_RUNTEST
+					&& prev->cmd.runtest->end_state == TAP_IDLE
+					&& cmd->cmd.runtest->num_cycles <= INT_MAX - prev->cmd.runtest->num_cycles) {
+				prev->cmd.runtest->num_cycles += cmd->cmd.runtest->num_cycles;
+				prev->cmd.runtest->end_state = cmd->cmd.runtest->end_state;
+				drop = true;
+			}
+			state = cmd->cmd.runtest->end_state;
+			break;
+
+		case JTAG_STABLECLOCKS:
+			if (prev && prev->type == JTAG_STABLECLOCKS
+					&& cmd->cmd.stableclocks->num_cycles <= INT_MAX - prev->cmd.stableclocks->num_cycles) {
+				prev->cmd.stableclocks->num_cycles += cmd->cmd.stableclocks->num_cycles;
+				drop = true;
+			}
+			break;
+
+		case JTAG_TLR_RESET:
+			/* TLR is already reached by the previous command */
+			if (prev && prev->type == JTAG_TLR_RESET
+					&& prev->cmd.statemove->end_state == cmd->cmd.statemove->end_state)
+				drop = true;
+			cur_ir_scan = NULL;
+			state = cmd->cmd.statemove->end_state;
+			break;
+
+		case JTAG_TMS:
+			if (prev && prev->type == JTAG_TMS) {
+				struct tms_command *a = prev->cmd.tms;
+				struct tms_command *b = cmd->cmd.tms;
+				uint8_t *bits = cmd_queue_alloc(DIV_ROUND_UP(a->num_bits + b->num_bits, 8));
+
+				if (bits) {
+					buf_set_buf(a->bits, 0, bits, 0, a->num_bits);
+					buf_set_buf(b->bits, 0, bits, a->num_bits, b->num_bits);
+					a->bits = bits;
+					a->num_bits += b->num_bits;
+					drop = true;
+				}
+			}
+			/* TMS sequences can go anywhere, including through Update-IR */
+			cur_ir_scan = NULL;
+			state = TAP_INVALID;
+			break;
+
+		case JTAG_PATHMOVE:
+			/* a path through Update-IR latches the captured IR value */
+			cur_ir_scan = NULL;
+			state = cmd->cmd.pathmove->path[cmd->cmd.pathmove->num_states - 1];
+			break;
+
+		case JTAG_SLEEP:
+			break;
+
+		default:
+			cur_ir_scan = NULL;
+			state = TAP_INVALID;
+			break;
+		}
+
+		if (drop) {
+			*p_cmd = cmd->next;
+			stats->commands++;
+		} else {
+			prev = cmd;
+			p_cmd = &cmd->next;
+		}
+	}
+
+	next_command_pointer = p_cmd;
+}
+
 /**
  * Copy a struct scan_field for insertion into the queue.
  *
@@ -212,8 +445,14 @@ int jtag_build_buffer(const struct scan_command *cmd, uint8_t **buffer)
 						cmd->fields[i].num_bits, char_buf);
 				free(char_buf);
 			}
-			buf_set_buf(cmd->fields[i].out_value, 0, *buffer,
-					bit_count, cmd->fields[i].num_bits);
+			/* byte aligned fields are copied whole, the following
+			 * field overwrites the bits masked out by buf_cpy() */
+			if (bit_count % 8 == 0)
+				buf_cpy(cmd->fields[i].out_value, *buffer + bit_count / 8,
+						cmd->fields[i].num_bits);
+			else
+				buf_set_buf(cmd->fields[i].out_value, 0, *buffer,
+						bit_count, cmd->fields[i].num_bits);
 		} else {
 			LOG_DEBUG_IO("fields[%i].out_value[%i]: NULL",
 					i, cmd->fields[i].num_bits);
@@ -227,6 +466,25 @@ int jtag_build_buffer(const struct scan_command *cmd, uint8_t **buffer)
 	return bit_count;
 }
 
+void jtag_scan_log_in_values(const struct scan_command *cmd)
+{
+	if (!LOG_LEVEL_IS(LOG_LVL_DEBUG_IO))
+		return;
+
+	for (int i = 0; i < cmd->num_fields; i++) {
+		int num_bits = cmd->fields[i].num_bits;
+		uint8_t *in_value = cmd->fields[i].in_value;
+
+		if (!in_value)
+			continue;
+
+		char *char_buf = buf_to_hex_str(in_value,
+				(num_bits > DEBUG_JTAG_IOZ) ? DEBUG_JTAG_IOZ : num_bits);
+		LOG_DEBUG("fields[%i].in_value[%i]: 0x%s", i, num_bits, char_buf);
+		free(char_buf);
+	}
+}
+
 int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd)
 {
 	int i;
@@ -242,27 +500,48 @@ int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd)
 		 */
 		if (cmd->fields[i].in_value) {
 			int num_bits = cmd->fields[i].num_bits;
-			uint8_t *captured = buf_set_buf(buffer, bit_count,
-					malloc(DIV_ROUND_UP(num_bits, 8)), 0, num_bits);
-
-			if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
-				char *char_buf = buf_to_hex_str(captured,
-						(num_bits > DEBUG_JTAG_IOZ)
-						? DEBUG_JTAG_IOZ
-								: num_bits);
-
-				LOG_DEBUG("fields[%i].in_value[%i]: 0x%s",
-						i, num_bits, char_buf);
-				free(char_buf);
+			uint8_t *in_value = cmd->fields[i].in_value;
+
+			/* copy straight into the field, clearing the unused bits
+			 * of its last byte like buf_cpy() does */
+			if (bit_count % 8 == 0) {
+				buf_cpy(buffer + bit_count / 8, in_value, num_bits);
+			} else {
+				buf_set_buf(buffer, bit_count, in_value, 0, num_bits);
+				if (num_bits % 8)
+					in_value[num_bits / 8] &= (1 << (num_bits % 8)) - 1;
 			}
-
-			if (cmd->fields[i].in_value)
-				buf_cpy(captured, cmd->fields[i].in_value, num_bits);
-
-			free(captured);
 		}
 		bit_count += cmd->fields[i].num_bits;
 	}
 
+	jtag_scan_log_in_values(cmd);
+
 	return retval;
 }
+
+int jtag_scan_iov(const struct scan_command *cmd, struct jtag_scan_iov *iov,
+		bool *byte_aligned)
+{
+	int count = 0;
+
+	*byte_aligned = true;
+
+	for (int i = 0; i < cmd->num_fields; i++) {
+		const struct scan_field *field = &cmd->fields[i];
+
+		if (field->num_bits == 0)
+			continue;
+
+		/* a segment not ending on a byte boundary is only fine last */
+		if (count > 0 && iov[count - 1].num_bits % 8)
+			*byte_aligned = false;
+
+		iov[count].out = field->out_value;
+		iov[count].in = field->in_value;
+		iov[count].num_bits = field->num_bits;
+		count++;
+	}
+
+	return count;
+}
@@ -152,15 +152,96 @@ struct jtag_command {
 /** The current queue of jtag_command_s structures. */
 extern struct jtag_command *jtag_command_queue;
 
+/** Usage statistics of the memory arena backing the command queue. */
+struct cmd_queue_stats {
+	/** Number of pages currently held by the arena. */
+	unsigned int pages;
+	/** Total size of the pages held by the arena, in bytes. */
+	size_t bytes_allocated;
+	/** Bytes handed out for the queue being built. */
+	size_t bytes_used;
+	/** Highest value reached by bytes_used since startup. */
+	size_t bytes_used_max;
+	/** Number of times a page had to be malloc'd. */
+	uint64_t page_allocs;
+	/** Number of times a page retained from a previous queue was reused. */
+	uint64_t page_reuses;
+	/** Number of times the queue has been reset. */
+	uint64_t resets;
+};
+
 void *cmd_queue_alloc(size_t size);
+void cmd_queue_free(void);
+void cmd_queue_get_stats(struct cmd_queue_stats *stats);
 
 void jtag_queue_command(struct jtag_command *cmd);
 void jtag_command_queue_reset(void);
 
+/**
+ * Detach the queue from jtag_command_queue, leaving it empty for the next
+ * commands. The memory of the detached queue stays valid until
+ * jtag_command_queue_release(). Only one queue can be detached at a time.
+ * @returns The first command of the detached queue.
+ */
+struct jtag_command *jtag_command_queue_detach(void);
+/** Release the memory of the queue detached by jtag_command_queue_detach(). */
+void jtag_command_queue_release(void);
+
+/** What jtag_command_queue_optimize() removed from the queue. */
+struct jtag_queue_optimize_stats {
+	/** Number of commands removed or merged into the previous one. */
+	unsigned int commands;
+	/** Number of scan bits that will not be shifted anymore. */
+	unsigned int bits;
+};
+
+/**
+ * Peephole pass over the command queue. Merges adjacent RUNTEST, STABLECLOCKS
+ * and TMS commands, drops repeated TLR resets and drops IR scans loading the
+ * instructions already held by the TAPs, as far as the queue itself tells.
+ * The effect of the queue on the scan chain is unchanged.
+ */
+void jtag_command_queue_optimize(struct jtag_queue_optimize_stats *stats);
+
 void jtag_scan_field_clone(struct scan_field *dst, const struct scan_field *src);
 enum scan_type jtag_scan_type(const struct scan_command *cmd);
 int jtag_scan_size(const struct scan_command *cmd);
 int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd);
 int jtag_build_buffer(const struct scan_command *cmd, uint8_t **buffer);
 
+/** Log the values captured by the fields of @a cmd, at debug_level 4. */
+void jtag_scan_log_in_values(const struct scan_command *cmd);
+
+/**
+ * One field of a scan command, seen as a piece of the bit stream shifted
+ * through the chain. Drivers that can shift from and capture into several
+ * buffers use these instead of jtag_build_buffer() and jtag_read_buffer(),
+ * so the data is not copied to and from a scan buffer.
+ */
+struct jtag_scan_iov {
+	/** Data to shift out, NULL to shift out zeros. */
+	const uint8_t *out;
+	/** Where to store the captured bits, NULL to discard them. */
+	uint8_t *in;
+	/** Number of bits, never zero. */
+	unsigned int num_bits;
+};
+
+/**
+ * Fill @a iov, which must have room for @a cmd->num_fields entries, with
+ * the non-empty fields of @a cmd in shift order. The entries point at the
+ * buffers of the fields themselves; a field's @c in may be written as soon
+ * as its bits are captured, so fields must not share buffers with other
+ * fields of the same scan.
+ *
+ * @param cmd the scan command.
+ * @param iov the segments.
+ * @param byte_aligned set to true when every segment but the last ends on
+ * a byte boundary of the bit stream, i.e. the segments can be handled as
+ * consecutive byte buffers.
+ * @returns the number of segments filled.
+ */
+int jtag_scan_iov(const struct scan_command *cmd, struct jtag_scan_iov *iov,
+		bool *byte_aligned);
+
 #endif /* OPENOCD_JTAG_COMMANDS_H */
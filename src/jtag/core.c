@@ -23,6 +23,7 @@
 #include "jtag.h"
 #include "swd.h"
 #include "interface.h"
+#include "recorder.h"
 #include <transport/transport.h>
 #include <helper/jep106.h>
 #include "helper/system.h"
@@ -90,6 +91,16 @@ tap_state_t cmd_queue_cur_state = TAP_RESET;
 static bool jtag_verify_capture_ir = true;
 static int jtag_verify = 1;
 
+/* skip IR scans loading the instructions already held by the TAPs */
+static bool jtag_ir_cache;
+static uint64_t jtag_ir_cache_hits;
+static uint64_t jtag_ir_cache_misses;
+
+/* peephole optimization of the queue before it reaches the driver */
+static bool jtag_optimize_queue;
+static uint64_t jtag_optimize_removed_commands;
+static uint64_t jtag_optimize_removed_bits;
+
 /* how long the OpenOCD should wait before attempting JTAG communication after reset lines
  *deasserted (in ms) */
 static int adapter_nsrst_delay;	/* default to no nSRST delay */
@@ -353,8 +364,46 @@ static void jtag_prelude(tap_state_t state)
 	cmd_queue_cur_state = state;
 }
 
-void jtag_add_ir_scan_noverify(struct jtag_tap *active, const struct scan_field *in_fields,
-	tap_state_t state)
+static void jtag_ir_cache_invalidate(void)
+{
+	for (struct jtag_tap *tap = jtag_all_taps(); tap; tap = tap->next_tap)
+		tap->cur_instr_valid = false;
+}
+
+/**
+ * Check if the IR scan can be skipped because the queue already leaves
+ * @a active holding the instruction, all the other enabled TAPs in BYPASS
+ * and the state machine in @a state.
+ */
+static bool jtag_ir_cache_hit(struct jtag_tap *active,
+	const struct scan_field *in_fields, tap_state_t state)
+{
+	if (!jtag_ir_cache)
+		return false;
+
+	bool hit = !in_fields->in_value && in_fields->out_value
+		&& in_fields->num_bits == active->ir_length
+		&& cmd_queue_cur_state == state;
+
+	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); hit && tap; tap = jtag_tap_next_enabled(tap)) {
+		if (!tap->cur_instr_valid)
+			hit = false;
+		else if (tap == active)
+			hit = !tap->bypass && !buf_cmp(tap->cur_instr, in_fields->out_value, tap->ir_length);
+		else
+			hit = tap->bypass;
+	}
+
+	if (hit)
+		jtag_ir_cache_hits++;
+	else
+		jtag_ir_cache_misses++;
+
+	return hit;
+}
+
+static void jtag_add_ir_scan_noverify_uncached(struct jtag_tap *active,
+	const struct scan_field *in_fields, tap_state_t state)
 {
 	jtag_prelude(state);
 
@@ -362,12 +411,21 @@ void jtag_add_ir_scan_noverify(struct jtag_tap *active, const struct scan_field
 	jtag_set_error(retval);
 }
 
+void jtag_add_ir_scan_noverify(struct jtag_tap *active, const struct scan_field *in_fields,
+	tap_state_t state)
+{
+	if (jtag_ir_cache_hit(active, in_fields, state))
+		return;
+
+	jtag_add_ir_scan_noverify_uncached(active, in_fields, state);
+}
+
 static void jtag_add_ir_scan_noverify_callback(struct jtag_tap *active,
 	int dummy,
 	const struct scan_field *in_fields,
 	tap_state_t state)
 {
-	jtag_add_ir_scan_noverify(active, in_fields, state);
+	jtag_add_ir_scan_noverify_uncached(active, in_fields, state);
 }
 
 /* If fields->in_value is filled out, then the captured IR value will be checked */
@@ -375,6 +433,9 @@ void jtag_add_ir_scan(struct jtag_tap *active, struct scan_field *in_fields, tap
 {
 	assert(state != TAP_RESET);
 
+	if (jtag_ir_cache_hit(active, in_fields, state))
+		return;
+
 	if (jtag_verify && jtag_verify_capture_ir) {
 		/* 8 x 32 bit id's is enough for all invocations */
 
@@ -397,6 +458,9 @@ void jtag_add_plain_ir_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_b
 
 	jtag_prelude(state);
 
+	/* the new instructions are not tracked per TAP */
+	jtag_ir_cache_invalidate();
+
 	int retval = interface_jtag_add_plain_ir_scan(
 			num_bits, out_bits, in_bits, state);
 	jtag_set_error(retval);
@@ -405,17 +469,6 @@ void jtag_add_plain_ir_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_b
 static int jtag_check_value_inner(uint8_t *captured, uint8_t *in_check_value,
 				  uint8_t *in_check_mask, int num_bits);
 
-static int jtag_check_value_mask_callback(jtag_callback_data_t data0,
-	jtag_callback_data_t data1,
-	jtag_callback_data_t data2,
-	jtag_callback_data_t data3)
-{
-	return jtag_check_value_inner((uint8_t *)data0,
-		(uint8_t *)data1,
-		(uint8_t *)data2,
-		(int)data3);
-}
-
 static void jtag_add_scan_check(struct jtag_tap *active, void (*jtag_add_scan)(
 		struct jtag_tap *active,
 		int in_num_fields,
@@ -427,11 +480,10 @@ static void jtag_add_scan_check(struct jtag_tap *active, void (*jtag_add_scan)(
 
 	for (int i = 0; i < in_num_fields; i++) {
 		if ((in_fields[i].check_value) && (in_fields[i].in_value)) {
-			jtag_add_callback4(jtag_check_value_mask_callback,
-				(jtag_callback_data_t)in_fields[i].in_value,
-				(jtag_callback_data_t)in_fields[i].check_value,
-				(jtag_callback_data_t)in_fields[i].check_mask,
-				(jtag_callback_data_t)in_fields[i].num_bits);
+			int retval = interface_jtag_add_scan_check(in_fields[i].in_value,
+				in_fields[i].check_value, in_fields[i].check_mask,
+				in_fields[i].num_bits);
+			jtag_set_error(retval);
 		}
 	}
 }
@@ -509,6 +561,9 @@ int jtag_add_tms_seq(unsigned nbits, const uint8_t *seq, enum tap_state state)
 	jtag_checks();
 	cmd_queue_cur_state = state;
 
+	/* the sequence may pass through Test-Logic-Reset or Update-IR */
+	jtag_ir_cache_invalidate();
+
 	retval = interface_add_tms_seq(nbits, seq, state);
 	jtag_set_error(retval);
 	return retval;
@@ -544,6 +599,9 @@ void jtag_add_pathmove(int num_states, const tap_state_t *path)
 
 	jtag_checks();
 
+	/* a path through Update-IR loads the value captured in the IR */
+	jtag_ir_cache_invalidate();
+
 	jtag_set_error(interface_jtag_add_pathmove(num_states, path));
 	cmd_queue_cur_state = path[num_states - 1];
 }
@@ -625,6 +683,9 @@ static int adapter_system_reset(int req_srst)
 
 	/* Maybe change SRST signal state */
 	if (jtag_srst != req_srst) {
+		/* the driver can't be used while a queue is in flight */
+		jtag_wait_queue_noclear();
+
 		retval = adapter_driver->reset(0, req_srst);
 		if (retval != ERROR_OK) {
 			LOG_ERROR("SRST error");
@@ -878,14 +939,9 @@ static int jtag_check_value_inner(uint8_t *captured, uint8_t *in_check_value,
 	uint8_t *in_check_mask, int num_bits)
 {
 	int retval = ERROR_OK;
-	int compare_failed;
-
-	if (in_check_mask)
-		compare_failed = buf_cmp_mask(captured, in_check_value, in_check_mask, num_bits);
-	else
-		compare_failed = buf_cmp(captured, in_check_value, num_bits);
+	int mismatch = buf_cmp_mask_offset(captured, in_check_value, in_check_mask, num_bits);
 
-	if (compare_failed) {
+	if (mismatch >= 0) {
 		char *captured_str, *in_check_value_str;
 		int bits = (num_bits > DEBUG_JTAG_IOZ) ? DEBUG_JTAG_IOZ : num_bits;
 
@@ -894,8 +950,8 @@ static int jtag_check_value_inner(uint8_t *captured, uint8_t *in_check_value,
 		captured_str = buf_to_hex_str(captured, bits);
 		in_check_value_str = buf_to_hex_str(in_check_value, bits);
 
-		LOG_WARNING("Bad value '%s' captured during DR or IR scan:",
-			captured_str);
+		LOG_WARNING("Bad value '%s' captured during DR or IR scan, first mismatch at bit %d:",
+			captured_str, mismatch);
 		LOG_WARNING(" check_value: 0x%s", in_check_value_str);
 
 		free(captured_str);
@@ -914,6 +970,18 @@ static int jtag_check_value_inner(uint8_t *captured, uint8_t *in_check_value,
 	return retval;
 }
 
+int jtag_scan_checks_verify(const struct jtag_scan_check *checks, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		int retval = jtag_check_value_inner(checks[i].captured, checks[i].value,
+			checks[i].mask, checks[i].num_bits);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
 void jtag_check_value_mask(struct scan_field *field, uint8_t *value, uint8_t *mask)
 {
 	assert(field->in_value);
@@ -929,31 +997,8 @@ void jtag_check_value_mask(struct scan_field *field, uint8_t *value, uint8_t *ma
 	jtag_set_error(retval);
 }
 
-int default_interface_jtag_execute_queue(void)
+static void jtag_debug_dump_queue(struct jtag_command *cmd)
 {
-	if (!is_adapter_initialized()) {
-		LOG_ERROR("No JTAG interface configured yet.  "
-			"Issue 'init' command in startup scripts "
-			"before communicating with targets.");
-		return ERROR_FAIL;
-	}
-
-	if (!transport_is_jtag()) {
-		/*
-		 * FIXME: This should not happen!
-		 * There could be old code that queues jtag commands with non jtag interfaces so, for
-		 * the moment simply highlight it by log an error and return on empty execute_queue.
-		 * We should fix it quitting with assert(0) because it is an internal error.
-		 * The fix can be applied immediately after next release (v0.11.0 ?)
-		 */
-		LOG_ERROR("JTAG API jtag_execute_queue() called on non JTAG interface");
-		if (!adapter_driver->jtag_ops || !adapter_driver->jtag_ops->execute_queue)
-			return ERROR_OK;
-	}
-
-	int result = adapter_driver->jtag_ops->execute_queue();
-
-	struct jtag_command *cmd = jtag_command_queue;
 	while (debug_level >= LOG_LVL_DEBUG_IO && cmd) {
 		switch (cmd->type) {
 			case JTAG_SCAN:
@@ -1011,6 +1056,96 @@ int default_interface_jtag_execute_queue(void)
 		}
 		cmd = cmd->next;
 	}
+}
+
+/* @returns false if the queue can't be handed to the adapter, with the result in *retval */
+static bool jtag_prepare_queue(int *retval)
+{
+	if (!is_adapter_initialized()) {
+		LOG_ERROR("No JTAG interface configured yet.  "
+			"Issue 'init' command in startup scripts "
+			"before communicating with targets.");
+		*retval = ERROR_FAIL;
+		return false;
+	}
+
+	if (!transport_is_jtag()) {
+		/*
+		 * FIXME: This should not happen!
+		 * There could be old code that queues jtag commands with non jtag interfaces so, for
+		 * the moment simply highlight it by log an error and return on empty execute_queue.
+		 * We should fix it quitting with assert(0) because it is an internal error.
+		 * The fix can be applied immediately after next release (v0.11.0 ?)
+		 */
+		LOG_ERROR("JTAG API jtag_execute_queue() called on non JTAG interface");
+		if (!adapter_driver->jtag_ops || !adapter_driver->jtag_ops->execute_queue) {
+			*retval = ERROR_OK;
+			return false;
+		}
+	}
+
+	if (jtag_optimize_queue) {
+		struct jtag_queue_optimize_stats stats;
+		jtag_command_queue_optimize(&stats);
+		if (stats.commands) {
+			LOG_DEBUG_IO("queue optimizer removed %u commands, %u scan bits",
+					stats.commands, stats.bits);
+			jtag_optimize_removed_commands += stats.commands;
+			jtag_optimize_removed_bits += stats.bits;
+		}
+	}
+
+	return true;
+}
+
+int default_interface_jtag_execute_queue(void)
+{
+	int result;
+
+	if (!jtag_prepare_queue(&result))
+		return result;
+
+	jtag_recorder_queue(jtag_command_queue);
+	result = adapter_driver->jtag_ops->execute_queue();
+	jtag_recorder_queue_done(jtag_command_queue, result);
+
+	jtag_debug_dump_queue(jtag_command_queue);
+
+	return result;
+}
+
+int default_interface_jtag_execute_queue_start(bool *in_flight)
+{
+	int result;
+
+	*in_flight = false;
+
+	if (!jtag_prepare_queue(&result))
+		return result;
+
+	jtag_recorder_queue(jtag_command_queue);
+
+	if (!adapter_driver->jtag_ops->execute_queue_start) {
+		result = adapter_driver->jtag_ops->execute_queue();
+		jtag_recorder_queue_done(jtag_command_queue, result);
+		jtag_debug_dump_queue(jtag_command_queue);
+		return result;
+	}
+
+	result = adapter_driver->jtag_ops->execute_queue_start();
+	*in_flight = (result == ERROR_OK);
+	if (!*in_flight)
+		jtag_recorder_queue_done(jtag_command_queue, result);
+
+	return result;
+}
+
+int default_interface_jtag_execute_queue_finish(struct jtag_command *cmd)
+{
+	int result = adapter_driver->jtag_ops->execute_queue_finish();
+
+	jtag_recorder_queue_done(cmd, result);
+	jtag_debug_dump_queue(cmd);
 
 	return result;
 }
@@ -1018,7 +1153,13 @@ int default_interface_jtag_execute_queue(void)
 void jtag_execute_queue_noclear(void)
 {
 	jtag_flush_queue_count++;
-	jtag_set_error(interface_jtag_execute_queue());
+
+	int retval = interface_jtag_execute_queue();
+	if (retval != ERROR_OK) {
+		/* don't trust the IR content after a failed flush */
+		jtag_ir_cache_invalidate();
+	}
+	jtag_set_error(retval);
 
 	if (jtag_flush_queue_sleep > 0) {
 		/* For debug purposes it can be useful to test performance
@@ -1029,6 +1170,30 @@ void jtag_execute_queue_noclear(void)
 	}
 }
 
+void jtag_execute_queue_async(void)
+{
+	jtag_flush_queue_count++;
+
+	int retval = interface_jtag_execute_queue_async();
+	if (retval != ERROR_OK)
+		jtag_ir_cache_invalidate();
+	jtag_set_error(retval);
+}
+
+void jtag_wait_queue_noclear(void)
+{
+	int retval = interface_jtag_wait_queue();
+	if (retval != ERROR_OK)
+		jtag_ir_cache_invalidate();
+	jtag_set_error(retval);
+}
+
+int jtag_wait_queue(void)
+{
+	jtag_wait_queue_noclear();
+	return jtag_error_clear();
+}
+
 int jtag_get_flush_queue_count(void)
 {
 	return jtag_flush_queue_count;
@@ -1044,6 +1209,9 @@ static int jtag_reset_callback(enum jtag_event event, void *priv)
 {
 	struct jtag_tap *tap = priv;
 
+	/* reset or changes in the scan chain, don't rely on the IR content */
+	tap->cur_instr_valid = false;
+
 	if (event == JTAG_TRST_ASSERTED) {
 		tap->enabled = !tap->disabled_after_reset;
 
@@ -1466,6 +1634,7 @@ void jtag_tap_init(struct jtag_tap *tap)
 	/* TAP will be in bypass mode after jtag_validate_ircapture() */
 	tap->bypass = 1;
 	buf_set_ones(tap->cur_instr, tap->ir_length);
+	tap->cur_instr_valid = false;
 
 	/* register the reset callback for the TAP */
 	jtag_register_event_callback(&jtag_reset_callback, tap);
@@ -1697,6 +1866,39 @@ bool jtag_will_verify(void)
 	return jtag_verify;
 }
 
+void jtag_set_ir_cache(bool enable)
+{
+	jtag_ir_cache = enable;
+	jtag_ir_cache_invalidate();
+}
+
+bool jtag_will_cache_ir(void)
+{
+	return jtag_ir_cache;
+}
+
+void jtag_get_ir_cache_stats(uint64_t *hits, uint64_t *misses)
+{
+	*hits = jtag_ir_cache_hits;
+	*misses = jtag_ir_cache_misses;
+}
+
+void jtag_set_optimize_queue(bool enable)
+{
+	jtag_optimize_queue = enable;
+}
+
+bool jtag_will_optimize_queue(void)
+{
+	return jtag_optimize_queue;
+}
+
+void jtag_get_optimize_queue_stats(uint64_t *commands, uint64_t *bits)
+{
+	*commands = jtag_optimize_removed_commands;
+	*bits = jtag_optimize_removed_bits;
+}
+
 void jtag_set_verify_capture_ir(bool enable)
 {
 	jtag_verify_capture_ir = enable;
@@ -225,6 +225,38 @@ static int am335xgpio_write(int tck, int tms, int tdi)
 	return ERROR_OK;
 }
 
+static int am335xgpio_write_edges(const uint8_t *edges, size_t count, uint8_t *tdo)
+{
+	/* all lines are set on the first state, then only those that change */
+	unsigned int prev = ~0u;
+	unsigned int sampled = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		unsigned int state = edges[i];
+		unsigned int changed = state ^ prev;
+
+		if (changed & BB_EDGE_TDI)
+			set_gpio_value(&adapter_gpio_config[ADAPTER_GPIO_IDX_TDI], !!(state & BB_EDGE_TDI));
+		if (changed & BB_EDGE_TMS)
+			set_gpio_value(&adapter_gpio_config[ADAPTER_GPIO_IDX_TMS], !!(state & BB_EDGE_TMS));
+		if (changed & BB_EDGE_TCK) /* Write clock last */
+			set_gpio_value(&adapter_gpio_config[ADAPTER_GPIO_IDX_TCK], !!(state & BB_EDGE_TCK));
+		prev = state;
+
+		for (unsigned int j = 0; j < jtag_delay; ++j)
+			asm volatile ("");
+
+		if (state & BB_EDGE_SAMPLE) {
+			bb_value_t value = am335xgpio_read();
+			if (value == BB_ERROR)
+				return ERROR_FAIL;
+			bitbang_edges_store_tdo(tdo, sampled++, value);
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static int am335xgpio_swd_write(int swclk, int swdio)
 {
 	set_gpio_value(&adapter_gpio_config[ADAPTER_GPIO_IDX_SWDIO], swdio);
@@ -285,6 +317,7 @@ static int am335xgpio_blink(int on)
 static struct bitbang_interface am335xgpio_bitbang = {
 	.read = am335xgpio_read,
 	.write = am335xgpio_write,
+	.write_edges = am335xgpio_write_edges,
 	.swdio_read = am335xgpio_swdio_read,
 	.swdio_drive = am335xgpio_swdio_drive,
 	.swd_write = am335xgpio_swd_write,
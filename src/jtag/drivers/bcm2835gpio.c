@@ -199,6 +199,45 @@ static int bcm2835gpio_write(int tck, int tms, int tdi)
 	return ERROR_OK;
 }
 
+static int bcm2835gpio_write_edges(const uint8_t *edges, size_t count, uint8_t *tdo)
+{
+	uint32_t set[8], clear[8];
+	unsigned int sampled = 0;
+
+	/* register values of every TCK/TMS/TDI combination, as in bcm2835gpio_write() */
+	for (unsigned int state = 0; state < 8; state++) {
+		int tck = !!(state & BB_EDGE_TCK);
+		int tms = !!(state & BB_EDGE_TMS);
+		int tdi = !!(state & BB_EDGE_TDI);
+
+		set[state] = tck << adapter_gpio_config[ADAPTER_GPIO_IDX_TCK].gpio_num |
+				tms << adapter_gpio_config[ADAPTER_GPIO_IDX_TMS].gpio_num |
+				tdi << adapter_gpio_config[ADAPTER_GPIO_IDX_TDI].gpio_num;
+		clear[state] = !tck << adapter_gpio_config[ADAPTER_GPIO_IDX_TCK].gpio_num |
+				!tms << adapter_gpio_config[ADAPTER_GPIO_IDX_TMS].gpio_num |
+				!tdi << adapter_gpio_config[ADAPTER_GPIO_IDX_TDI].gpio_num;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		unsigned int state = edges[i] & (BB_EDGE_TCK | BB_EDGE_TMS | BB_EDGE_TDI);
+
+		GPIO_SET = set[state];
+		GPIO_CLR = clear[state];
+		bcm2835_gpio_synchronize();
+
+		bcm2835_delay();
+
+		if (edges[i] & BB_EDGE_SAMPLE) {
+			bb_value_t value = bcm2835gpio_read();
+			if (value == BB_ERROR)
+				return ERROR_FAIL;
+			bitbang_edges_store_tdo(tdo, sampled++, value);
+		}
+	}
+
+	return ERROR_OK;
+}
+
 /* Requires push-pull drive mode for swclk and swdio */
 static int bcm2835gpio_swd_write_fast(int swclk, int swdio)
 {
@@ -419,6 +458,7 @@ static int bcm2835gpio_blink(int on)
 static struct bitbang_interface bcm2835gpio_bitbang = {
 	.read = bcm2835gpio_read,
 	.write = bcm2835gpio_write,
+	.write_edges = bcm2835gpio_write_edges,
 	.swdio_read = bcm2835_swdio_read,
 	.swdio_drive = bcm2835_swdio_drive,
 	.swd_write = bcm2835gpio_swd_write_generic,
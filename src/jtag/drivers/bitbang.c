@@ -141,6 +141,30 @@ static int bitbang_path_move(struct pathmove_command *cmd)
 	return ERROR_OK;
 }
 
+/* Number of bits handed to write_edges() at once */
+#define BITBANG_EDGES_CHUNK	1024
+
+/* Send num_cycles times the pair of states first, second through write_edges() */
+static int bitbang_repeat_edges(int num_cycles, uint8_t first, uint8_t second)
+{
+	uint8_t edges[2 * BITBANG_EDGES_CHUNK];
+
+	for (unsigned int i = 0; i < BITBANG_EDGES_CHUNK; i++) {
+		edges[2 * i] = first;
+		edges[2 * i + 1] = second;
+	}
+
+	while (num_cycles > 0) {
+		unsigned int n = MIN(num_cycles, BITBANG_EDGES_CHUNK);
+
+		if (bitbang_interface->write_edges(edges, 2 * n, NULL) != ERROR_OK)
+			return ERROR_FAIL;
+		num_cycles -= n;
+	}
+
+	return ERROR_OK;
+}
+
 static int bitbang_runtest(int num_cycles)
 {
 	int i;
@@ -155,11 +179,16 @@ static int bitbang_runtest(int num_cycles)
 	}
 
 	/* execute num_cycles */
-	for (i = 0; i < num_cycles; i++) {
-		if (bitbang_interface->write(0, 0, 0) != ERROR_OK)
-			return ERROR_FAIL;
-		if (bitbang_interface->write(1, 0, 0) != ERROR_OK)
+	if (bitbang_interface->write_edges) {
+		if (bitbang_repeat_edges(num_cycles, 0, BB_EDGE_TCK) != ERROR_OK)
 			return ERROR_FAIL;
+	} else {
+		for (i = 0; i < num_cycles; i++) {
+			if (bitbang_interface->write(0, 0, 0) != ERROR_OK)
+				return ERROR_FAIL;
+			if (bitbang_interface->write(1, 0, 0) != ERROR_OK)
+				return ERROR_FAIL;
+		}
 	}
 	if (bitbang_interface->write(CLOCK_IDLE(), 0, 0) != ERROR_OK)
 		return ERROR_FAIL;
@@ -179,6 +208,12 @@ static int bitbang_stableclocks(int num_cycles)
 	int i;
 
 	/* send num_cycles clocks onto the cable */
+	if (bitbang_interface->write_edges) {
+		uint8_t state = tms ? BB_EDGE_TMS : 0;
+
+		return bitbang_repeat_edges(num_cycles, state | BB_EDGE_TCK, state);
+	}
+
 	for (i = 0; i < num_cycles; i++) {
 		if (bitbang_interface->write(1, tms, 0) != ERROR_OK)
 			return ERROR_FAIL;
@@ -189,84 +224,162 @@ static int bitbang_stableclocks(int num_cycles)
 	return ERROR_OK;
 }
 
-static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
-		unsigned scan_size)
+/* Store a captured bit at the position a capture cursor points to */
+static void bitbang_scan_capture(const struct jtag_scan_iov *iov,
+		int *seg, unsigned int *bit, bb_value_t value)
 {
-	tap_state_t saved_end_state = tap_get_end_state();
-	unsigned bit_cnt;
+	uint8_t *in = iov[*seg].in;
 
-	if (!((!ir_scan &&
-			(tap_get_state() == TAP_DRSHIFT)) ||
-			(ir_scan && (tap_get_state() == TAP_IRSHIFT)))) {
-		if (ir_scan)
-			bitbang_end_state(TAP_IRSHIFT);
+	if (in) {
+		if (value == BB_HIGH)
+			in[*bit / 8] |= 1 << (*bit % 8);
 		else
-			bitbang_end_state(TAP_DRSHIFT);
+			in[*bit / 8] &= ~(1 << (*bit % 8));
+	}
 
-		if (bitbang_state_move(0) != ERROR_OK)
-			return ERROR_FAIL;
-		bitbang_end_state(saved_end_state);
+	if (++*bit == iov[*seg].num_bits) {
+		(*seg)++;
+		*bit = 0;
 	}
+}
 
-	size_t buffered = 0;
-	for (bit_cnt = 0; bit_cnt < scan_size; bit_cnt++) {
-		int tms = (bit_cnt == scan_size-1) ? 1 : 0;
-		int tdi;
-		int bytec = bit_cnt/8;
-		int bcval = 1 << (bit_cnt % 8);
-
-		/* if we're just reading the scan, but don't care about the output
-		 * default to outputting 'low', this also makes valgrind traces more readable,
-		 * as it removes the dependency on an uninitialised value
-		 */
-		tdi = 0;
-		if ((type != SCAN_IN) && (buffer[bytec] & bcval))
-			tdi = 1;
+/* Scan one bit at a time through write() and read() or sample() */
+static int bitbang_scan_bits(const struct jtag_scan_iov *iov, int iov_count,
+		unsigned scan_size, bool capture)
+{
+	unsigned bit_cnt = 0;
 
-		if (bitbang_interface->write(0, tms, tdi) != ERROR_OK)
-			return ERROR_FAIL;
+	/* segment and bit the next buffered sample belongs to */
+	int read_seg = 0;
+	unsigned int read_bit = 0;
 
-		if (type != SCAN_OUT) {
-			if (bitbang_interface->buf_size) {
-				if (bitbang_interface->sample() != ERROR_OK)
-					return ERROR_FAIL;
-				buffered++;
-			} else {
-				switch (bitbang_interface->read()) {
-					case BB_LOW:
-						buffer[bytec] &= ~bcval;
-						break;
-					case BB_HIGH:
-						buffer[bytec] |= bcval;
-						break;
-					default:
+	size_t buffered = 0;
+	for (int seg = 0; seg < iov_count; seg++) {
+		for (unsigned int i = 0; i < iov[seg].num_bits; i++, bit_cnt++) {
+			int tms = (bit_cnt == scan_size-1) ? 1 : 0;
+			int tdi;
+			int bytec = i/8;
+			int bcval = 1 << (i % 8);
+
+			/* if we're just reading the scan, but don't care about the output
+			 * default to outputting 'low', this also makes valgrind traces more readable,
+			 * as it removes the dependency on an uninitialised value
+			 */
+			tdi = 0;
+			if (iov[seg].out && (iov[seg].out[bytec] & bcval))
+				tdi = 1;
+
+			if (bitbang_interface->write(0, tms, tdi) != ERROR_OK)
+				return ERROR_FAIL;
+
+			if (capture) {
+				if (bitbang_interface->buf_size) {
+					if (bitbang_interface->sample() != ERROR_OK)
+						return ERROR_FAIL;
+					buffered++;
+				} else {
+					bb_value_t value = bitbang_interface->read();
+					if (value != BB_LOW && value != BB_HIGH)
 						return ERROR_FAIL;
+					bitbang_scan_capture(iov, &read_seg, &read_bit, value);
 				}
 			}
-		}
 
-		if (bitbang_interface->write(1, tms, tdi) != ERROR_OK)
-			return ERROR_FAIL;
+			if (bitbang_interface->write(1, tms, tdi) != ERROR_OK)
+				return ERROR_FAIL;
 
-		if (type != SCAN_OUT && bitbang_interface->buf_size &&
-				(buffered == bitbang_interface->buf_size ||
-				 bit_cnt == scan_size - 1)) {
-			for (unsigned i = bit_cnt + 1 - buffered; i <= bit_cnt; i++) {
-				switch (bitbang_interface->read_sample()) {
-					case BB_LOW:
-						buffer[i/8] &= ~(1 << (i % 8));
-						break;
-					case BB_HIGH:
-						buffer[i/8] |= 1 << (i % 8);
-						break;
-					default:
+			if (capture && bitbang_interface->buf_size &&
+					(buffered == bitbang_interface->buf_size ||
+					 bit_cnt == scan_size - 1)) {
+				for (; buffered; buffered--) {
+					bb_value_t value = bitbang_interface->read_sample();
+					if (value != BB_LOW && value != BB_HIGH)
 						return ERROR_FAIL;
+					bitbang_scan_capture(iov, &read_seg, &read_bit, value);
 				}
 			}
-			buffered = 0;
 		}
 	}
 
+	return ERROR_OK;
+}
+
+/* Scan through write_edges(), a chunk of bits at a time */
+static int bitbang_scan_edges(const struct jtag_scan_iov *iov, int iov_count,
+		unsigned scan_size, bool capture)
+{
+	uint8_t edges[2 * BITBANG_EDGES_CHUNK];
+	uint8_t tdo[BITBANG_EDGES_CHUNK / 8];
+	unsigned bit_cnt = 0;
+
+	/* segment and bit the next output and the next sample belong to */
+	int seg = 0;
+	unsigned int bit = 0;
+	int read_seg = 0;
+	unsigned int read_bit = 0;
+
+	while (bit_cnt < scan_size) {
+		unsigned int n = MIN(scan_size - bit_cnt, BITBANG_EDGES_CHUNK);
+
+		for (unsigned int i = 0; i < n; i++, bit_cnt++) {
+			uint8_t state = 0;
+
+			if (bit_cnt == scan_size - 1)
+				state |= BB_EDGE_TMS;
+			if (iov[seg].out && (iov[seg].out[bit / 8] & BIT(bit % 8)))
+				state |= BB_EDGE_TDI;
+			edges[2 * i] = state | (capture ? BB_EDGE_SAMPLE : 0);
+			edges[2 * i + 1] = state | BB_EDGE_TCK;
+
+			if (++bit == iov[seg].num_bits) {
+				seg++;
+				bit = 0;
+			}
+		}
+
+		if (bitbang_interface->write_edges(edges, 2 * n, capture ? tdo : NULL) != ERROR_OK)
+			return ERROR_FAIL;
+
+		if (capture)
+			for (unsigned int i = 0; i < n; i++)
+				bitbang_scan_capture(iov, &read_seg, &read_bit,
+						(tdo[i / 8] & BIT(i % 8)) ? BB_HIGH : BB_LOW);
+	}
+
+	return ERROR_OK;
+}
+
+static int bitbang_scan(bool ir_scan, const struct jtag_scan_iov *iov,
+		int iov_count, unsigned scan_size)
+{
+	tap_state_t saved_end_state = tap_get_end_state();
+	bool capture = false;
+	int retval;
+
+	for (int i = 0; i < iov_count; i++)
+		if (iov[i].in)
+			capture = true;
+
+	if (!((!ir_scan &&
+			(tap_get_state() == TAP_DRSHIFT)) ||
+			(ir_scan && (tap_get_state() == TAP_IRSHIFT)))) {
+		if (ir_scan)
+			bitbang_end_state(TAP_IRSHIFT);
+		else
+			bitbang_end_state(TAP_DRSHIFT);
+
+		if (bitbang_state_move(0) != ERROR_OK)
+			return ERROR_FAIL;
+		bitbang_end_state(saved_end_state);
+	}
+
+	if (bitbang_interface->write_edges)
+		retval = bitbang_scan_edges(iov, iov_count, scan_size, capture);
+	else
+		retval = bitbang_scan_bits(iov, iov_count, scan_size, capture);
+	if (retval != ERROR_OK)
+		return retval;
+
 	if (tap_get_state() != tap_get_end_state()) {
 		/* we *KNOW* the above loop transitioned out of
 		 * the shift state, so we skip the first state
@@ -278,12 +391,31 @@ static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
 	return ERROR_OK;
 }
 
+/* Shift straight from and into the buffers of the scan fields */
+static int bitbang_execute_scan(struct scan_command *cmd)
+{
+	struct jtag_scan_iov iov[MAX(cmd->num_fields, 1)];
+	bool byte_aligned;
+	int iov_count = jtag_scan_iov(cmd, iov, &byte_aligned);
+	int scan_size = jtag_scan_size(cmd);
+
+	bitbang_end_state(cmd->end_state);
+	LOG_DEBUG_IO("%s scan %d bits; end in %s",
+			(cmd->ir_scan) ? "IR" : "DR",
+			scan_size,
+		tap_state_name(cmd->end_state));
+
+	if (bitbang_scan(cmd->ir_scan, iov, iov_count, scan_size) != ERROR_OK)
+		return ERROR_FAIL;
+
+	jtag_scan_log_in_values(cmd);
+
+	return ERROR_OK;
+}
+
 int bitbang_execute_queue(void)
 {
 	struct jtag_command *cmd = jtag_command_queue;	/* currently processed command */
-	int scan_size;
-	enum scan_type type;
-	uint8_t *buffer;
 	int retval;
 
 	if (!bitbang_interface) {
@@ -335,19 +467,9 @@ int bitbang_execute_queue(void)
 					return ERROR_FAIL;
 				break;
 			case JTAG_SCAN:
-				bitbang_end_state(cmd->cmd.scan->end_state);
-				scan_size = jtag_build_buffer(cmd->cmd.scan, &buffer);
-				LOG_DEBUG_IO("%s scan %d bits; end in %s",
-						(cmd->cmd.scan->ir_scan) ? "IR" : "DR",
-						scan_size,
-					tap_state_name(cmd->cmd.scan->end_state));
-				type = jtag_scan_type(cmd->cmd.scan);
-				if (bitbang_scan(cmd->cmd.scan->ir_scan, type, buffer,
-							scan_size) != ERROR_OK)
-					return ERROR_FAIL;
-				if (jtag_read_buffer(buffer, cmd->cmd.scan) != ERROR_OK)
-					retval = ERROR_JTAG_QUEUE_FAILED;
-				free(buffer);
+				retval = bitbang_execute_scan(cmd->cmd.scan);
+				if (retval != ERROR_OK)
+					return retval;
 				break;
 			case JTAG_SLEEP:
 				LOG_DEBUG_IO("sleep %" PRIu32, cmd->cmd.sleep->us);
@@ -11,6 +11,7 @@
 #ifndef OPENOCD_JTAG_DRIVERS_BITBANG_H
 #define OPENOCD_JTAG_DRIVERS_BITBANG_H
 
+#include <helper/bits.h>
 #include <jtag/swd.h>
 
 typedef enum {
@@ -19,13 +20,23 @@ typedef enum {
 	BB_ERROR
 } bb_value_t;
 
+/** Bits of the edge states given to bitbang_interface.write_edges(). */
+#define BB_EDGE_TCK		BIT(0)
+#define BB_EDGE_TMS		BIT(1)
+#define BB_EDGE_TDI		BIT(2)
+/** Sample TDO once this state is applied. */
+#define BB_EDGE_SAMPLE	BIT(3)
+
 /** Low level callbacks (for bitbang).
  *
  * Either read(), or sample() and read_sample() must be implemented.
  *
  * The sample functions allow an interface to batch a number of writes and
  * sample requests together. Not waiting for a value to come back can greatly
- * increase throughput. */
+ * increase throughput.
+ *
+ * write_edges() goes further and hands over the TCK/TMS/TDI states of a
+ * whole scan at once, saving the per edge calls. */
 struct bitbang_interface {
 	/** Sample TDO and return the value. */
 	bb_value_t (*read)(void);
@@ -43,6 +54,12 @@ struct bitbang_interface {
 	/** Set TCK, TMS, and TDI to the given values. */
 	int (*write)(int tck, int tms, int tdi);
 
+	/** Apply @a count states made of BB_EDGE_* bits in order, each as
+	 * write() would (optional). After each state holding BB_EDGE_SAMPLE,
+	 * TDO is sampled and stored in the next bit of @a tdo, from bit 0 of
+	 * tdo[0] on. @a tdo is NULL when no state asks for a sample. */
+	int (*write_edges)(const uint8_t *edges, size_t count, uint8_t *tdo);
+
 	/** Blink led (optional). */
 	int (*blink)(int on);
 
@@ -56,6 +73,16 @@ struct bitbang_interface {
 	int (*swd_write)(int swclk, int swdio);
 };
 
+/** Store TDO sample number @a n, as write_edges() returns it. */
+static inline void bitbang_edges_store_tdo(uint8_t *tdo, unsigned int n,
+		bb_value_t value)
+{
+	if (value == BB_HIGH)
+		tdo[n / 8] |= BIT(n % 8);
+	else
+		tdo[n / 8] &= ~BIT(n % 8);
+}
+
 extern const struct swd_driver bitbang_swd;
 
 int bitbang_execute_queue(void);
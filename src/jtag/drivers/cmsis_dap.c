@@ -34,6 +34,7 @@
 #include <jtag/interface.h>
 #include <jtag/commands.h>
 #include <jtag/tcl.h>
+#include <target/arm_adi_v5.h>
 #include <target/cortex_m.h>
 
 #include "cmsis_dap.h"
@@ -334,6 +335,7 @@ static int cmsis_dap_xfer(struct cmsis_dap *dap, int txlen)
 		}
 		dap->pending_fifo_put_idx = 0;
 		dap->pending_fifo_get_idx = 0;
+		dap->last_ap_read = NULL;
 	}
 
 	uint8_t current_cmd = dap->command[0];
@@ -532,6 +534,31 @@ static int cmsis_dap_cmd_dap_swd_configure(uint8_t cfg)
 	return ERROR_OK;
 }
 
+/* Describe the scan chain to the adapter, as DAP_Transfer needs it in JTAG mode */
+static int cmsis_dap_cmd_dap_jtag_configure(void)
+{
+	uint8_t *command = cmsis_dap_handle->command;
+	unsigned int count = 0;
+
+	command[0] = CMD_DAP_JTAG_CONFIGURE;
+	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap; tap = jtag_tap_next_enabled(tap)) {
+		if (2 + count >= cmsis_dap_handle->packet_usable_size || count == UINT8_MAX) {
+			LOG_ERROR("CMSIS-DAP: too many TAPs in the JTAG chain");
+			return ERROR_JTAG_DEVICE_ERROR;
+		}
+		command[2 + count++] = tap->ir_length;
+	}
+	command[1] = count;
+
+	int retval = cmsis_dap_xfer(cmsis_dap_handle, 2 + count);
+	if (retval != ERROR_OK || cmsis_dap_handle->response[1] != DAP_OK) {
+		LOG_ERROR("CMSIS-DAP command CMD_JTAG_Configure failed.");
+		return ERROR_JTAG_DEVICE_ERROR;
+	}
+
+	return ERROR_OK;
+}
+
 #if 0
 static int cmsis_dap_cmd_dap_delay(uint16_t delay_us)
 {
@@ -750,6 +777,15 @@ static int cmsis_dap_cmd_dap_swo_data(
 }
 
 
+/* Release the transfers of a block once sent with an error or processed */
+static void cmsis_dap_swd_block_done(struct cmsis_dap *dap, struct pending_request_block *block)
+{
+	if (dap->last_ap_read >= block->transfers
+			&& dap->last_ap_read < block->transfers + block->transfer_count)
+		dap->last_ap_read = NULL;
+	block->transfer_count = 0;
+}
+
 static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 {
 	uint8_t *command = dap->command;
@@ -778,7 +814,7 @@ static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 	block->command = block_cmd ? CMD_DAP_TFER_BLOCK : CMD_DAP_TFER;
 
 	command[0] = block->command;
-	command[1] = 0x00;	/* DAP Index */
+	command[1] = dap->dap_index;
 
 	unsigned int idx;
 	if (block_cmd) {
@@ -843,7 +879,7 @@ static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 	return;
 
 skip:
-	block->transfer_count = 0;
+	cmsis_dap_swd_block_done(dap, block);
 }
 
 static void cmsis_dap_swd_read_process(struct cmsis_dap *dap, int timeout_ms)
@@ -912,24 +948,39 @@ static void cmsis_dap_swd_read_process(struct cmsis_dap *dap, int timeout_ms)
 
 			LOG_DEBUG_IO("Read result: %" PRIx32, data);
 
-			/* Imitate posted AP reads */
-			if ((transfer->cmd & SWD_CMD_APNDP) ||
-			    ((transfer->cmd & SWD_CMD_A32) >> 1 == DP_RDBUFF)) {
+			/* Imitate posted AP reads. The DAP operations over JTAG
+			 * take the results as the adapter returns them. */
+			if (swd_mode && ((transfer->cmd & SWD_CMD_APNDP) ||
+			    ((transfer->cmd & SWD_CMD_A32) >> 1 == DP_RDBUFF))) {
 				tmp = last_read;
 				last_read = data;
 			}
 
 			if (transfer->buffer)
 				*(uint32_t *)(transfer->buffer) = tmp;
+			if (transfer->rdbuff_buffer)
+				*(uint32_t *)(transfer->rdbuff_buffer) = data;
 		}
 	}
 
 skip:
-	block->transfer_count = 0;
+	cmsis_dap_swd_block_done(dap, block);
 	dap->pending_fifo_get_idx = (dap->pending_fifo_get_idx + 1) % dap->packet_count;
 	dap->pending_fifo_block_count--;
 }
 
+/* Send the block being filled, waiting for a response first if the FIFO is full */
+static void cmsis_dap_swd_send_block(struct cmsis_dap *dap)
+{
+	if (dap->pending_fifo_block_count)
+		cmsis_dap_swd_read_process(dap, 0);
+
+	cmsis_dap_swd_write_from_queue(dap);
+
+	if (dap->pending_fifo_block_count >= dap->packet_count)
+		cmsis_dap_swd_read_process(dap, LIBUSB_TIMEOUT_MS);
+}
+
 static int cmsis_dap_swd_run_queue(void)
 {
 	if (cmsis_dap_handle->pending_fifo_block_count)
@@ -979,6 +1030,17 @@ static unsigned int cmsis_dap_tfer_resp_size(unsigned int write_count,
 
 static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 {
+	/* The adapter completes posted AP reads by itself, so the DP RDBUFF read
+	 * following an AP read returns the data already received. Take it from
+	 * the AP read result instead: this saves a transaction, and keeps a burst
+	 * of AP reads eligible for DAP_TransferBlock. */
+	struct pending_transfer_result *last_ap_read = cmsis_dap_handle->last_ap_read;
+	cmsis_dap_handle->last_ap_read = NULL;
+	if (cmd == swd_cmd(true, false, DP_RDBUFF) && last_ap_read && queued_retval == ERROR_OK) {
+		last_ap_read->rdbuff_buffer = dst;
+		return;
+	}
+
 	/* Compute sizes of the DAP Transfer command and the expected response
 	 * for all queued and this operation */
 	bool targetsel_cmd = swd_cmd(false, false, DP_TARGETSEL) == cmd;
@@ -1009,14 +1071,8 @@ static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 			|| resp_size > tfer_max_response_size
 			|| targetsel_cmd
 			|| write_count + read_count > max_transfer_count) {
-		if (cmsis_dap_handle->pending_fifo_block_count)
-			cmsis_dap_swd_read_process(cmsis_dap_handle, 0);
-
 		/* Not enough room in the queue. Run the queue. */
-		cmsis_dap_swd_write_from_queue(cmsis_dap_handle);
-
-		if (cmsis_dap_handle->pending_fifo_block_count >= cmsis_dap_handle->packet_count)
-			cmsis_dap_swd_read_process(cmsis_dap_handle, LIBUSB_TIMEOUT_MS);
+		cmsis_dap_swd_send_block(cmsis_dap_handle);
 	}
 
 	assert(cmsis_dap_handle->pending_fifo[cmsis_dap_handle->pending_fifo_put_idx].transfer_count < pending_queue_len);
@@ -1040,10 +1096,13 @@ static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 		cmsis_dap_handle->swd_cmds_differ = true;
 	}
 
+	transfer->rdbuff_buffer = NULL;
 	if (cmd & SWD_CMD_RNW) {
 		/* Queue a read transaction */
 		transfer->buffer = dst;
 		cmsis_dap_handle->read_count++;
+		if (cmd & SWD_CMD_APNDP)
+			cmsis_dap_handle->last_ap_read = transfer;
 	} else {
 		cmsis_dap_handle->write_count++;
 	}
@@ -1062,6 +1121,258 @@ static void cmsis_dap_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_del
 	cmsis_dap_swd_queue_cmd(cmd, value, 0);
 }
 
+/*
+ * DAP operations of the dapdirect_jtag transport: the DAP registers are
+ * accessed through DAP_Transfer in JTAG mode, queued as in SWD mode. The
+ * adapter handles the DPACC/APACC scans, the posted reads and the WAIT
+ * retries.
+ */
+
+/* Select the JTAG chain position of the DAP accessed by the next transfers */
+static int cmsis_dap_jtag_dap_index(struct adiv5_dap *dap)
+{
+	unsigned int index = 0;
+	struct jtag_tap *tap = jtag_tap_next_enabled(NULL);
+
+	while (tap && tap != dap->tap) {
+		tap = jtag_tap_next_enabled(tap);
+		index++;
+	}
+	if (!tap) {
+		LOG_ERROR("CMSIS-DAP: TAP of %s is not enabled", adiv5_dap_name(dap));
+		return ERROR_FAIL;
+	}
+
+	if (index != cmsis_dap_handle->dap_index) {
+		/* The queued transfers are for the previous DAP */
+		cmsis_dap_swd_send_block(cmsis_dap_handle);
+		cmsis_dap_handle->dap_index = index;
+	}
+
+	return ERROR_OK;
+}
+
+static int cmsis_dap_cmd_dap_write_abort(uint32_t abort)
+{
+	uint8_t *command = cmsis_dap_handle->command;
+
+	/* DAP_WriteABORT is not a transfer: complete the queue first */
+	int retval = cmsis_dap_swd_run_queue();
+
+	command[0] = CMD_DAP_WRITE_ABORT;
+	command[1] = cmsis_dap_handle->dap_index;
+	h_u32_to_le(&command[2], abort);
+
+	int retval2 = cmsis_dap_xfer(cmsis_dap_handle, 6);
+	if (retval2 != ERROR_OK || cmsis_dap_handle->response[1] != DAP_OK) {
+		LOG_ERROR("CMSIS-DAP command CMD_WRITE_ABORT failed.");
+		return ERROR_JTAG_DEVICE_ERROR;
+	}
+
+	return retval;
+}
+
+static int cmsis_dap_jtag_dap_connect(struct adiv5_dap *dap)
+{
+	int retval = cmsis_dap_jtag_dap_index(dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = dap_dp_init(dap);
+	if (retval != ERROR_OK)
+		dap->do_reconnect = true;
+
+	return retval;
+}
+
+static int cmsis_dap_jtag_dap_check_reconnect(struct adiv5_dap *dap)
+{
+	int retval = cmsis_dap_jtag_dap_index(dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (dap->do_reconnect)
+		return cmsis_dap_jtag_dap_connect(dap);
+
+	return ERROR_OK;
+}
+
+static int cmsis_dap_jtag_dap_send_sequence(struct adiv5_dap *dap, enum swd_special_seq seq)
+{
+	/* The adapter stays in JTAG mode, ignore the request */
+	return ERROR_OK;
+}
+
+static void cmsis_dap_jtag_dap_queue_select(struct adiv5_dap *dap, uint64_t sel)
+{
+	dap->select = sel;
+	cmsis_dap_swd_queue_cmd(swd_cmd(false, false, DP_SELECT), NULL, (uint32_t)sel);
+	if (is_adiv6(dap) && dap->asize > 32)
+		cmsis_dap_swd_queue_cmd(swd_cmd(false, false, DP_SELECT1), NULL, (uint32_t)(sel >> 32));
+}
+
+/** Select the DP register bank matching bits 7:4 of reg. */
+static void cmsis_dap_jtag_dap_dp_bankselect(struct adiv5_dap *dap, unsigned int reg)
+{
+	/* Only register address 0 and 4 are banked. */
+	if ((reg & 0xf) > 4)
+		return;
+
+	uint64_t sel = (reg & 0x000000F0) >> 4;
+	if (dap->select != DP_SELECT_INVALID)
+		sel |= dap->select & ~0xfULL;
+
+	if (sel != dap->select)
+		cmsis_dap_jtag_dap_queue_select(dap, sel);
+}
+
+/** Select the AP register bank matching bits 7:4 of reg. */
+static void cmsis_dap_jtag_dap_ap_bankselect(struct adiv5_ap *ap, unsigned int reg)
+{
+	struct adiv5_dap *dap = ap->dap;
+	uint64_t sel;
+
+	if (is_adiv6(dap)) {
+		sel = ap->ap_num | (reg & 0x00000FF0);
+		if (sel == (dap->select & ~0xfULL))
+			return;
+		if (dap->select != DP_SELECT_INVALID)
+			sel |= dap->select & 0xf;
+	} else {
+		sel = (ap->ap_num << 24) | (reg & ADIV5_DP_SELECT_APBANK);
+		if (dap->select != DP_SELECT_INVALID)
+			sel |= dap->select & DP_SELECT_DPBANK;
+		if (sel == dap->select)
+			return;
+	}
+
+	cmsis_dap_jtag_dap_queue_select(dap, sel);
+}
+
+static int cmsis_dap_jtag_dap_queue_dp_read(struct adiv5_dap *dap, unsigned int reg,
+		uint32_t *data)
+{
+	int retval = cmsis_dap_jtag_dap_check_reconnect(dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	cmsis_dap_jtag_dap_dp_bankselect(dap, reg);
+	cmsis_dap_swd_queue_cmd(swd_cmd(true, false, reg), data, 0);
+
+	return ERROR_OK;
+}
+
+static int cmsis_dap_jtag_dap_queue_dp_write(struct adiv5_dap *dap, unsigned int reg,
+		uint32_t data)
+{
+	int retval = cmsis_dap_jtag_dap_check_reconnect(dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* In JTAG, ABORT has its own instruction instead of a DP address */
+	if (reg == DP_ABORT)
+		return cmsis_dap_cmd_dap_write_abort(data);
+
+	if (reg == DP_SELECT) {
+		dap->select = data & (ADIV5_DP_SELECT_APSEL | ADIV5_DP_SELECT_APBANK | DP_SELECT_DPBANK);
+		cmsis_dap_swd_queue_cmd(swd_cmd(false, false, reg), NULL, data);
+		return ERROR_OK;
+	}
+
+	cmsis_dap_jtag_dap_dp_bankselect(dap, reg);
+	cmsis_dap_swd_queue_cmd(swd_cmd(false, false, reg), NULL, data);
+
+	return ERROR_OK;
+}
+
+static int cmsis_dap_jtag_dap_queue_ap_read(struct adiv5_ap *ap, unsigned int reg,
+		uint32_t *data)
+{
+	int retval = cmsis_dap_jtag_dap_check_reconnect(ap->dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	cmsis_dap_jtag_dap_ap_bankselect(ap, reg);
+	cmsis_dap_swd_queue_cmd(swd_cmd(true, true, reg), data, 0);
+
+	return ERROR_OK;
+}
+
+static int cmsis_dap_jtag_dap_queue_ap_write(struct adiv5_ap *ap, unsigned int reg,
+		uint32_t data)
+{
+	int retval = cmsis_dap_jtag_dap_check_reconnect(ap->dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	cmsis_dap_jtag_dap_ap_bankselect(ap, reg);
+	cmsis_dap_swd_queue_cmd(swd_cmd(false, true, reg), NULL, data);
+
+	return ERROR_OK;
+}
+
+static int cmsis_dap_jtag_dap_queue_ap_abort(struct adiv5_dap *dap, uint8_t *ack)
+{
+	int retval = cmsis_dap_jtag_dap_index(dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return cmsis_dap_cmd_dap_write_abort(DAPABORT);
+}
+
+static int cmsis_dap_jtag_dap_run(struct adiv5_dap *dap)
+{
+	uint32_t ctrlstat = 0;
+
+	int retval = cmsis_dap_jtag_dap_index(dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* The adapter reports WAIT and protocol errors, but a failed access
+	 * only shows up in the sticky flags of CTRL/STAT */
+	cmsis_dap_jtag_dap_dp_bankselect(dap, DP_CTRL_STAT);
+	cmsis_dap_swd_queue_cmd(swd_cmd(true, false, DP_CTRL_STAT), &ctrlstat, 0);
+	retval = cmsis_dap_swd_run_queue();
+	if (retval != ERROR_OK) {
+		dap->select = DP_SELECT_INVALID;
+		return retval;
+	}
+
+	if (ctrlstat & SSTICKYERR) {
+		LOG_DEBUG("jtag-dp: CTRL/STAT 0x%" PRIx32, ctrlstat);
+		/* Check power to debug regions */
+		uint32_t pwrmask = CDBGPWRUPREQ | CDBGPWRUPACK | CSYSPWRUPREQ;
+		if (!dap->ignore_syspwrupack)
+			pwrmask |= CSYSPWRUPACK;
+		if ((ctrlstat & pwrmask) != pwrmask) {
+			LOG_ERROR("Debug regions are unpowered, an unexpected reset might have happened");
+			dap->do_reconnect = true;
+		}
+
+		LOG_ERROR("JTAG-DP STICKY ERROR");
+
+		/* Clear Sticky Error and Sticky Overrun Bits */
+		cmsis_dap_swd_queue_cmd(swd_cmd(false, false, DP_CTRL_STAT), NULL,
+			dap->dp_ctrl_stat | SSTICKYERR | SSTICKYORUN);
+		retval = cmsis_dap_swd_run_queue();
+		if (retval == ERROR_OK)
+			retval = ERROR_JTAG_DEVICE_ERROR;
+	}
+
+	return retval;
+}
+
+static const struct dap_ops cmsis_dap_jtag_dap_ops = {
+	.connect = cmsis_dap_jtag_dap_connect,
+	.send_sequence = cmsis_dap_jtag_dap_send_sequence,
+	.queue_dp_read = cmsis_dap_jtag_dap_queue_dp_read,
+	.queue_dp_write = cmsis_dap_jtag_dap_queue_dp_write,
+	.queue_ap_read = cmsis_dap_jtag_dap_queue_ap_read,
+	.queue_ap_write = cmsis_dap_jtag_dap_queue_ap_write,
+	.queue_ap_abort = cmsis_dap_jtag_dap_queue_ap_abort,
+	.run = cmsis_dap_jtag_dap_run,
+};
+
 static int cmsis_dap_get_serial_info(void)
 {
 	uint8_t *data;
@@ -1281,6 +1592,18 @@ static int cmsis_dap_init(void)
 		if (retval != ERROR_OK)
 			return retval;
 
+		if (transport_is_dapdirect_jtag()) {
+			retval = cmsis_dap_cmd_dap_jtag_configure();
+			if (retval != ERROR_OK)
+				return retval;
+
+			/* DAP_Transfer starts its scans from Run-Test/Idle */
+			static const uint8_t tlr_to_idle = 0x1f;
+			retval = cmsis_dap_cmd_dap_swj_sequence(8, &tlr_to_idle);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+
 		LOG_INFO("CMSIS-DAP: Interface Initialised (JTAG)");
 	}
 
@@ -2219,7 +2542,7 @@ static const struct swd_driver cmsis_dap_swd_driver = {
 	.run = cmsis_dap_swd_run_queue,
 };
 
-static const char * const cmsis_dap_transport[] = { "swd", "jtag", NULL };
+static const char * const cmsis_dap_transport[] = { "swd", "jtag", "dapdirect_jtag", NULL };
 
 static struct jtag_interface cmsis_dap_interface = {
 	.supported = DEBUG_CAP_TMS_SEQ,
@@ -2242,4 +2565,5 @@ struct adapter_driver cmsis_dap_adapter_driver = {
 
 	.jtag_ops = &cmsis_dap_interface,
 	.swd_ops = &cmsis_dap_swd_driver,
+	.dap_jtag_ops = &cmsis_dap_jtag_dap_ops,
 };
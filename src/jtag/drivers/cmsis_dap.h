@@ -12,6 +12,8 @@ struct pending_transfer_result {
 	uint8_t cmd;
 	uint32_t data;
 	void *buffer;
+	/* Destination of a DP RDBUFF read completed with the data of this AP read */
+	void *rdbuff_buffer;
 };
 
 /* Up to MIN(packet_count, MAX_PENDING_REQUESTS) requests may be issued
@@ -45,6 +47,12 @@ struct cmsis_dap {
 	uint8_t common_swd_cmd;
 	bool swd_cmds_differ;
 
+	/* The last queued transfer, if it is an AP read not yet processed */
+	struct pending_transfer_result *last_ap_read;
+
+	/* Index in the JTAG chain of the DAP accessed by DAP_Transfer */
+	uint8_t dap_index;
+
 	/* Pending requests are organized as a FIFO - circular buffer */
 	struct pending_request_block pending_fifo[MAX_PENDING_REQUESTS];
 	unsigned int packet_count;
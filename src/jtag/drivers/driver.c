@@ -44,6 +44,56 @@ static void jtag_callback_queue_reset(void)
 	jtag_callback_queue_tail = NULL;
 }
 
+/*
+ * Checks of captured values, kept in one contiguous table per queue and
+ * verified in a single pass after the queue is executed. The second table
+ * belongs to the queue in flight, see interface_jtag_execute_queue_async().
+ */
+struct jtag_scan_check_table {
+	struct jtag_scan_check *checks;
+	size_t count;
+	size_t size;
+};
+
+static struct jtag_scan_check_table jtag_scan_check_tables[2];
+static struct jtag_scan_check_table *jtag_scan_check_table = &jtag_scan_check_tables[0];
+
+int interface_jtag_add_scan_check(uint8_t *captured, uint8_t *value,
+		uint8_t *mask, int num_bits)
+{
+	struct jtag_scan_check_table *table = jtag_scan_check_table;
+
+	if (table->count == table->size) {
+		size_t size = table->size ? table->size * 2 : 64;
+		struct jtag_scan_check *checks = realloc(table->checks, size * sizeof(*checks));
+		if (!checks) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		table->checks = checks;
+		table->size = size;
+	}
+
+	struct jtag_scan_check *check = &table->checks[table->count++];
+	check->captured = captured;
+	check->value = value;
+	check->mask = mask;
+	check->num_bits = num_bits;
+	check->after = jtag_callback_queue_tail;
+
+	return ERROR_OK;
+}
+
+void jtag_scan_checks_free(void)
+{
+	for (unsigned int i = 0; i < ARRAY_SIZE(jtag_scan_check_tables); i++) {
+		free(jtag_scan_check_tables[i].checks);
+		jtag_scan_check_tables[i].checks = NULL;
+		jtag_scan_check_tables[i].count = 0;
+		jtag_scan_check_tables[i].size = 0;
+	}
+}
+
 /**
  * see jtag_add_ir_scan()
  *
@@ -91,6 +141,7 @@ int interface_jtag_add_ir_scan(struct jtag_tap *active,
 
 		/* update device information */
 		buf_cpy(field->out_value, tap->cur_instr, tap->ir_length);
+		tap->cur_instr_valid = true;
 
 		field++;
 	}
@@ -348,6 +399,66 @@ void interface_jtag_add_callback4(jtag_callback_t callback,
 	}
 }
 
+/* queue started by interface_jtag_execute_queue_async(), not completed yet */
+static bool jtag_queue_in_flight;
+static struct jtag_command *jtag_command_queue_in_flight;
+static struct jtag_callback_entry *jtag_callback_queue_in_flight;
+static struct jtag_scan_check_table *jtag_scan_check_table_in_flight;
+
+/*
+ * Verify the captured values and run the callbacks of an executed queue, in
+ * queue order: a callback may rely on the checks queued before it. The
+ * checks between two callbacks are verified in one pass.
+ */
+static int jtag_callback_queue_run(struct jtag_scan_check_table *table,
+		struct jtag_callback_entry *entry)
+{
+	const struct jtag_callback_entry *prev = NULL;
+	size_t done = 0;
+	int retval;
+
+	while (true) {
+		size_t n = 0;
+		while (done + n < table->count && table->checks[done + n].after == prev)
+			n++;
+
+		retval = jtag_scan_checks_verify(table->checks + done, n);
+		done += n;
+		if (retval != ERROR_OK || !entry)
+			break;
+
+		retval = entry->callback(entry->data0, entry->data1, entry->data2, entry->data3);
+		if (retval != ERROR_OK)
+			break;
+
+		prev = entry;
+		entry = entry->next;
+	}
+
+	table->count = 0;
+	return retval;
+}
+
+int interface_jtag_wait_queue(void)
+{
+	if (!jtag_queue_in_flight)
+		return ERROR_OK;
+
+	int retval = default_interface_jtag_execute_queue_finish(jtag_command_queue_in_flight);
+	if (retval == ERROR_OK)
+		retval = jtag_callback_queue_run(jtag_scan_check_table_in_flight,
+				jtag_callback_queue_in_flight);
+
+	jtag_command_queue_release();
+	jtag_scan_check_table_in_flight->count = 0;
+	jtag_queue_in_flight = false;
+	jtag_command_queue_in_flight = NULL;
+	jtag_callback_queue_in_flight = NULL;
+	jtag_scan_check_table_in_flight = NULL;
+
+	return retval;
+}
+
 int interface_jtag_execute_queue(void)
 {
 	static int reentry;
@@ -355,22 +466,46 @@ int interface_jtag_execute_queue(void)
 	assert(reentry == 0);
 	reentry++;
 
+	int wait_retval = interface_jtag_wait_queue();
+
 	int retval = default_interface_jtag_execute_queue();
-	if (retval == ERROR_OK) {
-		struct jtag_callback_entry *entry;
-		for (entry = jtag_callback_queue_head; entry; entry = entry->next) {
-			retval = entry->callback(entry->data0, entry->data1, entry->data2, entry->data3);
-			if (retval != ERROR_OK)
-				break;
-		}
-	}
+	if (retval == ERROR_OK)
+		retval = jtag_callback_queue_run(jtag_scan_check_table, jtag_callback_queue_head);
 
 	jtag_command_queue_reset();
 	jtag_callback_queue_reset();
+	jtag_scan_check_table->count = 0;
 
 	reentry--;
 
-	return retval;
+	return (wait_retval != ERROR_OK) ? wait_retval : retval;
+}
+
+int interface_jtag_execute_queue_async(void)
+{
+	/* only one queue in flight, the next one is being built */
+	int wait_retval = interface_jtag_wait_queue();
+
+	int retval = default_interface_jtag_execute_queue_start(&jtag_queue_in_flight);
+	if (jtag_queue_in_flight) {
+		jtag_callback_queue_in_flight = jtag_callback_queue_head;
+		jtag_command_queue_in_flight = jtag_command_queue_detach();
+		jtag_callback_queue_reset();
+		jtag_scan_check_table_in_flight = jtag_scan_check_table;
+		if (jtag_scan_check_table == &jtag_scan_check_tables[0])
+			jtag_scan_check_table = &jtag_scan_check_tables[1];
+		else
+			jtag_scan_check_table = &jtag_scan_check_tables[0];
+	} else {
+		/* executed synchronously or failed */
+		if (retval == ERROR_OK)
+			retval = jtag_callback_queue_run(jtag_scan_check_table, jtag_callback_queue_head);
+		jtag_command_queue_reset();
+		jtag_callback_queue_reset();
+		jtag_scan_check_table->count = 0;
+	}
+
+	return (wait_retval != ERROR_OK) ? wait_retval : retval;
 }
 
 static int jtag_convert_to_callback4(jtag_callback_data_t data0,
@@ -109,10 +109,46 @@ static struct signal *signals;
 static struct swd_cmd_queue_entry {
 	uint8_t cmd;
 	uint32_t *dst;
-	uint8_t trn_ack_data_parity_trn[DIV_ROUND_UP(4 + 3 + 32 + 1 + 4, 8)];
+	uint32_t data;
+	uint32_t ap_delay_clk;
+	/* offset of the raw response in swd_resp */
+	size_t resp;
 } *swd_cmd_queue;
 static size_t swd_cmd_queue_length;
 static size_t swd_cmd_queue_alloced;
+
+/* Raw responses of the queued transactions, back to back, so that the MPSSE
+ * layer copies the read data of a whole queue at once */
+#define SWD_RESP_READ_LEN 5  /* trn, ack, data, parity and trn, in 4 + 1 bytes */
+#define SWD_RESP_WRITE_LEN 1 /* trn, ack and trn, in the top bits */
+static uint8_t *swd_resp;
+static size_t swd_resp_len;
+
+/* Longest idle sequence after an AP access encoded in a transaction template */
+#define SWD_TEMPLATE_DELAY_MAX 128
+#define SWD_TEMPLATE_MAX (32 + 6 + SWD_TEMPLATE_DELAY_MAX / 8)
+
+/* Batched recoveries from WAIT responses of one transaction before giving up */
+#define SWD_WAIT_RETRIES 10
+
+/* MPSSE commands of a transaction, built once for a pin state and an AP delay */
+struct swd_template {
+	bool valid;
+	/* pin state the sequence starts from and leaves */
+	uint16_t output;
+	uint16_t direction;
+	uint16_t end_output;
+	uint16_t end_direction;
+	uint32_t ap_delay_clk;
+	unsigned int len;
+	/* offset of the request byte and, for writes, of the data and parity */
+	unsigned int cmd_pos;
+	unsigned int data_pos;
+	unsigned int parity_pos;
+	uint8_t seq[SWD_TEMPLATE_MAX];
+};
+/* indexed by the RnW and APnDP bits of the request */
+static struct swd_template swd_templates[2][2];
 static int queued_retval;
 static int freq;
 
@@ -150,7 +186,8 @@ static struct signal *create_signal(const char *name)
 	return *psig;
 }
 
-static int ftdi_set_signal(const struct signal *s, char value)
+/* Compute in *out and *dir the pin state with signal s set to value */
+static int ftdi_signal_state(const struct signal *s, char value, uint16_t *out, uint16_t *dir)
 {
 	bool data;
 	bool oe;
@@ -186,19 +223,34 @@ static int ftdi_set_signal(const struct signal *s, char value)
 		return ERROR_FAIL;
 	}
 
-	uint16_t old_output = output;
-	uint16_t old_direction = direction;
-
-	output = data ? output | s->data_mask : output & ~s->data_mask;
+	*out = data ? *out | s->data_mask : *out & ~s->data_mask;
 	if (s->oe_mask == s->data_mask)
-		direction = oe ? direction | s->oe_mask : direction & ~s->oe_mask;
+		*dir = oe ? *dir | s->oe_mask : *dir & ~s->oe_mask;
 	else
-		output = oe ? output | s->oe_mask : output & ~s->oe_mask;
+		*out = oe ? *out | s->oe_mask : *out & ~s->oe_mask;
+
+	return ERROR_OK;
+}
 
+/* Queue the update of the pins whose state differs from old_output and old_direction */
+static void ftdi_update_pins(uint16_t old_output, uint16_t old_direction)
+{
 	if ((output & 0xff) != (old_output & 0xff) || (direction & 0xff) != (old_direction & 0xff))
 		mpsse_set_data_bits_low_byte(mpsse_ctx, output & 0xff, direction & 0xff);
 	if ((output >> 8 != old_output >> 8) || (direction >> 8 != old_direction >> 8))
 		mpsse_set_data_bits_high_byte(mpsse_ctx, output >> 8, direction >> 8);
+}
+
+static int ftdi_set_signal(const struct signal *s, char value)
+{
+	uint16_t old_output = output;
+	uint16_t old_direction = direction;
+
+	int retval = ftdi_signal_state(s, value, &output, &direction);
+	if (retval != ERROR_OK)
+		return retval;
+
+	ftdi_update_pins(old_output, old_direction);
 
 	return ERROR_OK;
 }
@@ -425,14 +477,12 @@ static void ftdi_execute_scan(struct jtag_command *cmd)
 	LOG_DEBUG_IO("%s type:%d", cmd->cmd.scan->ir_scan ? "IRSCAN" : "DRSCAN",
 		jtag_scan_type(cmd->cmd.scan));
 
-	/* Make sure there are no trailing fields with num_bits == 0, or the logic below will fail. */
-	while (cmd->cmd.scan->num_fields > 0
-			&& cmd->cmd.scan->fields[cmd->cmd.scan->num_fields - 1].num_bits == 0) {
-		cmd->cmd.scan->num_fields--;
-		LOG_DEBUG_IO("discarding trailing empty field");
-	}
+	/* Empty fields are skipped, the logic below needs a non-empty last segment. */
+	struct jtag_scan_iov iov[MAX(cmd->cmd.scan->num_fields, 1)];
+	bool byte_aligned;
+	int iov_count = jtag_scan_iov(cmd->cmd.scan, iov, &byte_aligned);
 
-	if (cmd->cmd.scan->num_fields == 0) {
+	if (iov_count == 0) {
 		LOG_DEBUG_IO("empty scan, doing nothing");
 		return;
 	}
@@ -447,31 +497,31 @@ static void ftdi_execute_scan(struct jtag_command *cmd)
 
 	ftdi_end_state(cmd->cmd.scan->end_state);
 
-	struct scan_field *field = cmd->cmd.scan->fields;
+	struct jtag_scan_iov *field = iov;
 	unsigned scan_size = 0;
 
-	for (int i = 0; i < cmd->cmd.scan->num_fields; i++, field++) {
+	for (int i = 0; i < iov_count; i++, field++) {
 		scan_size += field->num_bits;
-		LOG_DEBUG_IO("%s%s field %d/%d %d bits",
-			field->in_value ? "in" : "",
-			field->out_value ? "out" : "",
+		LOG_DEBUG_IO("%s%s field %d/%d %u bits",
+			field->in ? "in" : "",
+			field->out ? "out" : "",
 			i,
-			cmd->cmd.scan->num_fields,
+			iov_count,
 			field->num_bits);
 
-		if (i == cmd->cmd.scan->num_fields - 1 && tap_get_state() != tap_get_end_state()) {
+		if (i == iov_count - 1 && tap_get_state() != tap_get_end_state()) {
 			/* Last field, and we're leaving IRSHIFT/DRSHIFT. Clock last bit during tap
 			 * movement. This last field can't have length zero, it was checked above. */
 			mpsse_clock_data(mpsse_ctx,
-				field->out_value,
+				field->out,
 				0,
-				field->in_value,
+				field->in,
 				0,
 				field->num_bits - 1,
 				ftdi_jtag_mode);
 			uint8_t last_bit = 0;
-			if (field->out_value)
-				bit_copy(&last_bit, 0, field->out_value, field->num_bits - 1, 1);
+			if (field->out)
+				bit_copy(&last_bit, 0, field->out, field->num_bits - 1, 1);
 
 			/* If endstate is TAP_IDLE, clock out 1-1-0 (->EXIT1 ->UPDATE ->IDLE)
 			 * Otherwise, clock out 1-0 (->EXIT1 ->PAUSE)
@@ -480,7 +530,7 @@ static void ftdi_execute_scan(struct jtag_command *cmd)
 			mpsse_clock_tms_cs(mpsse_ctx,
 					&tms_bits,
 					0,
-					field->in_value,
+					field->in,
 					field->num_bits - 1,
 					1,
 					last_bit,
@@ -506,9 +556,9 @@ static void ftdi_execute_scan(struct jtag_command *cmd)
 			}
 		} else
 			mpsse_clock_data(mpsse_ctx,
-				field->out_value,
+				field->out,
 				0,
-				field->in_value,
+				field->in,
 				0,
 				field->num_bits,
 				ftdi_jtag_mode);
@@ -529,6 +579,9 @@ static int ftdi_reset(int trst, int srst)
 
 	LOG_DEBUG_IO("reset trst: %i srst %i", trst, srst);
 
+	/* don't mix the signal writes into a flush still in flight */
+	jtag_wait_queue_noclear();
+
 	if (!swd_mode) {
 		if (trst == 1) {
 			if (sig_ntrst)
@@ -625,7 +678,7 @@ static void ftdi_execute_command(struct jtag_command *cmd)
 	}
 }
 
-static int ftdi_execute_queue(void)
+static int ftdi_execute_queue_start(void)
 {
 	/* blink, if the current layout has that feature */
 	struct signal *led = find_signal_by_name("LED");
@@ -640,13 +693,31 @@ static int ftdi_execute_queue(void)
 	if (led)
 		ftdi_set_signal(led, '0');
 
-	int retval = mpsse_flush(mpsse_ctx);
+	int retval = mpsse_flush_start(mpsse_ctx);
 	if (retval != ERROR_OK)
 		LOG_ERROR("error while flushing MPSSE queue: %d", retval);
 
 	return retval;
 }
 
+static int ftdi_execute_queue_finish(void)
+{
+	int retval = mpsse_flush_finish(mpsse_ctx);
+	if (retval != ERROR_OK)
+		LOG_ERROR("error while flushing MPSSE queue: %d", retval);
+
+	return retval;
+}
+
+static int ftdi_execute_queue(void)
+{
+	int retval = ftdi_execute_queue_start();
+	if (retval != ERROR_OK)
+		return retval;
+
+	return ftdi_execute_queue_finish();
+}
+
 static int ftdi_initialize(void)
 {
 	if (tap_get_tms_path_len(TAP_IRPAUSE, TAP_IRPAUSE) == 7)
@@ -703,6 +774,7 @@ static int ftdi_quit(void)
 	free(ftdi_device_desc);
 
 	free(swd_cmd_queue);
+	free(swd_resp);
 
 	return ERROR_OK;
 }
@@ -824,6 +896,9 @@ COMMAND_HANDLER(ftdi_handle_set_signal_command)
 		return ERROR_FAIL;
 	}
 
+	/* the MPSSE can't be used while a queue is in flight */
+	jtag_wait_queue_noclear();
+
 	switch (*CMD_ARGV[1]) {
 	case '0':
 	case '1':
@@ -856,6 +931,9 @@ COMMAND_HANDLER(ftdi_handle_get_signal_command)
 		return ERROR_FAIL;
 	}
 
+	/* the MPSSE can't be used while a queue is in flight */
+	jtag_wait_queue_noclear();
+
 	int ret = ftdi_get_signal(sig, &sig_data);
 	if (ret != ERROR_OK)
 		return ret;
@@ -918,6 +996,33 @@ COMMAND_HANDLER(ftdi_handle_tdo_sample_edge_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(ftdi_handle_throughput_command)
+{
+	if (CMD_ARGC > 1 || (CMD_ARGC == 1 && strcmp(CMD_ARGV[0], "reset")))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!mpsse_ctx) {
+		command_print(CMD, "ftdi device not open");
+		return ERROR_FAIL;
+	}
+
+	if (CMD_ARGC == 1) {
+		mpsse_reset_stats(mpsse_ctx);
+		return ERROR_OK;
+	}
+
+	struct mpsse_stats stats;
+	mpsse_get_stats(mpsse_ctx, &stats);
+	command_print(CMD, "%" PRIu64 " bytes out, %" PRIu64 " bytes in, %" PRIu64 " chunks, %" PRId64 " ms busy",
+		stats.bytes_written, stats.bytes_read, stats.chunks, stats.busy_ms);
+	if (stats.busy_ms > 0)
+		command_print(CMD, "%" PRIu64 " KiB/s out, %" PRIu64 " KiB/s in",
+			stats.bytes_written * 1000 / 1024 / stats.busy_ms,
+			stats.bytes_read * 1000 / 1024 / stats.busy_ms);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration ftdi_subcommand_handlers[] = {
 	{
 		.name = "device_desc",
@@ -979,6 +1084,13 @@ static const struct command_registration ftdi_subcommand_handlers[] = {
 			"allow signalling speed increase)",
 		.usage = "(rising|falling)",
 	},
+	{
+		.name = "throughput",
+		.handler = &ftdi_handle_throughput_command,
+		.mode = COMMAND_EXEC,
+		.help = "show or reset the USB traffic counters of the FTDI device",
+		.usage = "[reset]",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -1031,28 +1143,238 @@ static int ftdi_swd_init(void)
 
 	swd_cmd_queue_alloced = 10;
 	swd_cmd_queue = malloc(swd_cmd_queue_alloced * sizeof(*swd_cmd_queue));
+	swd_resp = malloc(swd_cmd_queue_alloced * SWD_RESP_READ_LEN);
 
-	return swd_cmd_queue ? ERROR_OK : ERROR_FAIL;
+	return swd_cmd_queue && swd_resp ? ERROR_OK : ERROR_FAIL;
 }
 
-static void ftdi_swd_swdio_en(bool enable)
+/* Compute in *out and *dir the pin state set by ftdi_swd_swdio_en() */
+static void ftdi_swd_swdio_state(bool enable, uint16_t *out, uint16_t *dir)
 {
 	struct signal *oe = find_signal_by_name("SWDIO_OE");
 	if (oe) {
 		if (oe->data_mask)
-			ftdi_set_signal(oe, enable ? '1' : '0');
+			ftdi_signal_state(oe, enable ? '1' : '0', out, dir);
 		else {
 			/* Sets TDI/DO pin to input during rx when both pins are connected
 			   to SWDIO */
 			if (enable)
-				direction |= jtag_direction_init & 0x0002U;
+				*dir |= jtag_direction_init & 0x0002U;
 			else
-				direction &= ~0x0002U;
-			mpsse_set_data_bits_low_byte(mpsse_ctx, output & 0xff, direction & 0xff);
+				*dir &= ~0x0002U;
 		}
 	}
 }
 
+static void ftdi_swd_swdio_en(bool enable)
+{
+	uint16_t old_output = output;
+	uint16_t old_direction = direction;
+
+	ftdi_swd_swdio_state(enable, &output, &direction);
+	ftdi_update_pins(old_output, old_direction);
+}
+
+/* Append to seq the MPSSE commands moving the pins from one state to another */
+static unsigned int swd_seq_pins(uint8_t *seq, uint16_t from_output, uint16_t from_direction,
+	uint16_t to_output, uint16_t to_direction)
+{
+	unsigned int len = 0;
+
+	if ((to_output & 0xff) != (from_output & 0xff) || (to_direction & 0xff) != (from_direction & 0xff)) {
+		seq[len++] = 0x80; /* set data bits low byte */
+		seq[len++] = to_output & 0xff;
+		seq[len++] = to_direction & 0xff;
+	}
+	if ((to_output >> 8) != (from_output >> 8) || (to_direction >> 8) != (from_direction >> 8)) {
+		seq[len++] = 0x82; /* set data bits high byte */
+		seq[len++] = to_output >> 8;
+		seq[len++] = to_direction >> 8;
+	}
+
+	return len;
+}
+
+/* Append to seq the MPSSE commands clocking out clk idle cycles */
+static unsigned int swd_seq_idle(uint8_t *seq, unsigned int clk)
+{
+	unsigned int len = 0;
+
+	if (clk >= 8) {
+		seq[len++] = SWD_MODE | 0x10; /* clock data bytes out */
+		seq[len++] = (clk / 8 - 1) & 0xff;
+		seq[len++] = (clk / 8 - 1) >> 8;
+		memset(seq + len, 0, clk / 8);
+		len += clk / 8;
+	}
+	if (clk % 8) {
+		seq[len++] = SWD_MODE | 0x12; /* clock data bits out */
+		seq[len++] = clk % 8 - 1;
+		seq[len++] = 0;
+	}
+
+	return len;
+}
+
+/*
+ * Return the template of a transaction starting from the current pin state. The
+ * sequence is what ftdi_swd_queue_cmd() used to queue with one MPSSE call per
+ * field: request, turnaround to the target, acknowledge and read data, or
+ * acknowledge, turnaround back and write data, then the idle cycles of an AP
+ * access.
+ */
+static const struct swd_template *ftdi_swd_template_get(bool rnw, bool ap, uint32_t ap_delay_clk)
+{
+	struct swd_template *t = &swd_templates[rnw][ap];
+
+	if (!ap)
+		ap_delay_clk = 0;
+	if (t->valid && t->output == output && t->direction == direction && t->ap_delay_clk == ap_delay_clk)
+		return t;
+
+	uint16_t off_output = output, off_direction = direction;
+	ftdi_swd_swdio_state(false, &off_output, &off_direction);
+	uint16_t on_output = off_output, on_direction = off_direction;
+	ftdi_swd_swdio_state(true, &on_output, &on_direction);
+
+	uint8_t *seq = t->seq;
+	unsigned int len = 0;
+
+	seq[len++] = SWD_MODE | 0x10; /* clock data bytes out: request */
+	seq[len++] = 0;
+	seq[len++] = 0;
+	t->cmd_pos = len++;
+	len += swd_seq_pins(seq + len, output, direction, off_output, off_direction);
+	if (rnw) {
+		seq[len++] = SWD_MODE | 0x20; /* clock data bytes in: trn, ack, data[27:0] */
+		seq[len++] = 3;
+		seq[len++] = 0;
+		seq[len++] = SWD_MODE | 0x22; /* clock data bits in: data[31:28], parity, trn */
+		seq[len++] = 6 - 1;
+		len += swd_seq_pins(seq + len, off_output, off_direction, on_output, on_direction);
+	} else {
+		seq[len++] = SWD_MODE | 0x22; /* clock data bits in: trn, ack, trn */
+		seq[len++] = 5 - 1;
+		len += swd_seq_pins(seq + len, off_output, off_direction, on_output, on_direction);
+		seq[len++] = SWD_MODE | 0x10; /* clock data bytes out: data */
+		seq[len++] = 3;
+		seq[len++] = 0;
+		t->data_pos = len;
+		len += 4;
+		seq[len++] = SWD_MODE | 0x12; /* clock data bits out: parity */
+		seq[len++] = 0;
+		t->parity_pos = len++;
+	}
+	/* Insert idle cycles after AP accesses to avoid WAIT */
+	if (ap_delay_clk <= SWD_TEMPLATE_DELAY_MAX)
+		len += swd_seq_idle(seq + len, ap_delay_clk);
+
+	assert(len <= SWD_TEMPLATE_MAX);
+	t->len = len;
+	t->output = output;
+	t->direction = direction;
+	t->end_output = on_output;
+	t->end_direction = on_direction;
+	t->ap_delay_clk = ap_delay_clk;
+	t->valid = true;
+
+	return t;
+}
+
+/* Decode the raw response of a queued transaction, returning its acknowledge */
+static int ftdi_swd_decode(const struct swd_cmd_queue_entry *q, uint32_t *data, int *parity)
+{
+	const uint8_t *r = swd_resp + q->resp;
+
+	if (q->cmd & SWD_CMD_RNW) {
+		uint64_t bits = le_to_h_u32(r) | (uint64_t)(r[4] >> 2) << 32;
+		*data = bits >> 4;
+		*parity = (bits >> 36) & 1;
+		return (bits >> 1) & 0x7;
+	}
+
+	*data = q->data;
+	*parity = parity_u32(q->data);
+	return (r[0] >> 4) & 0x7;
+}
+
+/*
+ * A WAIT leaves the transaction undone. With overrun detection, which the DAP
+ * setup enables, the DP then answers FAULT to the following transactions
+ * without executing them, so the queue can be replayed from the WAIT once the
+ * sticky flags are cleared. Only reads of DP registers may succeed in between,
+ * and reading them again is harmless.
+ */
+static bool ftdi_swd_can_replay(size_t first)
+{
+	for (size_t i = first + 1; i < swd_cmd_queue_length; i++) {
+		uint32_t data;
+		int parity;
+		int ack = ftdi_swd_decode(&swd_cmd_queue[i], &data, &parity);
+		uint8_t cmd = swd_cmd_queue[i].cmd;
+
+		if (!swd_cmd_returns_ack(cmd) || ack == SWD_ACK_WAIT || ack == SWD_ACK_FAULT)
+			continue;
+		if (ack == SWD_ACK_OK && (cmd & SWD_CMD_RNW) && !(cmd & SWD_CMD_APNDP))
+			continue;
+		return false;
+	}
+
+	return true;
+}
+
+static void ftdi_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data, uint32_t ap_delay_clk);
+
+static bool ftdi_swd_queue_grow(size_t length)
+{
+	if (length <= swd_cmd_queue_alloced)
+		return true;
+
+	size_t alloced = MAX(swd_cmd_queue_alloced * 2, length);
+	struct swd_cmd_queue_entry *q = realloc(swd_cmd_queue, alloced * sizeof(*swd_cmd_queue));
+	if (q)
+		swd_cmd_queue = q;
+	uint8_t *resp = realloc(swd_resp, alloced * SWD_RESP_READ_LEN);
+	if (resp)
+		swd_resp = resp;
+	if (!q || !resp)
+		return false;
+
+	swd_cmd_queue_alloced = alloced;
+	LOG_DEBUG("Increased SWD command queue to %zu elements", swd_cmd_queue_alloced);
+	return true;
+}
+
+/* Queue again the transactions from the one that got WAIT, after clearing the sticky
+ * overrun. STICKYERR and STICKYCMP are left alone so that a bus fault which happened
+ * before the WAIT is still reported by the next CTRL/STAT read. */
+static int ftdi_swd_replay(size_t first, unsigned int retry)
+{
+	size_t count = swd_cmd_queue_length - first;
+	struct swd_cmd_queue_entry *replay = malloc(count * sizeof(*replay));
+
+	if (!replay || !ftdi_swd_queue_grow(count + 1)) {
+		free(replay);
+		return ERROR_FAIL;
+	}
+	memcpy(replay, swd_cmd_queue + first, count * sizeof(*replay));
+
+	LOG_DEBUG("SWD WAIT, replaying %zu transactions, retry %u", count, retry);
+	swd_cmd_queue_length = 0;
+	swd_resp_len = 0;
+
+	/* Give the stalled AP more time at each retry */
+	mpsse_clock_data_out(mpsse_ctx, NULL, 0, 8 << MIN(retry, 8u), SWD_MODE);
+	ftdi_swd_queue_cmd(swd_cmd(false, false, DP_ABORT),
+		NULL, WDERRCLR | ORUNERRCLR, 0);
+	for (size_t i = 0; i < count; i++)
+		ftdi_swd_queue_cmd(replay[i].cmd, replay[i].dst, replay[i].data, replay[i].ap_delay_clk);
+	mpsse_clock_data_out(mpsse_ctx, NULL, 0, 8, SWD_MODE);
+
+	free(replay);
+	return ERROR_OK;
+}
+
 /**
  * Flush the MPSSE queue and process the SWD transaction queue
  * @return
@@ -1076,48 +1398,71 @@ static int ftdi_swd_run_queue(void)
 	if (led)
 		ftdi_set_signal(led, '0');
 
-	queued_retval = mpsse_flush(mpsse_ctx);
-	if (queued_retval != ERROR_OK) {
-		LOG_ERROR("MPSSE failed");
-		goto skip;
-	}
-
-	for (size_t i = 0; i < swd_cmd_queue_length; i++) {
-		int ack = buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1, 3);
-
-		/* Devices do not reply to DP_TARGETSEL write cmd, ignore received ack */
-		bool check_ack = swd_cmd_returns_ack(swd_cmd_queue[i].cmd);
-
-		LOG_DEBUG_IO("%s%s %s %s reg %X = %08"PRIx32,
-				check_ack ? "" : "ack ignored ",
-				ack == SWD_ACK_OK ? "OK" : ack == SWD_ACK_WAIT ? "WAIT" : ack == SWD_ACK_FAULT ? "FAULT" : "JUNK",
-				swd_cmd_queue[i].cmd & SWD_CMD_APNDP ? "AP" : "DP",
-				swd_cmd_queue[i].cmd & SWD_CMD_RNW ? "read" : "write",
-				(swd_cmd_queue[i].cmd & SWD_CMD_A32) >> 1,
-				buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn,
-						1 + 3 + (swd_cmd_queue[i].cmd & SWD_CMD_RNW ? 0 : 1), 32));
-
-		if (ack != SWD_ACK_OK && check_ack) {
-			queued_retval = swd_ack_to_error_code(ack);
+	unsigned int retry = 0;
+	bool replayed = false;
+	for (;;) {
+		queued_retval = mpsse_flush(mpsse_ctx);
+		if (queued_retval != ERROR_OK) {
+			LOG_ERROR("MPSSE failed");
 			goto skip;
+		}
 
-		} else if (swd_cmd_queue[i].cmd & SWD_CMD_RNW) {
-			uint32_t data = buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1 + 3, 32);
-			int parity = buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1 + 3 + 32, 1);
-
-			if (parity != parity_u32(data)) {
-				LOG_ERROR("SWD Read data parity mismatch");
-				queued_retval = ERROR_FAIL;
+		size_t wait_at = swd_cmd_queue_length;
+		for (size_t i = 0; i < swd_cmd_queue_length; i++) {
+			uint32_t data;
+			int parity;
+			int ack = ftdi_swd_decode(&swd_cmd_queue[i], &data, &parity);
+
+			/* Devices do not reply to DP_TARGETSEL write cmd, ignore received ack */
+			bool check_ack = swd_cmd_returns_ack(swd_cmd_queue[i].cmd);
+
+			LOG_DEBUG_IO("%s%s %s %s reg %X = %08"PRIx32,
+					check_ack ? "" : "ack ignored ",
+					ack == SWD_ACK_OK ? "OK" : ack == SWD_ACK_WAIT ? "WAIT" : ack == SWD_ACK_FAULT ? "FAULT" : "JUNK",
+					swd_cmd_queue[i].cmd & SWD_CMD_APNDP ? "AP" : "DP",
+					swd_cmd_queue[i].cmd & SWD_CMD_RNW ? "read" : "write",
+					(swd_cmd_queue[i].cmd & SWD_CMD_A32) >> 1,
+					data);
+
+			if (ack != SWD_ACK_OK && check_ack) {
+				if (ack == SWD_ACK_WAIT && ftdi_swd_can_replay(i)) {
+					wait_at = i;
+					break;
+				}
+				queued_retval = swd_ack_to_error_code(ack);
 				goto skip;
+
+			} else if (swd_cmd_queue[i].cmd & SWD_CMD_RNW) {
+				if (parity != parity_u32(data)) {
+					LOG_ERROR("SWD Read data parity mismatch");
+					queued_retval = ERROR_FAIL;
+					goto skip;
+				}
+
+				if (swd_cmd_queue[i].dst)
+					*swd_cmd_queue[i].dst = data;
 			}
+		}
 
-			if (swd_cmd_queue[i].dst)
-				*swd_cmd_queue[i].dst = data;
+		if (wait_at == swd_cmd_queue_length)
+			break;
+
+		/* Only count the retries of a transaction that keeps waiting; the
+		 * replayed queue starts with the ABORT write */
+		retry = replayed && wait_at == 1 ? retry + 1 : 0;
+		if (retry >= SWD_WAIT_RETRIES) {
+			queued_retval = ERROR_WAIT;
+			goto skip;
 		}
+		queued_retval = ftdi_swd_replay(wait_at, retry);
+		replayed = true;
+		if (queued_retval != ERROR_OK)
+			goto skip;
 	}
 
 skip:
 	swd_cmd_queue_length = 0;
+	swd_resp_len = 0;
 	retval = queued_retval;
 	queued_retval = ERROR_OK;
 
@@ -1135,50 +1480,38 @@ static void ftdi_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data, uint32
 		 * Note that it's not possible to avoid running the queue here, because mpsse contains
 		 * pointers into the queue which may be invalid after the realloc. */
 		queued_retval = ftdi_swd_run_queue();
-		struct swd_cmd_queue_entry *q = realloc(swd_cmd_queue, swd_cmd_queue_alloced * 2 * sizeof(*swd_cmd_queue));
-		if (q) {
-			swd_cmd_queue = q;
-			swd_cmd_queue_alloced *= 2;
-			LOG_DEBUG("Increased SWD command queue to %zu elements", swd_cmd_queue_alloced);
-		}
+		ftdi_swd_queue_grow(swd_cmd_queue_alloced * 2);
 	}
 
 	if (queued_retval != ERROR_OK)
 		return;
 
 	size_t i = swd_cmd_queue_length++;
-	swd_cmd_queue[i].cmd = cmd | SWD_CMD_START | SWD_CMD_PARK;
-
-	mpsse_clock_data_out(mpsse_ctx, &swd_cmd_queue[i].cmd, 0, 8, SWD_MODE);
-
-	if (swd_cmd_queue[i].cmd & SWD_CMD_RNW) {
-		/* Queue a read transaction */
-		swd_cmd_queue[i].dst = dst;
-
-		ftdi_swd_swdio_en(false);
-		mpsse_clock_data_in(mpsse_ctx, swd_cmd_queue[i].trn_ack_data_parity_trn,
-				0, 1 + 3 + 32 + 1 + 1, SWD_MODE);
-		ftdi_swd_swdio_en(true);
-	} else {
-		/* Queue a write transaction */
-		ftdi_swd_swdio_en(false);
-
-		mpsse_clock_data_in(mpsse_ctx, swd_cmd_queue[i].trn_ack_data_parity_trn,
-				0, 1 + 3 + 1, SWD_MODE);
-
-		ftdi_swd_swdio_en(true);
-
-		buf_set_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1 + 3 + 1, 32, data);
-		buf_set_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1 + 3 + 1 + 32, 1, parity_u32(data));
-
-		mpsse_clock_data_out(mpsse_ctx, swd_cmd_queue[i].trn_ack_data_parity_trn,
-				1 + 3 + 1, 32 + 1, SWD_MODE);
+	struct swd_cmd_queue_entry *q = &swd_cmd_queue[i];
+	q->cmd = cmd | SWD_CMD_START | SWD_CMD_PARK;
+	q->dst = dst;
+	q->data = data;
+	q->ap_delay_clk = ap_delay_clk;
+	q->resp = swd_resp_len;
+
+	const struct swd_template *t = ftdi_swd_template_get(cmd & SWD_CMD_RNW, cmd & SWD_CMD_APNDP, ap_delay_clk);
+	uint8_t seq[SWD_TEMPLATE_MAX];
+	memcpy(seq, t->seq, t->len);
+	seq[t->cmd_pos] = q->cmd;
+	if (!(cmd & SWD_CMD_RNW)) {
+		h_u32_to_le(seq + t->data_pos, data);
+		seq[t->parity_pos] = parity_u32(data);
 	}
 
-	/* Insert idle cycles after AP accesses to avoid WAIT */
-	if (cmd & SWD_CMD_APNDP)
-		mpsse_clock_data_out(mpsse_ctx, NULL, 0, ap_delay_clk, SWD_MODE);
+	unsigned int resp_len = cmd & SWD_CMD_RNW ? SWD_RESP_READ_LEN : SWD_RESP_WRITE_LEN;
+	mpsse_queue_raw(mpsse_ctx, seq, t->len, swd_resp + swd_resp_len, resp_len);
+	swd_resp_len += resp_len;
+	output = t->end_output;
+	direction = t->end_direction;
 
+	/* Idle cycles too long for the template */
+	if ((cmd & SWD_CMD_APNDP) && ap_delay_clk > SWD_TEMPLATE_DELAY_MAX)
+		mpsse_clock_data_out(mpsse_ctx, NULL, 0, ap_delay_clk, SWD_MODE);
 }
 
 static void ftdi_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_clk)
@@ -1252,6 +1585,8 @@ static const char * const ftdi_transports[] = { "jtag", "swd", NULL };
 static struct jtag_interface ftdi_interface = {
 	.supported = DEBUG_CAP_TMS_SEQ,
 	.execute_queue = ftdi_execute_queue,
+	.execute_queue_start = ftdi_execute_queue_start,
+	.execute_queue_finish = ftdi_execute_queue_finish,
 };
 
 struct adapter_driver ftdi_adapter_driver = {
@@ -74,6 +74,7 @@ static inline bool gpio_level(int g)
 
 static bb_value_t imx_gpio_read(void);
 static int imx_gpio_write(int tck, int tms, int tdi);
+static int imx_gpio_write_edges(const uint8_t *edges, size_t count, uint8_t *tdo);
 
 static int imx_gpio_swdio_read(void);
 static void imx_gpio_swdio_drive(bool is_output);
@@ -85,6 +86,7 @@ static int imx_gpio_quit(void);
 static struct bitbang_interface imx_gpio_bitbang = {
 	.read = imx_gpio_read,
 	.write = imx_gpio_write,
+	.write_edges = imx_gpio_write_edges,
 	.swdio_read = imx_gpio_swdio_read,
 	.swdio_drive = imx_gpio_swdio_drive,
 	.swd_write = imx_gpio_swd_write,
@@ -135,6 +137,38 @@ static int imx_gpio_write(int tck, int tms, int tdi)
 	return ERROR_OK;
 }
 
+static int imx_gpio_write_edges(const uint8_t *edges, size_t count, uint8_t *tdo)
+{
+	/* all lines are set on the first state, then only those that change */
+	unsigned int prev = ~0u;
+	unsigned int sampled = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		unsigned int state = edges[i];
+		unsigned int changed = state ^ prev;
+
+		if (changed & BB_EDGE_TMS)
+			(state & BB_EDGE_TMS) ? gpio_set(tms_gpio) : gpio_clear(tms_gpio);
+		if (changed & BB_EDGE_TDI)
+			(state & BB_EDGE_TDI) ? gpio_set(tdi_gpio) : gpio_clear(tdi_gpio);
+		if (changed & BB_EDGE_TCK)
+			(state & BB_EDGE_TCK) ? gpio_set(tck_gpio) : gpio_clear(tck_gpio);
+		prev = state;
+
+		for (unsigned int j = 0; j < jtag_delay; j++)
+			asm volatile ("");
+
+		if (state & BB_EDGE_SAMPLE) {
+			bb_value_t value = imx_gpio_read();
+			if (value == BB_ERROR)
+				return ERROR_FAIL;
+			bitbang_edges_store_tdo(tdo, sampled++, value);
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static int imx_gpio_swd_write(int swclk, int swdio)
 {
 	swdio ? gpio_set(swdio_gpio) : gpio_clear(swdio_gpio);
@@ -31,12 +31,20 @@
 #define DEFAULT_SERVER_PORT	5555
 
 #define	XFERT_MAX_SIZE		512
+/* Largest transfer size "jtag_vpi set_xfer_size" can ask for */
+#define XFERT_MAX_SIZE_LIMIT	(64 * 1024)
+
+/* Bytes of responses left in flight in pipelined mode. The server must be
+ * able to write them while we are still writing commands, so stay well
+ * within the usual socket buffer sizes. */
+#define PIPELINE_MAX_BYTES	(64 * 1024)
 
 #define CMD_RESET		0
 #define CMD_TMS_SEQ		1
 #define CMD_SCAN_CHAIN		2
 #define CMD_SCAN_CHAIN_FLIP_TMS	3
 #define CMD_STOP_SIMU		4
+#define CMD_SET_XFER_SIZE	5
 
 /* jtag_vpi server port and address to connect to */
 static int server_port = DEFAULT_SERVER_PORT;
@@ -45,27 +53,56 @@ static char *server_address;
 /* Send CMD_STOP_SIMU to server when OpenOCD exits? */
 static bool stop_sim_on_exit;
 
+/* Send the commands of a queue back to back, and collect the responses at
+ * the end of the queue? */
+static bool pipeline = true;
+
+/* Transfer size to negotiate with the server, and the one in use */
+static unsigned int xfer_size_wanted = XFERT_MAX_SIZE;
+static unsigned int xfer_size = XFERT_MAX_SIZE;
+
 static int sockfd;
 static struct sockaddr_in serv_addr;
 
-/* One jtag_vpi "packet" as sent over a TCP channel. */
-struct vpi_cmd {
-	union {
-		uint32_t cmd;
-		unsigned char cmd_buf[4];
-	};
-	unsigned char buffer_out[XFERT_MAX_SIZE];
-	unsigned char buffer_in[XFERT_MAX_SIZE];
-	union {
-		uint32_t length;
-		unsigned char length_buf[4];
-	};
-	union {
-		uint32_t nb_bits;
-		unsigned char nb_bits_buf[4];
-	};
+/*
+ * One jtag_vpi "packet" as sent over a TCP channel is made of, in order:
+ *   uint32_t cmd;
+ *   unsigned char buffer_out[xfer_size];
+ *   unsigned char buffer_in[xfer_size];
+ *   uint32_t length;
+ *   uint32_t nb_bits;
+ * With the default transfer size of 512 bytes, this is the packet of
+ * every jtag_vpi server.
+ */
+#define PACKET_SIZE(xfer)	(2 * (xfer) + 3 * 4)
+#define PACKET_OUT(xfer)	4
+#define PACKET_IN(xfer)		((xfer) + 4)
+#define PACKET_LENGTH(xfer)	(2 * (xfer) + 4)
+#define PACKET_NB_BITS(xfer)	(2 * (xfer) + 8)
+
+/* Packets not sent yet */
+static uint8_t *send_buf;
+static size_t send_buf_used;
+static size_t send_buf_size;
+
+/* Received packet */
+static uint8_t *recv_packet;
+
+/*
+ * Work left for the end of the pipeline, in order: a scan response to
+ * receive into @a in, or the fields of @a scan to fill from @a buf.
+ */
+struct jtag_vpi_pending {
+	uint8_t *in;
+	int nb_bits;
+	uint8_t *buf;
+	struct scan_command *scan;
 };
 
+static struct jtag_vpi_pending *pending;
+static unsigned int pending_count;
+static unsigned int pending_max;
+
 static char *jtag_vpi_cmd_to_str(int cmd_num)
 {
 	switch (cmd_num) {
@@ -79,89 +116,55 @@ static char *jtag_vpi_cmd_to_str(int cmd_num)
 		return "CMD_SCAN_CHAIN_FLIP_TMS";
 	case CMD_STOP_SIMU:
 		return "CMD_STOP_SIMU";
+	case CMD_SET_XFER_SIZE:
+		return "CMD_SET_XFER_SIZE";
 	default:
 		return "<unknown>";
 	}
 }
 
-static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
+static int jtag_vpi_write(const uint8_t *buf, size_t len)
 {
-	int retval;
+	size_t written = 0;
 
-	/* Optional low-level JTAG debug */
-	if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
-		if (vpi->nb_bits > 0) {
-			/* command with a non-empty data payload */
-			char *char_buf = buf_to_hex_str(vpi->buffer_out,
-					(vpi->nb_bits > DEBUG_JTAG_IOZ)
-						? DEBUG_JTAG_IOZ
-						: vpi->nb_bits);
-			LOG_DEBUG_IO("sending JTAG VPI cmd: cmd=%s, "
-					"length=%" PRIu32 ", "
-					"nb_bits=%" PRIu32 ", "
-					"buf_out=0x%s%s",
-					jtag_vpi_cmd_to_str(vpi->cmd),
-					vpi->length,
-					vpi->nb_bits,
-					char_buf,
-					(vpi->nb_bits > DEBUG_JTAG_IOZ) ? "(...)" : "");
-			free(char_buf);
-		} else {
-			/* command without data payload */
-			LOG_DEBUG_IO("sending JTAG VPI cmd: cmd=%s, "
-					"length=%" PRIu32 ", "
-					"nb_bits=%" PRIu32,
-					jtag_vpi_cmd_to_str(vpi->cmd),
-					vpi->length,
-					vpi->nb_bits);
-		}
-	}
-
-	/* Use little endian when transmitting/receiving jtag_vpi cmds.
-	   The choice of little endian goes against usual networking conventions
-	   but is intentional to remain compatible with most older OpenOCD builds
-	   (i.e. builds on little-endian platforms). */
-	h_u32_to_le(vpi->cmd_buf, vpi->cmd);
-	h_u32_to_le(vpi->length_buf, vpi->length);
-	h_u32_to_le(vpi->nb_bits_buf, vpi->nb_bits);
-
-retry_write:
-	retval = write_socket(sockfd, vpi, sizeof(struct vpi_cmd));
+	while (written < len) {
+		int retval = write_socket(sockfd, buf + written, len - written);
 
-	if (retval < 0) {
-		/* Account for the case when socket write is interrupted. */
+		if (retval < 0) {
+			/* Account for the case when socket write is interrupted. */
 #ifdef _WIN32
-		int wsa_err = WSAGetLastError();
-		if (wsa_err == WSAEINTR)
-			goto retry_write;
+			int wsa_err = WSAGetLastError();
+			if (wsa_err == WSAEINTR)
+				continue;
 #else
-		if (errno == EINTR)
-			goto retry_write;
+			if (errno == EINTR)
+				continue;
 #endif
-		/* Otherwise this is an error using the socket, most likely fatal
-		   for the connection. B*/
-		log_socket_error("jtag_vpi xmit");
-		/* TODO: Clean way how adapter drivers can report fatal errors
-		   to upper layers of OpenOCD and let it perform an orderly shutdown? */
-		exit(-1);
-	} else if (retval < (int)sizeof(struct vpi_cmd)) {
-		/* This means we could not send all data, which is most likely fatal
-		   for the jtag_vpi connection (the underlying TCP connection likely not
-		   usable anymore) */
-		LOG_ERROR("jtag_vpi: Could not send all data through jtag_vpi connection.");
-		exit(-1);
+			/* Otherwise this is an error using the socket, most likely fatal
+			   for the connection. B*/
+			log_socket_error("jtag_vpi xmit");
+			/* TODO: Clean way how adapter drivers can report fatal errors
+			   to upper layers of OpenOCD and let it perform an orderly shutdown? */
+			exit(-1);
+		} else if (retval == 0) {
+			/* This means we could not send all data, which is most likely fatal
+			   for the jtag_vpi connection (the underlying TCP connection likely not
+			   usable anymore) */
+			LOG_ERROR("jtag_vpi: Could not send all data through jtag_vpi connection.");
+			exit(-1);
+		}
+		written += retval;
 	}
 
-	/* Otherwise the packet has been sent successfully. */
+	/* Otherwise the data has been sent successfully. */
 	return ERROR_OK;
 }
 
-static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
+static int jtag_vpi_read(uint8_t *buf, size_t len)
 {
-	unsigned bytes_buffered = 0;
-	while (bytes_buffered < sizeof(struct vpi_cmd)) {
-		int bytes_to_receive = sizeof(struct vpi_cmd) - bytes_buffered;
-		int retval = read_socket(sockfd, ((char *)vpi) + bytes_buffered, bytes_to_receive);
+	size_t bytes_buffered = 0;
+	while (bytes_buffered < len) {
+		int retval = read_socket(sockfd, buf + bytes_buffered, len - bytes_buffered);
 		if (retval < 0) {
 #ifdef _WIN32
 			int wsa_err = WSAGetLastError();
@@ -187,10 +190,153 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 		bytes_buffered += retval;
 	}
 
-	/* Use little endian when transmitting/receiving jtag_vpi cmds. */
-	vpi->cmd = le_to_h_u32(vpi->cmd_buf);
-	vpi->length = le_to_h_u32(vpi->length_buf);
-	vpi->nb_bits = le_to_h_u32(vpi->nb_bits_buf);
+	return ERROR_OK;
+}
+
+static int jtag_vpi_send_flush(void)
+{
+	if (!send_buf_used)
+		return ERROR_OK;
+
+	int retval = jtag_vpi_write(send_buf, send_buf_used);
+	send_buf_used = 0;
+	return retval;
+}
+
+/**
+ * jtag_vpi_send_cmd - queue a command packet for the server
+ * @param cmd CMD_xxx command
+ * @param out @a nb_bits bits of data (or NULL if @a fill is to be sent)
+ * @param fill byte value sent when @a out is NULL
+ * @param length number of data bytes, or the argument of the command
+ * @param nb_bits number of data bits
+ *
+ * The packet is sent at once, unless in pipelined mode.
+ */
+static int jtag_vpi_send_cmd(uint32_t cmd, const uint8_t *out, uint8_t fill,
+		uint32_t length, uint32_t nb_bits)
+{
+	/* Optional low-level JTAG debug */
+	if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
+		if (nb_bits > 0 && out) {
+			/* command with a non-empty data payload */
+			char *char_buf = buf_to_hex_str(out,
+					(nb_bits > DEBUG_JTAG_IOZ)
+						? DEBUG_JTAG_IOZ
+						: nb_bits);
+			LOG_DEBUG_IO("sending JTAG VPI cmd: cmd=%s, "
+					"length=%" PRIu32 ", "
+					"nb_bits=%" PRIu32 ", "
+					"buf_out=0x%s%s",
+					jtag_vpi_cmd_to_str(cmd),
+					length,
+					nb_bits,
+					char_buf,
+					(nb_bits > DEBUG_JTAG_IOZ) ? "(...)" : "");
+			free(char_buf);
+		} else {
+			/* command without data payload */
+			LOG_DEBUG_IO("sending JTAG VPI cmd: cmd=%s, "
+					"length=%" PRIu32 ", "
+					"nb_bits=%" PRIu32,
+					jtag_vpi_cmd_to_str(cmd),
+					length,
+					nb_bits);
+		}
+	}
+
+	if (send_buf_used + PACKET_SIZE(xfer_size) > send_buf_size) {
+		int retval = jtag_vpi_send_flush();
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	uint8_t *packet = send_buf + send_buf_used;
+	memset(packet, 0, PACKET_SIZE(xfer_size));
+
+	/* Use little endian when transmitting/receiving jtag_vpi cmds.
+	   The choice of little endian goes against usual networking conventions
+	   but is intentional to remain compatible with most older OpenOCD builds
+	   (i.e. builds on little-endian platforms). */
+	h_u32_to_le(packet, cmd);
+	if (out)
+		memcpy(packet + PACKET_OUT(xfer_size), out, DIV_ROUND_UP(nb_bits, 8));
+	else
+		memset(packet + PACKET_OUT(xfer_size), fill, DIV_ROUND_UP(nb_bits, 8));
+	h_u32_to_le(packet + PACKET_LENGTH(xfer_size), length);
+	h_u32_to_le(packet + PACKET_NB_BITS(xfer_size), nb_bits);
+	send_buf_used += PACKET_SIZE(xfer_size);
+
+	if (!pipeline)
+		return jtag_vpi_send_flush();
+
+	return ERROR_OK;
+}
+
+/* Receive the response of a scan, storing its TDO bits into @a in if not NULL */
+static int jtag_vpi_receive_scan(uint8_t *in, int nb_bits)
+{
+	int retval = jtag_vpi_read(recv_packet, PACKET_SIZE(xfer_size));
+	if (retval != ERROR_OK)
+		return retval;
+
+	const uint8_t *buffer_in = recv_packet + PACKET_IN(xfer_size);
+	int nb_bytes = DIV_ROUND_UP(nb_bits, 8);
+
+	/* Optional low-level JTAG debug */
+	if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
+		char *char_buf = buf_to_hex_str(buffer_in,
+				(nb_bits > DEBUG_JTAG_IOZ) ? DEBUG_JTAG_IOZ : nb_bits);
+		LOG_DEBUG_IO("recvd JTAG VPI data: nb_bits=%d, buf_in=0x%s%s",
+			nb_bits, char_buf, (nb_bits > DEBUG_JTAG_IOZ) ? "(...)" : "");
+		free(char_buf);
+	}
+
+	if (in) {
+		memcpy(in, buffer_in, nb_bytes);
+		if (nb_bits % 8)
+			in[nb_bytes - 1] &= (1 << (nb_bits % 8)) - 1;
+	}
+
+	return ERROR_OK;
+}
+
+/* Send the queued packets, then receive every pending scan response */
+static int jtag_vpi_flush(void)
+{
+	int retval = jtag_vpi_send_flush();
+
+	for (unsigned int i = 0; i < pending_count; i++) {
+		struct jtag_vpi_pending *p = &pending[i];
+		int ret;
+
+		if (p->buf) {
+			ret = jtag_read_buffer(p->buf, p->scan);
+			free(p->buf);
+		} else {
+			ret = jtag_vpi_receive_scan(p->in, p->nb_bits);
+		}
+		if (retval == ERROR_OK)
+			retval = ret;
+	}
+	pending_count = 0;
+
+	return retval;
+}
+
+/* Add work for the end of the pipeline, flushing it when full or not pipelined */
+static int jtag_vpi_add_pending(uint8_t *in, int nb_bits, uint8_t *buf,
+		struct scan_command *scan)
+{
+	pending[pending_count++] = (struct jtag_vpi_pending) {
+		.in = in,
+		.nb_bits = nb_bits,
+		.buf = buf,
+		.scan = scan,
+	};
+
+	if (!pipeline || pending_count == pending_max)
+		return jtag_vpi_flush();
 
 	return ERROR_OK;
 }
@@ -202,12 +348,7 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
  */
 static int jtag_vpi_reset(int trst, int srst)
 {
-	struct vpi_cmd vpi;
-	memset(&vpi, 0, sizeof(struct vpi_cmd));
-
-	vpi.cmd = CMD_RESET;
-	vpi.length = 0;
-	return jtag_vpi_send_cmd(&vpi);
+	return jtag_vpi_send_cmd(CMD_RESET, NULL, 0, 0, 0);
 }
 
 /**
@@ -223,18 +364,7 @@ static int jtag_vpi_reset(int trst, int srst)
  */
 static int jtag_vpi_tms_seq(const uint8_t *bits, int nb_bits)
 {
-	struct vpi_cmd vpi;
-	int nb_bytes;
-
-	memset(&vpi, 0, sizeof(struct vpi_cmd));
-	nb_bytes = DIV_ROUND_UP(nb_bits, 8);
-
-	vpi.cmd = CMD_TMS_SEQ;
-	memcpy(vpi.buffer_out, bits, nb_bytes);
-	vpi.length = nb_bytes;
-	vpi.nb_bits = nb_bits;
-
-	return jtag_vpi_send_cmd(&vpi);
+	return jtag_vpi_send_cmd(CMD_TMS_SEQ, bits, 0, DIV_ROUND_UP(nb_bits, 8), nb_bits);
 }
 
 /**
@@ -289,69 +419,45 @@ static int jtag_vpi_state_move(tap_state_t state)
 	return ERROR_OK;
 }
 
-static int jtag_vpi_queue_tdi_xfer(uint8_t *bits, int nb_bits, int tap_shift)
+static int jtag_vpi_queue_tdi_xfer(const uint8_t *out, uint8_t *in, uint8_t fill,
+		int nb_bits, int tap_shift)
 {
-	struct vpi_cmd vpi;
-	int nb_bytes = DIV_ROUND_UP(nb_bits, 8);
-
-	memset(&vpi, 0, sizeof(struct vpi_cmd));
-
-	vpi.cmd = tap_shift ? CMD_SCAN_CHAIN_FLIP_TMS : CMD_SCAN_CHAIN;
-
-	if (bits)
-		memcpy(vpi.buffer_out, bits, nb_bytes);
-	else
-		memset(vpi.buffer_out, 0xff, nb_bytes);
-
-	vpi.length = nb_bytes;
-	vpi.nb_bits = nb_bits;
-
-	int retval = jtag_vpi_send_cmd(&vpi);
+	int retval = jtag_vpi_send_cmd(tap_shift ? CMD_SCAN_CHAIN_FLIP_TMS : CMD_SCAN_CHAIN,
+			out, fill, DIV_ROUND_UP(nb_bits, 8), nb_bits);
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = jtag_vpi_receive_cmd(&vpi);
-	if (retval != ERROR_OK)
-		return retval;
-
-	/* Optional low-level JTAG debug */
-	if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
-		char *char_buf = buf_to_hex_str(vpi.buffer_in,
-				(nb_bits > DEBUG_JTAG_IOZ) ? DEBUG_JTAG_IOZ : nb_bits);
-		LOG_DEBUG_IO("recvd JTAG VPI data: nb_bits=%d, buf_in=0x%s%s",
-			nb_bits, char_buf, (nb_bits > DEBUG_JTAG_IOZ) ? "(...)" : "");
-		free(char_buf);
-	}
-
-	if (bits)
-		memcpy(bits, vpi.buffer_in, nb_bytes);
-
-	return ERROR_OK;
+	return jtag_vpi_add_pending(in, nb_bits, NULL, NULL);
 }
 
 /**
  * jtag_vpi_queue_tdi - short description
- * @param bits bits to be queued on TDI (or NULL if 0 are to be queued)
+ * @param out bits to be queued on TDI (or NULL if @a fill is to be queued)
+ * @param in where to store the bits read from TDO (or NULL to discard them)
+ * @param fill byte value queued when @a out is NULL
  * @param nb_bits number of bits
  * @param tap_shift
  */
-static int jtag_vpi_queue_tdi(uint8_t *bits, int nb_bits, int tap_shift)
+static int jtag_vpi_queue_tdi(const uint8_t *out, uint8_t *in, uint8_t fill,
+		int nb_bits, int tap_shift)
 {
-	int nb_xfer = DIV_ROUND_UP(nb_bits, XFERT_MAX_SIZE * 8);
+	int nb_xfer = DIV_ROUND_UP(nb_bits, xfer_size * 8);
 	int retval;
 
 	while (nb_xfer) {
 		if (nb_xfer ==  1) {
-			retval = jtag_vpi_queue_tdi_xfer(bits, nb_bits, tap_shift);
+			retval = jtag_vpi_queue_tdi_xfer(out, in, fill, nb_bits, tap_shift);
 			if (retval != ERROR_OK)
 				return retval;
 		} else {
-			retval = jtag_vpi_queue_tdi_xfer(bits, XFERT_MAX_SIZE * 8, NO_TAP_SHIFT);
+			retval = jtag_vpi_queue_tdi_xfer(out, in, fill, xfer_size * 8, NO_TAP_SHIFT);
 			if (retval != ERROR_OK)
 				return retval;
-			nb_bits -= XFERT_MAX_SIZE * 8;
-			if (bits)
-				bits += XFERT_MAX_SIZE;
+			nb_bits -= xfer_size * 8;
+			if (out)
+				out += xfer_size;
+			if (in)
+				in += xfer_size;
 		}
 
 		nb_xfer--;
@@ -384,12 +490,12 @@ static int jtag_vpi_clock_tms(int tms)
  */
 static int jtag_vpi_scan(struct scan_command *cmd)
 {
-	int scan_bits;
+	struct jtag_scan_iov iov[MAX(cmd->num_fields, 1)];
+	bool byte_aligned;
+	int iov_count;
 	uint8_t *buf = NULL;
 	int retval = ERROR_OK;
 
-	scan_bits = jtag_build_buffer(cmd, &buf);
-
 	if (cmd->ir_scan) {
 		retval = jtag_vpi_state_move(TAP_IRSHIFT);
 		if (retval != ERROR_OK)
@@ -400,16 +506,36 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			return retval;
 	}
 
-	if (cmd->end_state == TAP_DRSHIFT) {
-		retval = jtag_vpi_queue_tdi(buf, scan_bits, NO_TAP_SHIFT);
-		if (retval != ERROR_OK)
-			return retval;
-	} else {
-		retval = jtag_vpi_queue_tdi(buf, scan_bits, TAP_SHIFT);
+	iov_count = jtag_scan_iov(cmd, iov, &byte_aligned);
+	if (!byte_aligned) {
+		/* fields split bytes of the stream, shift a copy of them */
+		iov[0].num_bits = jtag_build_buffer(cmd, &buf);
+		iov[0].out = buf;
+		iov[0].in = buf;
+		iov_count = 1;
+	}
+
+	/* the last segment leaves the shift state, unless asked not to */
+	for (int i = 0; i < iov_count; i++) {
+		int tap_shift = NO_TAP_SHIFT;
+		if (i == iov_count - 1 && cmd->end_state != TAP_DRSHIFT)
+			tap_shift = TAP_SHIFT;
+		retval = jtag_vpi_queue_tdi(iov[i].out, iov[i].in, 0, iov[i].num_bits,
+				tap_shift);
 		if (retval != ERROR_OK)
-			return retval;
+			break;
 	}
 
+	/* the fields get their bits, and the copy is freed, once the responses
+	 * have come back */
+	if (buf) {
+		int ret = jtag_vpi_add_pending(NULL, 0, buf, cmd);
+		if (retval == ERROR_OK)
+			retval = ret;
+	}
+	if (retval != ERROR_OK)
+		return retval;
+
 	if (cmd->end_state != TAP_DRSHIFT) {
 		/*
 		 * As our JTAG is in an unstable state (IREXIT1 or DREXIT1), move it
@@ -425,12 +551,6 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			tap_set_state(TAP_DRPAUSE);
 	}
 
-	retval = jtag_read_buffer(buf, cmd);
-	if (retval != ERROR_OK)
-		return retval;
-
-	free(buf);
-
 	if (cmd->end_state != TAP_DRSHIFT) {
 		retval = jtag_vpi_state_move(cmd->end_state);
 		if (retval != ERROR_OK)
@@ -448,7 +568,7 @@ static int jtag_vpi_runtest(int cycles, tap_state_t state)
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = jtag_vpi_queue_tdi(NULL, cycles, NO_TAP_SHIFT);
+	retval = jtag_vpi_queue_tdi(NULL, NULL, 0xff, cycles, NO_TAP_SHIFT);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -508,6 +628,7 @@ static int jtag_vpi_execute_queue(void)
 			retval = jtag_vpi_tms(cmd->cmd.tms);
 			break;
 		case JTAG_SLEEP:
+			retval = jtag_vpi_flush();
 			jtag_sleep(cmd->cmd.sleep->us);
 			break;
 		case JTAG_SCAN:
@@ -521,9 +642,68 @@ static int jtag_vpi_execute_queue(void)
 		}
 	}
 
+	/* collect the responses of the queue, even after an error */
+	int flush_retval = jtag_vpi_flush();
+	if (retval == ERROR_OK)
+		retval = flush_retval;
+
 	return retval;
 }
 
+/* Size the packet buffers and the pipeline for the current transfer size */
+static int jtag_vpi_alloc_buffers(void)
+{
+	pending_max = MAX(PIPELINE_MAX_BYTES / PACKET_SIZE(xfer_size), 1);
+	send_buf_size = pending_max * PACKET_SIZE(xfer_size);
+
+	free(send_buf);
+	free(recv_packet);
+	free(pending);
+	send_buf = malloc(send_buf_size);
+	recv_packet = malloc(PACKET_SIZE(xfer_size));
+	pending = calloc(pending_max, sizeof(*pending));
+	send_buf_used = 0;
+	pending_count = 0;
+
+	if (!send_buf || !recv_packet || !pending) {
+		LOG_ERROR("jtag_vpi: out of memory");
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+/*
+ * Ask the server for a larger transfer size. The request and its answer use
+ * the default packet; the answer gives the size the server accepted, in
+ * length, and which both sides use from then on.
+ */
+static int jtag_vpi_set_xfer_size(void)
+{
+	int retval = jtag_vpi_send_cmd(CMD_SET_XFER_SIZE, NULL, 0, xfer_size_wanted, 0);
+	if (retval != ERROR_OK)
+		return retval;
+	retval = jtag_vpi_send_flush();
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = jtag_vpi_read(recv_packet, PACKET_SIZE(xfer_size));
+	if (retval != ERROR_OK)
+		return retval;
+
+	uint32_t cmd = le_to_h_u32(recv_packet);
+	uint32_t size = le_to_h_u32(recv_packet + PACKET_LENGTH(xfer_size));
+	if (cmd != CMD_SET_XFER_SIZE || size < XFERT_MAX_SIZE || size > xfer_size_wanted) {
+		LOG_ERROR("jtag_vpi: invalid answer to the transfer size request");
+		return ERROR_FAIL;
+	}
+
+	xfer_size = size;
+	LOG_INFO("jtag_vpi: transfer size set to %u bytes", xfer_size);
+
+	return jtag_vpi_alloc_buffers();
+}
+
 static int jtag_vpi_init(void)
 {
 	int flag = 1;
@@ -564,17 +744,23 @@ static int jtag_vpi_init(void)
 
 	LOG_INFO("jtag_vpi: Connection to %s : %u successful", server_address, server_port);
 
+	xfer_size = XFERT_MAX_SIZE;
+	if (jtag_vpi_alloc_buffers() != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (xfer_size_wanted != XFERT_MAX_SIZE)
+		return jtag_vpi_set_xfer_size();
+
 	return ERROR_OK;
 }
 
 static int jtag_vpi_stop_simulation(void)
 {
-	struct vpi_cmd cmd;
-	memset(&cmd, 0, sizeof(struct vpi_cmd));
-	cmd.length = 0;
-	cmd.nb_bits = 0;
-	cmd.cmd = CMD_STOP_SIMU;
-	return jtag_vpi_send_cmd(&cmd);
+	int retval = jtag_vpi_send_cmd(CMD_STOP_SIMU, NULL, 0, 0, 0);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return jtag_vpi_send_flush();
 }
 
 static int jtag_vpi_quit(void)
@@ -588,6 +774,12 @@ static int jtag_vpi_quit(void)
 		log_socket_error("jtag_vpi");
 	}
 	free(server_address);
+	free(send_buf);
+	send_buf = NULL;
+	free(recv_packet);
+	recv_packet = NULL;
+	free(pending);
+	pending = NULL;
 	return ERROR_OK;
 }
 
@@ -624,6 +816,32 @@ COMMAND_HANDLER(jtag_vpi_stop_sim_on_exit_handler)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(jtag_vpi_pipeline_handler)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ON_OFF(CMD_ARGV[0], pipeline);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(jtag_vpi_set_xfer_size_handler)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	unsigned int size;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+	if (size < XFERT_MAX_SIZE || size > XFERT_MAX_SIZE_LIMIT) {
+		command_print(CMD, "transfer size must be between %u and %u bytes",
+				XFERT_MAX_SIZE, XFERT_MAX_SIZE_LIMIT);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	xfer_size_wanted = size;
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_vpi_subcommand_handlers[] = {
 	{
 		.name = "set_port",
@@ -647,6 +865,22 @@ static const struct command_registration jtag_vpi_subcommand_handlers[] = {
 			"before OpenOCD exits (default: off)",
 		.usage = "<on|off>",
 	},
+	{
+		.name = "pipeline",
+		.handler = &jtag_vpi_pipeline_handler,
+		.mode = COMMAND_CONFIG,
+		.help = "Configure if the commands of a queue are sent without "
+			"waiting for each response (default: on)",
+		.usage = "<on|off>",
+	},
+	{
+		.name = "set_xfer_size",
+		.handler = &jtag_vpi_set_xfer_size_handler,
+		.mode = COMMAND_CONFIG,
+		.help = "negotiate a larger transfer size with the jtag_vpi server "
+			"(default: 512)",
+		.usage = "bytes",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -22,6 +22,15 @@
 static struct gpiod_chip *gpiod_chip[ADAPTER_GPIO_IDX_NUM] = {};
 static struct gpiod_line *gpiod_line[ADAPTER_GPIO_IDX_NUM] = {};
 
+/* TDI, TMS and TCK, when requested together, in this order */
+static struct gpiod_line_bulk jtag_bulk;
+static bool jtag_bulk_requested;
+
+static int last_tck;
+static int last_tms;
+static int last_tdi;
+static bool last_jtag_stored;
+
 static int last_swclk;
 static int last_swdio;
 static bool last_stored;
@@ -57,6 +66,15 @@ static bb_value_t linuxgpiod_read(void)
 	return retval ? BB_HIGH : BB_LOW;
 }
 
+/* Set TDI, TMS and TCK with a single call, when requested together */
+static void linuxgpiod_write_bulk(int tck, int tms, int tdi)
+{
+	int values[3] = { tdi, tms, tck };
+
+	if (gpiod_line_set_value_bulk(&jtag_bulk, values) < 0)
+		LOG_WARNING("writing tdi, tms and tck failed");
+}
+
 /*
  * Bitbang interface write of TCK, TMS, TDI
  *
@@ -65,19 +83,29 @@ static bb_value_t linuxgpiod_read(void)
  */
 static int linuxgpiod_write(int tck, int tms, int tdi)
 {
-	static int last_tck;
-	static int last_tms;
-	static int last_tdi;
-
-	static int first_time;
-
 	int retval;
 
-	if (!first_time) {
+	if (!last_jtag_stored) {
 		last_tck = !tck;
 		last_tms = !tms;
 		last_tdi = !tdi;
-		first_time = 1;
+		last_jtag_stored = true;
+	}
+
+	if (jtag_bulk_requested) {
+		if (tck == last_tck && tms == last_tms && tdi == last_tdi)
+			return ERROR_OK;
+
+		/* the lines change together, so keep a rising clock last */
+		if (tck && !last_tck && (tms != last_tms || tdi != last_tdi))
+			linuxgpiod_write_bulk(0, tms, tdi);
+		linuxgpiod_write_bulk(tck, tms, tdi);
+
+		last_tdi = tdi;
+		last_tms = tms;
+		last_tck = tck;
+
+		return ERROR_OK;
 	}
 
 	if (tdi != last_tdi) {
@@ -106,6 +134,26 @@ static int linuxgpiod_write(int tck, int tms, int tdi)
 	return ERROR_OK;
 }
 
+/* Bitbang interface write of a whole vector of TCK, TMS, TDI states */
+static int linuxgpiod_write_edges(const uint8_t *edges, size_t count, uint8_t *tdo)
+{
+	unsigned int sampled = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		linuxgpiod_write(!!(edges[i] & BB_EDGE_TCK), !!(edges[i] & BB_EDGE_TMS),
+				!!(edges[i] & BB_EDGE_TDI));
+
+		if (edges[i] & BB_EDGE_SAMPLE) {
+			bb_value_t value = linuxgpiod_read();
+			if (value == BB_ERROR)
+				return ERROR_FAIL;
+			bitbang_edges_store_tdo(tdo, sampled++, value);
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static int linuxgpiod_swdio_read(void)
 {
 	int retval;
@@ -196,6 +244,7 @@ static int linuxgpiod_blink(int on)
 static struct bitbang_interface linuxgpiod_bitbang = {
 	.read = linuxgpiod_read,
 	.write = linuxgpiod_write,
+	.write_edges = linuxgpiod_write_edges,
 	.swdio_read = linuxgpiod_swdio_read,
 	.swdio_drive = linuxgpiod_swdio_drive,
 	.swd_write = linuxgpiod_swd_write,
@@ -254,46 +303,36 @@ static bool linuxgpiod_swd_mode_possible(void)
 	return true;
 }
 
-static inline void helper_release(enum adapter_gpio_config_index idx)
-{
-	if (gpiod_line[idx]) {
-		gpiod_line_release(gpiod_line[idx]);
-		gpiod_line[idx] = NULL;
-	}
-	if (gpiod_chip[idx]) {
-		gpiod_chip_close(gpiod_chip[idx]);
-		gpiod_chip[idx] = NULL;
-	}
-}
-
 static int linuxgpiod_quit(void)
 {
 	LOG_DEBUG("linuxgpiod_quit");
-	for (int i = 0; i < ADAPTER_GPIO_IDX_NUM; ++i)
-		helper_release(i);
+
+	/* release all the lines first, as a chip may hold the lines of several signals */
+	for (int i = 0; i < ADAPTER_GPIO_IDX_NUM; ++i) {
+		if (gpiod_line[i]) {
+			gpiod_line_release(gpiod_line[i]);
+			gpiod_line[i] = NULL;
+		}
+	}
+	for (int i = 0; i < ADAPTER_GPIO_IDX_NUM; ++i) {
+		if (gpiod_chip[i]) {
+			gpiod_chip_close(gpiod_chip[i]);
+			gpiod_chip[i] = NULL;
+		}
+	}
+	jtag_bulk_requested = false;
+	last_jtag_stored = false;
 
 	return ERROR_OK;
 }
 
-static int helper_get_line(enum adapter_gpio_config_index idx)
+/* Fill the request config and the initial value of a line from its adapter gpio config */
+static void helper_line_config(enum adapter_gpio_config_index idx,
+		struct gpiod_line_request_config *config, int *val)
 {
-	if (!is_gpio_config_valid(idx))
-		return ERROR_OK;
+	int dir = GPIOD_LINE_REQUEST_DIRECTION_INPUT, flags = 0;
 
-	int dir = GPIOD_LINE_REQUEST_DIRECTION_INPUT, flags = 0, val = 0, retval;
-
-	gpiod_chip[idx] = gpiod_chip_open_by_number(adapter_gpio_config[idx].chip_num);
-	if (!gpiod_chip[idx]) {
-		LOG_ERROR("Cannot open LinuxGPIOD chip %d for %s", adapter_gpio_config[idx].chip_num,
-			adapter_gpio_get_name(idx));
-		return ERROR_JTAG_INIT_FAILED;
-	}
-
-	gpiod_line[idx] = gpiod_chip_get_line(gpiod_chip[idx], adapter_gpio_config[idx].gpio_num);
-	if (!gpiod_line[idx]) {
-		LOG_ERROR("Error get line %s", adapter_gpio_get_name(idx));
-		return ERROR_JTAG_INIT_FAILED;
-	}
+	*val = 0;
 
 	switch (adapter_gpio_config[idx].init_state) {
 	case ADAPTER_GPIO_INIT_STATE_INPUT:
@@ -301,11 +340,11 @@ static int helper_get_line(enum adapter_gpio_config_index idx)
 		break;
 	case ADAPTER_GPIO_INIT_STATE_INACTIVE:
 		dir = GPIOD_LINE_REQUEST_DIRECTION_OUTPUT;
-		val = 0;
+		*val = 0;
 		break;
 	case ADAPTER_GPIO_INIT_STATE_ACTIVE:
 		dir = GPIOD_LINE_REQUEST_DIRECTION_OUTPUT;
-		val = 1;
+		*val = 1;
 		break;
 	}
 
@@ -347,13 +386,32 @@ static int helper_get_line(enum adapter_gpio_config_index idx)
 	if (adapter_gpio_config[idx].active_low)
 		flags |= GPIOD_LINE_REQUEST_FLAG_ACTIVE_LOW;
 
-	struct gpiod_line_request_config config = {
+	*config = (struct gpiod_line_request_config) {
 		.consumer = "OpenOCD",
 		.request_type = dir,
 		.flags = flags,
 	};
+}
+
+static int helper_request_line(enum adapter_gpio_config_index idx,
+		const struct gpiod_line_request_config *config, int val)
+{
+	int retval;
+
+	gpiod_chip[idx] = gpiod_chip_open_by_number(adapter_gpio_config[idx].chip_num);
+	if (!gpiod_chip[idx]) {
+		LOG_ERROR("Cannot open LinuxGPIOD chip %d for %s", adapter_gpio_config[idx].chip_num,
+			adapter_gpio_get_name(idx));
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	gpiod_line[idx] = gpiod_chip_get_line(gpiod_chip[idx], adapter_gpio_config[idx].gpio_num);
+	if (!gpiod_line[idx]) {
+		LOG_ERROR("Error get line %s", adapter_gpio_get_name(idx));
+		return ERROR_JTAG_INIT_FAILED;
+	}
 
-	retval = gpiod_line_request(gpiod_line[idx], &config, val);
+	retval = gpiod_line_request(gpiod_line[idx], config, val);
 	if (retval < 0) {
 		LOG_ERROR("Error requesting gpio line %s", adapter_gpio_get_name(idx));
 		return ERROR_JTAG_INIT_FAILED;
@@ -362,6 +420,77 @@ static int helper_get_line(enum adapter_gpio_config_index idx)
 	return ERROR_OK;
 }
 
+static int helper_get_line(enum adapter_gpio_config_index idx)
+{
+	if (!is_gpio_config_valid(idx))
+		return ERROR_OK;
+
+	struct gpiod_line_request_config config;
+	int val;
+
+	helper_line_config(idx, &config, &val);
+
+	return helper_request_line(idx, &config, val);
+}
+
+/*
+ * Request TDI, TMS and TCK as one bulk when they are on the same chip with
+ * the same settings, so that each TCK edge costs a single call. Otherwise
+ * request them one by one.
+ */
+static int helper_get_jtag_lines(void)
+{
+	static const enum adapter_gpio_config_index idx[3] = {
+		ADAPTER_GPIO_IDX_TDI, ADAPTER_GPIO_IDX_TMS, ADAPTER_GPIO_IDX_TCK
+	};
+	struct gpiod_line_request_config config[3];
+	int val[3];
+
+	for (unsigned int i = 0; i < 3; i++)
+		helper_line_config(idx[i], &config[i], &val[i]);
+
+	for (unsigned int i = 1; i < 3; i++) {
+		if (adapter_gpio_config[idx[i]].chip_num != adapter_gpio_config[idx[0]].chip_num ||
+				config[i].request_type != config[0].request_type ||
+				config[i].flags != config[0].flags ||
+				config[i].request_type != GPIOD_LINE_REQUEST_DIRECTION_OUTPUT) {
+			for (unsigned int j = 0; j < 3; j++)
+				if (helper_request_line(idx[j], &config[j], val[j]) != ERROR_OK)
+					return ERROR_JTAG_INIT_FAILED;
+			return ERROR_OK;
+		}
+	}
+
+	/* the chip is owned by TCK, the lines of TDI and TMS are taken from it */
+	int chip_num = adapter_gpio_config[ADAPTER_GPIO_IDX_TCK].chip_num;
+	struct gpiod_chip *chip = gpiod_chip_open_by_number(chip_num);
+	if (!chip) {
+		LOG_ERROR("Cannot open LinuxGPIOD chip %d for tck", chip_num);
+		return ERROR_JTAG_INIT_FAILED;
+	}
+	gpiod_chip[ADAPTER_GPIO_IDX_TCK] = chip;
+
+	gpiod_line_bulk_init(&jtag_bulk);
+	for (unsigned int i = 0; i < 3; i++) {
+		gpiod_line[idx[i]] = gpiod_chip_get_line(chip, adapter_gpio_config[idx[i]].gpio_num);
+		if (!gpiod_line[idx[i]]) {
+			LOG_ERROR("Error get line %s", adapter_gpio_get_name(idx[i]));
+			return ERROR_JTAG_INIT_FAILED;
+		}
+		gpiod_line_bulk_add(&jtag_bulk, gpiod_line[idx[i]]);
+	}
+
+	if (gpiod_line_request_bulk(&jtag_bulk, &config[0], val) < 0) {
+		LOG_ERROR("Error requesting gpio lines tdi, tms and tck");
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	jtag_bulk_requested = true;
+	LOG_DEBUG("tdi, tms and tck requested as one bulk");
+
+	return ERROR_OK;
+}
+
 static int linuxgpiod_init(void)
 {
 	LOG_INFO("Linux GPIOD JTAG/SWD bitbang driver");
@@ -381,9 +510,7 @@ static int linuxgpiod_init(void)
 		}
 
 		if (helper_get_line(ADAPTER_GPIO_IDX_TDO) != ERROR_OK ||
-			helper_get_line(ADAPTER_GPIO_IDX_TDI) != ERROR_OK ||
-			helper_get_line(ADAPTER_GPIO_IDX_TCK) != ERROR_OK ||
-			helper_get_line(ADAPTER_GPIO_IDX_TMS) != ERROR_OK ||
+			helper_get_jtag_lines() != ERROR_OK ||
 			helper_get_line(ADAPTER_GPIO_IDX_TRST) != ERROR_OK)
 				goto out_error;
 	}
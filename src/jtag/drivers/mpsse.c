@@ -52,6 +52,23 @@
 #define SIO_RESET_PURGE_RX 1
 #define SIO_RESET_PURGE_TX 2
 
+/* Largest number of command chunks in flight, see ring_size in mpsse_open() */
+#define MPSSE_RING_MAX 4
+
+/* A chunk of commands handed to the USB stack, waiting for its completion */
+struct mpsse_slot {
+	struct mpsse_ctx *ctx;
+	uint8_t *write_buffer;
+	unsigned write_count;
+	uint8_t *read_buffer;
+	unsigned read_count;
+	struct bit_copy_queue read_queue;
+	struct libusb_transfer *write_transfer;
+	bool write_done;
+	unsigned written;
+	unsigned received;
+};
+
 struct mpsse_ctx {
 	struct libusb_context *usb_ctx;
 	struct libusb_device_handle *usb_dev;
@@ -73,6 +90,21 @@ struct mpsse_ctx {
 	unsigned read_chunk_size;
 	struct bit_copy_queue read_queue;
 	int retval;
+	/* set by mpsse_flush_start() until mpsse_flush_finish() */
+	bool flush_pending;
+	/* chunks in flight, oldest at ring_tail */
+	struct mpsse_slot ring[MPSSE_RING_MAX];
+	unsigned ring_size;
+	unsigned ring_tail;
+	unsigned ring_count;
+	/* single read stream shared by the chunks, demultiplexed in read_cb() */
+	struct libusb_transfer *read_transfer;
+	bool read_active;
+	bool read_failed;
+	unsigned read_slot;
+	unsigned read_expected;
+	int64_t busy_since;
+	struct mpsse_stats stats;
 };
 
 /* Returns true if the string descriptor indexed by str_index in device matches string */
@@ -306,6 +338,10 @@ error:
 	return false;
 }
 
+static int ring_wait(struct mpsse_ctx *ctx, unsigned in_flight);
+static void ring_abort(struct mpsse_ctx *ctx);
+static int mpsse_submit(struct mpsse_ctx *ctx);
+
 struct mpsse_ctx *mpsse_open(const uint16_t vids[], const uint16_t pids[], const char *description,
 	const char *serial, const char *location, int channel)
 {
@@ -331,6 +367,22 @@ struct mpsse_ctx *mpsse_open(const uint16_t vids[], const uint16_t pids[], const
 	if (!ctx->read_chunk || !ctx->read_buffer || !ctx->write_buffer)
 		goto error;
 
+	/* Each chunk in flight owns a pair of buffers, swapped with the ones
+	 * being filled when the chunk is submitted */
+	for (unsigned i = 0; i < MPSSE_RING_MAX; i++) {
+		struct mpsse_slot *slot = &ctx->ring[i];
+
+		bit_copy_queue_init(&slot->read_queue);
+		slot->write_buffer = calloc(1, ctx->write_size);
+		slot->read_buffer = malloc(ctx->read_size);
+		slot->write_transfer = libusb_alloc_transfer(0);
+		if (!slot->write_buffer || !slot->read_buffer || !slot->write_transfer)
+			goto error;
+	}
+	ctx->read_transfer = libusb_alloc_transfer(0);
+	if (!ctx->read_transfer)
+		goto error;
+
 	ctx->interface = channel;
 	ctx->index = channel + 1;
 	ctx->usb_read_timeout = 5000;
@@ -373,6 +425,13 @@ struct mpsse_ctx *mpsse_open(const uint16_t vids[], const uint16_t pids[], const
 		goto error;
 	}
 
+	/* The chips only buffer a few KiB per channel (FT2232H 4 KiB, FT4232H
+	 * 2 KiB, FT232H 1 KiB, FT2232C 384 bytes), much less than a chunk. What
+	 * keeps the MPSSE busy is having the next chunks queued on the host before
+	 * the FIFO drains: a high speed chip drains a chunk in about a millisecond,
+	 * so it gets a deeper ring than the full speed FT2232C. */
+	ctx->ring_size = mpsse_is_high_speed(ctx) ? MPSSE_RING_MAX : 2;
+
 	mpsse_purge(ctx);
 
 	return ctx;
@@ -383,12 +442,21 @@ error:
 
 void mpsse_close(struct mpsse_ctx *ctx)
 {
+	mpsse_flush_finish(ctx);
+	ring_wait(ctx, 0);
+
 	if (ctx->usb_dev)
 		libusb_close(ctx->usb_dev);
 	if (ctx->usb_ctx)
 		libusb_exit(ctx->usb_ctx);
 	bit_copy_discard(&ctx->read_queue);
 
+	for (unsigned i = 0; i < MPSSE_RING_MAX; i++) {
+		free(ctx->ring[i].write_buffer);
+		free(ctx->ring[i].read_buffer);
+		libusb_free_transfer(ctx->ring[i].write_transfer);
+	}
+	libusb_free_transfer(ctx->read_transfer);
 	free(ctx->write_buffer);
 	free(ctx->read_buffer);
 	free(ctx->read_chunk);
@@ -404,6 +472,7 @@ void mpsse_purge(struct mpsse_ctx *ctx)
 {
 	int err;
 	LOG_DEBUG("-");
+	ring_abort(ctx);
 	ctx->write_count = 0;
 	ctx->read_count = 0;
 	ctx->retval = ERROR_OK;
@@ -437,6 +506,7 @@ static unsigned buffer_read_space(struct mpsse_ctx *ctx)
 static void buffer_write_byte(struct mpsse_ctx *ctx, uint8_t data)
 {
 	LOG_DEBUG_IO("%02x", data);
+	assert(!ctx->flush_pending);
 	assert(ctx->write_count < ctx->write_size);
 	ctx->write_buffer[ctx->write_count++] = data;
 }
@@ -445,6 +515,7 @@ static unsigned buffer_write(struct mpsse_ctx *ctx, const uint8_t *out, unsigned
 	unsigned bit_count)
 {
 	LOG_DEBUG_IO("%d bits", bit_count);
+	assert(!ctx->flush_pending);
 	assert(ctx->write_count + DIV_ROUND_UP(bit_count, 8) <= ctx->write_size);
 	bit_copy(ctx->write_buffer + ctx->write_count, 0, out, out_offset, bit_count);
 	ctx->write_count += DIV_ROUND_UP(bit_count, 8);
@@ -455,6 +526,7 @@ static unsigned buffer_add_read(struct mpsse_ctx *ctx, uint8_t *in, unsigned in_
 	unsigned bit_count, unsigned offset)
 {
 	LOG_DEBUG_IO("%d bits, offset %d", bit_count, offset);
+	assert(!ctx->flush_pending);
 	assert(ctx->read_count + DIV_ROUND_UP(bit_count, 8) <= ctx->read_size);
 	bit_copy_queued(&ctx->read_queue, in, in_offset, ctx->read_buffer + ctx->read_count, offset,
 		bit_count);
@@ -495,7 +567,7 @@ void mpsse_clock_data(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_of
 		/* Guarantee buffer space enough for a minimum size transfer */
 		if (buffer_write_space(ctx) + (length < 8) < (out || (!out && !in) ? 4 : 3)
 				|| (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
+			ctx->retval = mpsse_submit(ctx);
 
 		if (length < 8) {
 			/* Transfer remaining bits in bit mode */
@@ -569,7 +641,7 @@ void mpsse_clock_tms_cs(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_
 	while (length > 0) {
 		/* Guarantee buffer space enough for a minimum size transfer */
 		if (buffer_write_space(ctx) < 3 || (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
+			ctx->retval = mpsse_submit(ctx);
 
 		/* Byte transfer */
 		unsigned this_bits = length;
@@ -602,6 +674,30 @@ void mpsse_clock_tms_cs(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_
 	}
 }
 
+void mpsse_queue_raw(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_len, uint8_t *in,
+	unsigned in_len)
+{
+	LOG_DEBUG_IO("%d bytes, read %d", out_len, in_len);
+
+	if (ctx->retval != ERROR_OK) {
+		LOG_DEBUG_IO("Ignoring command due to previous error");
+		return;
+	}
+
+	assert(out_len < ctx->write_size && in_len <= ctx->read_size);
+	if (buffer_write_space(ctx) < out_len || buffer_read_space(ctx) < in_len) {
+		ctx->retval = mpsse_submit(ctx);
+		if (ctx->retval != ERROR_OK)
+			return;
+	}
+
+	assert(!ctx->flush_pending);
+	memcpy(ctx->write_buffer + ctx->write_count, out, out_len);
+	ctx->write_count += out_len;
+	if (in_len)
+		buffer_add_read(ctx, in, 0, in_len * 8, 0);
+}
+
 void mpsse_set_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t dir)
 {
 	LOG_DEBUG_IO("-");
@@ -612,7 +708,7 @@ void mpsse_set_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t d
 	}
 
 	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_submit(ctx);
 
 	buffer_write_byte(ctx, 0x80);
 	buffer_write_byte(ctx, data);
@@ -629,7 +725,7 @@ void mpsse_set_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t
 	}
 
 	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_submit(ctx);
 
 	buffer_write_byte(ctx, 0x82);
 	buffer_write_byte(ctx, data);
@@ -646,7 +742,7 @@ void mpsse_read_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t *data)
 	}
 
 	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_submit(ctx);
 
 	buffer_write_byte(ctx, 0x81);
 	buffer_add_read(ctx, data, 0, 8, 0);
@@ -662,7 +758,7 @@ void mpsse_read_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t *data)
 	}
 
 	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_submit(ctx);
 
 	buffer_write_byte(ctx, 0x83);
 	buffer_add_read(ctx, data, 0, 8, 0);
@@ -677,7 +773,7 @@ static void single_byte_boolean_helper(struct mpsse_ctx *ctx, bool var, uint8_t
 	}
 
 	if (buffer_write_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_submit(ctx);
 
 	buffer_write_byte(ctx, var ? val_if_true : val_if_false);
 }
@@ -698,7 +794,7 @@ void mpsse_set_divisor(struct mpsse_ctx *ctx, uint16_t divisor)
 	}
 
 	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_submit(ctx);
 
 	buffer_write_byte(ctx, 0x86);
 	buffer_write_byte(ctx, divisor & 0xff);
@@ -758,141 +854,191 @@ int mpsse_set_frequency(struct mpsse_ctx *ctx, int frequency)
 	return frequency;
 }
 
-/* Context needed by the callbacks */
-struct transfer_result {
-	struct mpsse_ctx *ctx;
-	bool done;
-	unsigned transferred;
-};
+static struct mpsse_slot *ring_slot(struct mpsse_ctx *ctx, unsigned n)
+{
+	return &ctx->ring[(ctx->ring_tail + n) % ctx->ring_size];
+}
+
+static bool slot_done(const struct mpsse_slot *slot)
+{
+	/* no read data will come for commands that did not make it */
+	return slot->write_done && (slot->received == slot->read_count
+		|| slot->written < slot->write_count);
+}
+
+/* Hand the payload of the read stream to the chunks in flight, in order */
+static void read_deliver(struct mpsse_ctx *ctx, const uint8_t *data, unsigned size)
+{
+	while (size && ctx->read_expected) {
+		struct mpsse_slot *slot = &ctx->ring[ctx->read_slot];
+		unsigned this_size = slot->read_count - slot->received;
+		if (this_size > size)
+			this_size = size;
+		memcpy(slot->read_buffer + slot->received, data, this_size);
+		slot->received += this_size;
+		ctx->read_expected -= this_size;
+		data += this_size;
+		size -= this_size;
+		if (slot->received == slot->read_count)
+			ctx->read_slot = (ctx->read_slot + 1) % ctx->ring_size;
+	}
+
+	if (size)
+		LOG_DEBUG_IO("dropped %u unexpected bytes", size);
+}
 
 static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 {
-	struct transfer_result *res = transfer->user_data;
-	struct mpsse_ctx *ctx = res->ctx;
+	struct mpsse_ctx *ctx = transfer->user_data;
 
 	unsigned packet_size = ctx->max_packet_size;
 
 	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
 
 	/* Strip the two status bytes sent at the beginning of each USB packet
-	 * while copying the chunk buffer to the read buffer */
+	 * while handing the chunk buffer over to the read buffers */
 	unsigned num_packets = DIV_ROUND_UP(transfer->actual_length, packet_size);
 	unsigned chunk_remains = transfer->actual_length;
 	for (unsigned i = 0; i < num_packets && chunk_remains > 2; i++) {
 		unsigned this_size = packet_size - 2;
 		if (this_size > chunk_remains - 2)
 			this_size = chunk_remains - 2;
-		if (this_size > ctx->read_count - res->transferred)
-			this_size = ctx->read_count - res->transferred;
-		memcpy(ctx->read_buffer + res->transferred,
-			ctx->read_chunk + packet_size * i + 2,
-			this_size);
-		res->transferred += this_size;
+		read_deliver(ctx, ctx->read_chunk + packet_size * i + 2, this_size);
 		chunk_remains -= this_size + 2;
-		if (res->transferred == ctx->read_count) {
-			res->done = true;
-			break;
-		}
 	}
 
-	LOG_DEBUG_IO("raw chunk %d, transferred %d of %d", transfer->actual_length, res->transferred,
-		ctx->read_count);
+	LOG_DEBUG_IO("raw chunk %d, %u bytes still expected", transfer->actual_length,
+		ctx->read_expected);
+
+	ctx->read_active = false;
+	if (!ctx->read_expected)
+		return;
 
-	if (!res->done)
-		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
-			res->done = true;
+	if (transfer->status == LIBUSB_TRANSFER_COMPLETED || transfer->status == LIBUSB_TRANSFER_TIMED_OUT)
+		ctx->read_active = libusb_submit_transfer(transfer) == LIBUSB_SUCCESS;
+	ctx->read_failed = !ctx->read_active;
 }
 
 static LIBUSB_CALL void write_cb(struct libusb_transfer *transfer)
 {
-	struct transfer_result *res = transfer->user_data;
-	struct mpsse_ctx *ctx = res->ctx;
+	struct mpsse_slot *slot = transfer->user_data;
+	struct mpsse_ctx *ctx = slot->ctx;
 
-	res->transferred += transfer->actual_length;
+	slot->written += transfer->actual_length;
 
-	LOG_DEBUG_IO("transferred %d of %d", res->transferred, ctx->write_count);
+	LOG_DEBUG_IO("transferred %d of %d", slot->written, slot->write_count);
 
 	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
 
-	if (res->transferred == ctx->write_count)
-		res->done = true;
-	else {
-		transfer->length = ctx->write_count - res->transferred;
-		transfer->buffer = ctx->write_buffer + res->transferred;
-		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
-			res->done = true;
+	/* A short write can only be resumed while no later chunk is queued
+	 * behind it, else it is reported when the chunk is retired */
+	if (slot->written < slot->write_count && transfer->status == LIBUSB_TRANSFER_COMPLETED
+			&& slot == ring_slot(ctx, ctx->ring_count - 1)) {
+		transfer->length = slot->write_count - slot->written;
+		transfer->buffer = slot->write_buffer + slot->written;
+		if (libusb_submit_transfer(transfer) == LIBUSB_SUCCESS)
+			return;
 	}
+	slot->write_done = true;
 }
 
-int mpsse_flush(struct mpsse_ctx *ctx)
+/* Complete the oldest chunk, which must be done */
+static int ring_retire(struct mpsse_ctx *ctx)
 {
-	int retval = ctx->retval;
+	struct mpsse_slot *slot = ring_slot(ctx, 0);
+	int retval = ERROR_OK;
 
-	if (retval != ERROR_OK) {
-		LOG_DEBUG_IO("Ignoring flush due to previous error");
-		assert(ctx->write_count == 0 && ctx->read_count == 0);
-		ctx->retval = ERROR_OK;
-		return retval;
+	if (slot->written < slot->write_count) {
+		LOG_ERROR("ftdi device did not accept all data: %d, tried %d",
+			slot->written,
+			slot->write_count);
+		retval = ERROR_FAIL;
+	} else if (slot->received < slot->read_count) {
+		LOG_ERROR("ftdi device did not return all data: %d, expected %d",
+			slot->received,
+			slot->read_count);
+		retval = ERROR_FAIL;
+	} else {
+		bit_copy_execute(&slot->read_queue);
 	}
 
-	LOG_DEBUG_IO("write %d%s, read %d", ctx->write_count, ctx->read_count ? "+1" : "",
-			ctx->read_count);
-	assert(ctx->write_count > 0 || ctx->read_count == 0); /* No read data without write data */
+	bit_copy_discard(&slot->read_queue);
+	ctx->stats.bytes_written += slot->written;
+	ctx->stats.bytes_read += slot->received;
+	ctx->stats.chunks++;
 
-	if (ctx->write_count == 0)
-		return retval;
+	ctx->ring_tail = (ctx->ring_tail + 1) % ctx->ring_size;
+	ctx->ring_count--;
+	if (!ctx->ring_count)
+		ctx->stats.busy_ms += timeval_ms() - ctx->busy_since;
 
-	struct libusb_transfer *read_transfer = NULL;
-	struct transfer_result read_result = { .ctx = ctx, .done = true };
-	if (ctx->read_count) {
-		buffer_write_byte(ctx, 0x87); /* SEND_IMMEDIATE */
-		read_result.done = false;
-		/* delay read transaction to ensure the FTDI chip can support us with data
-		   immediately after processing the MPSSE commands in the write transaction */
-	}
+	return retval;
+}
 
-	struct transfer_result write_result = { .ctx = ctx, .done = false };
-	struct libusb_transfer *write_transfer = libusb_alloc_transfer(0);
-	libusb_fill_bulk_transfer(write_transfer, ctx->usb_dev, ctx->out_ep, ctx->write_buffer,
-		ctx->write_count, write_cb, &write_result, ctx->usb_write_timeout);
-	retval = libusb_submit_transfer(write_transfer);
-	if (retval != LIBUSB_SUCCESS)
-		goto error_check;
+/* Cancel the chunks in flight and drop their read data */
+static void ring_abort(struct mpsse_ctx *ctx)
+{
+	if (!ctx->ring_count)
+		return;
 
-	if (ctx->read_count) {
-		read_transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(read_transfer, ctx->usb_dev, ctx->in_ep, ctx->read_chunk,
-			ctx->read_chunk_size, read_cb, &read_result,
-			ctx->usb_read_timeout);
-		retval = libusb_submit_transfer(read_transfer);
-		if (retval != LIBUSB_SUCCESS)
-			goto error_check;
+	LOG_DEBUG("cancel %u chunks", ctx->ring_count);
+	ctx->read_expected = 0;
+	if (ctx->read_active)
+		libusb_cancel_transfer(ctx->read_transfer);
+	for (unsigned i = 0; i < ctx->ring_count; i++)
+		if (!ring_slot(ctx, i)->write_done)
+			libusb_cancel_transfer(ring_slot(ctx, i)->write_transfer);
+
+	for (unsigned i = 0; i < ctx->ring_count; i++) {
+		while (!ring_slot(ctx, i)->write_done || ctx->read_active) {
+			struct timeval timeout_usb = { .tv_sec = 1 };
+			if (libusb_handle_events_timeout_completed(ctx->usb_ctx, &timeout_usb, NULL) != LIBUSB_SUCCESS)
+				break;
+		}
 	}
 
+	for (unsigned i = 0; i < ctx->ring_count; i++)
+		bit_copy_discard(&ring_slot(ctx, i)->read_queue);
+	ctx->ring_tail = 0;
+	ctx->ring_count = 0;
+	ctx->read_active = false;
+	ctx->read_failed = false;
+	ctx->stats.busy_ms += timeval_ms() - ctx->busy_since;
+}
+
+/* Wait until at most in_flight chunks are left in flight. On failure, nothing
+ * is left in flight and the device is purged. */
+static int ring_wait(struct mpsse_ctx *ctx, unsigned in_flight)
+{
+	int retval = ERROR_OK;
+
 	/* Polling loop, more or less taken from libftdi */
 	int64_t start = timeval_ms();
 	int64_t warn_after = 2000;
-	while (!write_result.done || !read_result.done) {
+	while (ctx->ring_count > in_flight) {
+		if (slot_done(ring_slot(ctx, 0))) {
+			retval = ring_retire(ctx);
+			if (retval != ERROR_OK)
+				break;
+			continue;
+		}
+		if (ctx->read_failed) {
+			LOG_ERROR("ftdi device read failed, %u bytes still expected", ctx->read_expected);
+			retval = ERROR_FAIL;
+			break;
+		}
+
 		struct timeval timeout_usb;
 
 		timeout_usb.tv_sec = 1;
 		timeout_usb.tv_usec = 0;
 
-		retval = libusb_handle_events_timeout_completed(ctx->usb_ctx, &timeout_usb, NULL);
+		int err = libusb_handle_events_timeout_completed(ctx->usb_ctx, &timeout_usb, NULL);
 		keep_alive();
-		if (retval == LIBUSB_ERROR_NO_DEVICE || retval == LIBUSB_ERROR_INTERRUPTED)
+		if (err != LIBUSB_SUCCESS) {
+			LOG_ERROR("libusb_handle_events() failed with %s", libusb_error_name(err));
+			retval = ERROR_FAIL;
 			break;
-
-		if (retval != LIBUSB_SUCCESS) {
-			libusb_cancel_transfer(write_transfer);
-			if (read_transfer)
-				libusb_cancel_transfer(read_transfer);
-			while (!write_result.done || !read_result.done) {
-				retval = libusb_handle_events_timeout_completed(ctx->usb_ctx,
-								&timeout_usb, NULL);
-				if (retval != LIBUSB_SUCCESS)
-					break;
-			}
 		}
 
 		int64_t now = timeval_ms();
@@ -903,37 +1049,131 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 		}
 	}
 
-error_check:
-	if (retval != LIBUSB_SUCCESS) {
-		LOG_ERROR("libusb_handle_events() failed with %s", libusb_error_name(retval));
-		retval = ERROR_FAIL;
-	} else if (write_result.transferred < ctx->write_count) {
-		LOG_ERROR("ftdi device did not accept all data: %d, tried %d",
-			write_result.transferred,
-			ctx->write_count);
-		retval = ERROR_FAIL;
-	} else if (read_result.transferred < ctx->read_count) {
-		LOG_ERROR("ftdi device did not return all data: %d, expected %d",
-			read_result.transferred,
+	if (retval != ERROR_OK)
+		mpsse_purge(ctx);
+
+	return retval;
+}
+
+/* Submit the queued commands as a new chunk, without waiting for their completion
+ * unless the ring is full */
+static int mpsse_submit(struct mpsse_ctx *ctx)
+{
+	LOG_DEBUG_IO("write %d%s, read %d", ctx->write_count, ctx->read_count ? "+1" : "",
 			ctx->read_count);
-		retval = ERROR_FAIL;
-	} else if (ctx->read_count) {
-		ctx->write_count = 0;
-		ctx->read_count = 0;
-		bit_copy_execute(&ctx->read_queue);
-		retval = ERROR_OK;
-	} else {
-		ctx->write_count = 0;
-		bit_copy_discard(&ctx->read_queue);
-		retval = ERROR_OK;
+	assert(ctx->write_count > 0 || ctx->read_count == 0); /* No read data without write data */
+
+	if (ctx->write_count == 0)
+		return ERROR_OK;
+
+	if (ctx->ring_count == ctx->ring_size) {
+		int retval = ring_wait(ctx, ctx->ring_size - 1);
+		if (retval != ERROR_OK)
+			return retval;
 	}
 
-	if (retval != ERROR_OK)
+	if (ctx->read_count)
+		buffer_write_byte(ctx, 0x87); /* SEND_IMMEDIATE */
+
+	struct mpsse_slot *slot = ring_slot(ctx, ctx->ring_count);
+	uint8_t *write_buffer = slot->write_buffer;
+	uint8_t *read_buffer = slot->read_buffer;
+	slot->ctx = ctx;
+	slot->write_buffer = ctx->write_buffer;
+	slot->write_count = ctx->write_count;
+	slot->read_buffer = ctx->read_buffer;
+	slot->read_count = ctx->read_count;
+	list_splice_init(&ctx->read_queue.list, &slot->read_queue.list);
+	slot->write_done = false;
+	slot->written = 0;
+	slot->received = 0;
+	ctx->write_buffer = write_buffer;
+	ctx->write_count = 0;
+	ctx->read_buffer = read_buffer;
+	ctx->read_count = 0;
+
+	if (!ctx->ring_count)
+		ctx->busy_since = timeval_ms();
+	ctx->ring_count++;
+
+	libusb_fill_bulk_transfer(slot->write_transfer, ctx->usb_dev, ctx->out_ep, slot->write_buffer,
+		slot->write_count, write_cb, slot, ctx->usb_write_timeout);
+	int retval = libusb_submit_transfer(slot->write_transfer);
+	if (retval != LIBUSB_SUCCESS) {
+		slot->write_done = true;
+	} else if (slot->read_count) {
+		/* delay read transaction to ensure the FTDI chip can support us with data
+		   immediately after processing the MPSSE commands in the write transaction */
+		if (!ctx->read_expected)
+			ctx->read_slot = slot - ctx->ring;
+		ctx->read_expected += slot->read_count;
+		if (!ctx->read_active) {
+			libusb_fill_bulk_transfer(ctx->read_transfer, ctx->usb_dev, ctx->in_ep, ctx->read_chunk,
+				ctx->read_chunk_size, read_cb, ctx, ctx->usb_read_timeout);
+			retval = libusb_submit_transfer(ctx->read_transfer);
+			ctx->read_active = retval == LIBUSB_SUCCESS;
+		}
+	}
+
+	/* nothing left in flight on failure */
+	if (retval != LIBUSB_SUCCESS) {
+		LOG_ERROR("libusb_submit_transfer() failed with %s", libusb_error_name(retval));
 		mpsse_purge(ctx);
+		return ERROR_FAIL;
+	}
 
-	libusb_free_transfer(write_transfer);
-	if (read_transfer)
-		libusb_free_transfer(read_transfer);
+	return ERROR_OK;
+}
 
-	return retval;
+int mpsse_flush_start(struct mpsse_ctx *ctx)
+{
+	int retval = mpsse_flush_finish(ctx);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = ctx->retval;
+
+	if (retval != ERROR_OK) {
+		LOG_DEBUG_IO("Ignoring flush due to previous error");
+		assert(ctx->write_count == 0 && ctx->read_count == 0);
+		ctx->retval = ERROR_OK;
+		return retval;
+	}
+
+	retval = mpsse_submit(ctx);
+	if (retval != ERROR_OK)
+		return retval;
+
+	ctx->flush_pending = true;
+
+	return ERROR_OK;
+}
+
+int mpsse_flush_finish(struct mpsse_ctx *ctx)
+{
+	if (!ctx->flush_pending)
+		return ERROR_OK;
+
+	ctx->flush_pending = false;
+
+	return ring_wait(ctx, 0);
+}
+
+int mpsse_flush(struct mpsse_ctx *ctx)
+{
+	int retval = mpsse_flush_start(ctx);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return mpsse_flush_finish(ctx);
+}
+
+void mpsse_get_stats(struct mpsse_ctx *ctx, struct mpsse_stats *stats)
+{
+	*stats = ctx->stats;
+}
+
+void mpsse_reset_stats(struct mpsse_ctx *ctx)
+{
+	ctx->stats = (struct mpsse_stats){ 0 };
 }
@@ -28,6 +28,15 @@ enum ftdi_chip_type {
 
 struct mpsse_ctx;
 
+/* Traffic since the device was opened or the statistics were reset */
+struct mpsse_stats {
+	uint64_t bytes_written;
+	uint64_t bytes_read;
+	uint64_t chunks;
+	/* time with at least one chunk in flight */
+	int64_t busy_ms;
+};
+
 /* Device handling */
 struct mpsse_ctx *mpsse_open(const uint16_t *vid, const uint16_t *pid, const char *description,
 	const char *serial, const char *location, int channel);
@@ -47,6 +56,10 @@ void mpsse_clock_tms_cs_out(struct mpsse_ctx *ctx, const uint8_t *out, unsigned
 			   unsigned length, bool tdi, uint8_t mode);
 void mpsse_clock_tms_cs(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_offset, uint8_t *in,
 		       unsigned in_offset, unsigned length, bool tdi, uint8_t mode);
+/* Queue commands already encoded by the caller, which must produce exactly in_len bytes of read
+ * data. Consecutive calls reading to consecutive bytes cost a single copy of the read data. */
+void mpsse_queue_raw(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_len, uint8_t *in,
+	unsigned in_len);
 void mpsse_set_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t dir);
 void mpsse_set_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t dir);
 void mpsse_read_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t *data);
@@ -60,8 +73,18 @@ int mpsse_rtck_config(struct mpsse_ctx *ctx, bool enable);
  * Frequency 0 means RTCK. */
 int mpsse_set_frequency(struct mpsse_ctx *ctx, int frequency);
 
-/* Queue handling */
+/* Queue handling. Commands are sent in chunks as the buffers fill up, with several chunks in
+ * flight; mpsse_flush() sends the last chunk and waits for the completion of all of them. */
 int mpsse_flush(struct mpsse_ctx *ctx);
+
+/* Split mpsse_flush(): submit the queued commands and return, then wait for their completion.
+ * Nothing can be queued in between. After a failed mpsse_flush_start(), nothing is in flight. */
+int mpsse_flush_start(struct mpsse_ctx *ctx);
+int mpsse_flush_finish(struct mpsse_ctx *ctx);
 void mpsse_purge(struct mpsse_ctx *ctx);
 
+/* Transfer statistics, for throughput measurements */
+void mpsse_get_stats(struct mpsse_ctx *ctx, struct mpsse_stats *stats);
+void mpsse_reset_stats(struct mpsse_ctx *ctx);
+
 #endif /* OPENOCD_JTAG_DRIVERS_MPSSE_H */
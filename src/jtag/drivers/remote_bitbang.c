@@ -25,6 +25,11 @@
 static char *remote_bitbang_host;
 static char *remote_bitbang_port;
 
+/* Binary extension: probe for it at init, and use it if the server has it */
+#define REMOTE_BITBANG_BINARY_VERSION 1
+static bool remote_bitbang_binary_probe;
+static bool remote_bitbang_binary;
+
 static int remote_bitbang_fd;
 static uint8_t remote_bitbang_send_buf[512];
 static unsigned int remote_bitbang_send_buf_used;
@@ -200,12 +205,118 @@ static bb_value_t remote_bitbang_read_sample(void)
 	return char_to_int(c);
 }
 
+/* Read len bytes, waiting for them */
+static int remote_bitbang_recv(uint8_t *buf, unsigned int len)
+{
+	for (unsigned int i = 0; i < len; i++) {
+		if (remote_bitbang_recv_buf_empty()) {
+			if (remote_bitbang_fill_buf(BLOCK) != ERROR_OK)
+				return ERROR_FAIL;
+			if (remote_bitbang_recv_buf_empty()) {
+				LOG_ERROR("remote_bitbang: connection closed by the remote end");
+				return ERROR_FAIL;
+			}
+		}
+		buf[i] = remote_bitbang_recv_buf[remote_bitbang_recv_buf_start];
+		remote_bitbang_recv_buf_start =
+			(remote_bitbang_recv_buf_start + 1) % sizeof(remote_bitbang_recv_buf);
+	}
+	return ERROR_OK;
+}
+
+static int remote_bitbang_queue_u32(uint32_t value)
+{
+	for (unsigned int i = 0; i < 4; i++)
+		if (remote_bitbang_queue((value >> (8 * i)) & 0xff, NO_FLUSH) != ERROR_OK)
+			return ERROR_FAIL;
+	return ERROR_OK;
+}
+
 static int remote_bitbang_write(int tck, int tms, int tdi)
 {
 	char c = '0' + ((tck ? 0x4 : 0x0) | (tms ? 0x2 : 0x0) | (tdi ? 0x1 : 0x0));
 	return remote_bitbang_queue(c, NO_FLUSH);
 }
 
+/*
+ * Bitbang interface write of a vector of edge states, with the binary
+ * extension. The bit shifts generated by bitbang.c, a TCK low state
+ * followed by the same state with TCK high, become one 'S' or 'I' command.
+ * Anything else is sent as ASCII write requests.
+ */
+static int remote_bitbang_write_edges(const uint8_t *edges, size_t count, uint8_t *tdo)
+{
+	const uint8_t lines = BB_EDGE_TCK | BB_EDGE_TMS | BB_EDGE_TDI;
+	bool pairs = count % 2 == 0;
+	bool same = true;
+	bool capture = false;
+
+	for (size_t i = 0; pairs && i < count; i += 2) {
+		if ((edges[i] & BB_EDGE_TCK) || (edges[i + 1] & BB_EDGE_SAMPLE) ||
+				(edges[i + 1] & lines) != ((edges[i] & lines) | BB_EDGE_TCK))
+			pairs = false;
+		if (edges[i] != edges[0])
+			same = false;
+		if (edges[i] & BB_EDGE_SAMPLE)
+			capture = true;
+	}
+
+	if (!pairs) {
+		unsigned int sampled = 0;
+
+		for (size_t i = 0; i < count; i++) {
+			if (remote_bitbang_write(!!(edges[i] & BB_EDGE_TCK), !!(edges[i] & BB_EDGE_TMS),
+					!!(edges[i] & BB_EDGE_TDI)) != ERROR_OK)
+				return ERROR_FAIL;
+			if (edges[i] & BB_EDGE_SAMPLE) {
+				uint8_t c;
+				if (remote_bitbang_queue('R', NO_FLUSH) != ERROR_OK ||
+						remote_bitbang_recv(&c, 1) != ERROR_OK)
+					return ERROR_FAIL;
+				bb_value_t value = char_to_int(c);
+				if (value == BB_ERROR)
+					return ERROR_FAIL;
+				bitbang_edges_store_tdo(tdo, sampled++, value);
+			}
+		}
+		return ERROR_OK;
+	}
+
+	uint32_t num_bits = count / 2;
+
+	/* idle clocks: 'I', tms/tdi as in the write requests, cycle count */
+	if (same && !capture) {
+		if (remote_bitbang_queue('I', NO_FLUSH) != ERROR_OK ||
+				remote_bitbang_queue(((edges[0] & BB_EDGE_TMS) ? 0x2 : 0x0) |
+					((edges[0] & BB_EDGE_TDI) ? 0x1 : 0x0), NO_FLUSH) != ERROR_OK)
+			return ERROR_FAIL;
+		return remote_bitbang_queue_u32(num_bits);
+	}
+
+	/* shift: 'S', capture flag, bit count, TMS bits, TDI bits */
+	if (remote_bitbang_queue('S', NO_FLUSH) != ERROR_OK ||
+			remote_bitbang_queue(capture ? 0x1 : 0x0, NO_FLUSH) != ERROR_OK ||
+			remote_bitbang_queue_u32(num_bits) != ERROR_OK)
+		return ERROR_FAIL;
+
+	static const uint8_t payload[] = { BB_EDGE_TMS, BB_EDGE_TDI };
+	for (unsigned int p = 0; p < ARRAY_SIZE(payload); p++) {
+		for (uint32_t i = 0; i < num_bits; i += 8) {
+			uint8_t byte = 0;
+			for (uint32_t j = i; j < num_bits && j < i + 8; j++)
+				if (edges[2 * j] & payload[p])
+					byte |= BIT(j - i);
+			if (remote_bitbang_queue(byte, NO_FLUSH) != ERROR_OK)
+				return ERROR_FAIL;
+		}
+	}
+
+	if (capture)
+		return remote_bitbang_recv(tdo, DIV_ROUND_UP(num_bits, 8));
+
+	return ERROR_OK;
+}
+
 static int remote_bitbang_reset(int trst, int srst)
 {
 	char c = 'r' + ((trst ? 0x2 : 0x0) | (srst ? 0x1 : 0x0));
@@ -305,6 +416,47 @@ static int remote_bitbang_init_unix(void)
 	return fd;
 }
 
+/*
+ * Ask the server for the binary extension. A server without it ignores the
+ * 'X' and only answers the read request that follows.
+ */
+static int remote_bitbang_init_binary(void)
+{
+	uint8_t c;
+
+	remote_bitbang_binary = false;
+	remote_bitbang_bitbang.write_edges = NULL;
+
+	if (!remote_bitbang_binary_probe)
+		return ERROR_OK;
+
+	if (remote_bitbang_queue('X', NO_FLUSH) != ERROR_OK ||
+			remote_bitbang_queue('R', FLUSH_SEND_BUF) != ERROR_OK ||
+			remote_bitbang_recv(&c, 1) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (c == 'X') {
+		uint8_t version;
+		if (remote_bitbang_recv(&version, 1) != ERROR_OK ||
+				remote_bitbang_recv(&c, 1) != ERROR_OK)
+			return ERROR_FAIL;
+		/* a server announces the highest version it supports */
+		remote_bitbang_binary = version >= REMOTE_BITBANG_BINARY_VERSION;
+	}
+
+	if (char_to_int(c) == BB_ERROR)
+		return ERROR_FAIL;
+
+	if (remote_bitbang_binary) {
+		remote_bitbang_bitbang.write_edges = &remote_bitbang_write_edges;
+		LOG_INFO("remote_bitbang: using the binary extension");
+	} else {
+		LOG_DEBUG("remote_bitbang: no binary extension, using ASCII requests");
+	}
+
+	return ERROR_OK;
+}
+
 static int remote_bitbang_init(void)
 {
 	bitbang_interface = &remote_bitbang_bitbang;
@@ -323,6 +475,9 @@ static int remote_bitbang_init(void)
 
 	socket_nonblock(remote_bitbang_fd);
 
+	if (remote_bitbang_init_binary() != ERROR_OK)
+		return ERROR_FAIL;
+
 	LOG_INFO("remote_bitbang driver initialized");
 	return ERROR_OK;
 }
@@ -349,6 +504,15 @@ COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_host_command)
 	return ERROR_COMMAND_SYNTAX_ERROR;
 }
 
+COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_binary_command)
+{
+	if (CMD_ARGC == 1) {
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], remote_bitbang_binary_probe);
+		return ERROR_OK;
+	}
+	return ERROR_COMMAND_SYNTAX_ERROR;
+}
+
 static const struct command_registration remote_bitbang_subcommand_handlers[] = {
 	{
 		.name = "port",
@@ -366,6 +530,13 @@ static const struct command_registration remote_bitbang_subcommand_handlers[] =
 			"  if port is 0 or unset, this is the name of the unix socket to use.",
 		.usage = "host_name",
 	},
+	{
+		.name = "binary",
+		.handler = remote_bitbang_handle_remote_bitbang_binary_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Probe for and use the binary protocol extension (default off).",
+		.usage = "(on|off)",
+	},
 	COMMAND_REGISTRATION_DONE,
 };
 
@@ -102,6 +102,15 @@
 #define STLINK_MAX_RW16_32      STLINK_DATA_SIZE
 #define STLINK_SWIM_DATA_SIZE   STLINK_DATA_SIZE
 
+/*
+ * Bulk 16 and 32bit memory transfers are split in chunks that the firmware
+ * processes one after the other. On USB, up to this many chunks, each one
+ * followed by its R/W status request, are kept in flight at once.
+ */
+#define STLINK_BURST_DEPTH      (8)
+/* Max commands sent at once, e.g. queued DAP register accesses */
+#define STLINK_BURST_MAX_XFERS  (64)
+
 /* "WAIT" responses will be retried (with exponential backoff) at
  * most this many times before failing to caller.
  */
@@ -171,6 +180,18 @@ struct stlink_tcp_priv_s {
 	struct stlink_tcp_version version;
 };
 
+/** One command of a burst, see stlink_backend_s::xfer_burst */
+struct stlink_burst_xfer {
+	/** command block of STLINK_CMD_SIZE_V2 bytes */
+	const uint8_t *cmd;
+	/** endpoint of the data phase, rx_ep or tx_ep */
+	uint8_t direction;
+	/** data phase buffer */
+	uint8_t *buf;
+	/** data phase size, 0 if none */
+	int size;
+};
+
 struct stlink_backend_s {
 	/** */
 	int (*open)(void *handle, struct hl_interface_param_s *param);
@@ -180,6 +201,9 @@ struct stlink_backend_s {
 	int (*xfer_noerrcheck)(void *handle, const uint8_t *buf, int size);
 	/** */
 	int (*read_trace)(void *handle, const uint8_t *buf, int size);
+	/** send several commands without waiting for each data phase to
+	 * complete, ignoring the status in the replies; NULL if not supported */
+	int (*xfer_burst)(void *handle, const struct stlink_burst_xfer *xfers, unsigned int n);
 };
 
 /* TODO: make queue size dynamic */
@@ -514,6 +538,7 @@ static inline int stlink_usb_xfer_noerrcheck(void *handle, const uint8_t *buf, i
 #define STLINK_F_FIX_CLOSE_AP           BIT(8)  /* v2>=j29 || v3     */
 #define STLINK_F_HAS_DPBANKSEL          BIT(9)  /* v2>=j32 || v3>=j2 */
 #define STLINK_F_HAS_RW8_512BYTES       BIT(10) /*            v3>=j6 */
+#define STLINK_F_HAS_MEM_PIPELINE       BIT(11) /* v2>=j24 || v3     */
 
 /* aliases */
 #define STLINK_F_HAS_TARGET_VOLT        STLINK_F_HAS_TRACE
@@ -522,6 +547,7 @@ static inline int stlink_usb_xfer_noerrcheck(void *handle, const uint8_t *buf, i
 #define STLINK_F_HAS_MEM_RD_NO_INC      STLINK_F_HAS_DPBANKSEL
 #define STLINK_F_HAS_RW_MISC            STLINK_F_HAS_DPBANKSEL
 #define STLINK_F_HAS_CSW                STLINK_F_HAS_DPBANKSEL
+#define STLINK_F_HAS_REG_PIPELINE       STLINK_F_HAS_MEM_PIPELINE
 
 #define STLINK_REGSEL_IS_FPU(x)         ((x) > 0x1F)
 
@@ -830,6 +856,49 @@ static int stlink_usb_xfer_rw(void *handle, int cmdsize, const uint8_t *buf, int
 }
 #endif
 
+#ifdef USE_LIBUSB_ASYNCIO
+/** */
+static int stlink_usb_usb_xfer_burst(void *handle, const struct stlink_burst_xfer *xfers, unsigned int n)
+{
+	struct stlink_usb_handle_s *h = handle;
+	struct jtag_xfer transfers[2 * STLINK_BURST_MAX_XFERS];
+	size_t n_transfers = 0;
+
+	assert(handle);
+	assert(n <= STLINK_BURST_MAX_XFERS);
+
+	memset(transfers, 0, sizeof(transfers));
+
+	for (unsigned int i = 0; i < n; i++) {
+		transfers[n_transfers].ep = h->tx_ep;
+		transfers[n_transfers].buf = (uint8_t *)xfers[i].cmd;
+		transfers[n_transfers].size = STLINK_CMD_SIZE_V2;
+		n_transfers++;
+
+		if (xfers[i].size) {
+			transfers[n_transfers].ep = xfers[i].direction;
+			transfers[n_transfers].buf = xfers[i].buf;
+			transfers[n_transfers].size = xfers[i].size;
+			n_transfers++;
+		}
+	}
+
+	int retval = jtag_libusb_bulk_transfer_n(h->usb_backend_priv.fd, transfers,
+			n_transfers, STLINK_WRITE_TIMEOUT);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (size_t i = 0; i < n_transfers; i++) {
+		if (transfers[i].transfer_size != transfers[i].size) {
+			LOG_DEBUG("short bulk transfer %zu in burst", i);
+			return ERROR_FAIL;
+		}
+	}
+
+	return ERROR_OK;
+}
+#endif
+
 /** */
 static int stlink_usb_xfer_v1_get_sense(void *handle)
 {
@@ -1351,9 +1420,11 @@ static int stlink_usb_version(void *handle)
 
 		/* API to set JTAG frequency from J24 */
 		/* API to access DAP registers from J24 */
+		/* Memory R/W commands can be pipelined from J24 */
 		if (h->version.jtag >= 24) {
 			flags |= STLINK_F_HAS_JTAG_SET_FREQ;
 			flags |= STLINK_F_HAS_DAP_REG;
+			flags |= STLINK_F_HAS_MEM_PIPELINE;
 		}
 
 		/* Quirk for read DP in JTAG mode (V2 only) from J24, fixed in J32 */
@@ -1396,6 +1467,9 @@ static int stlink_usb_version(void *handle)
 		/* API to access DAP registers */
 		flags |= STLINK_F_HAS_DAP_REG;
 
+		/* Memory R/W commands can be pipelined */
+		flags |= STLINK_F_HAS_MEM_PIPELINE;
+
 		/* API to read/write memory at 16 bit */
 		/* API to write memory without address increment */
 		flags |= STLINK_F_HAS_MEM_16BIT;
@@ -1433,6 +1507,9 @@ static int stlink_usb_version(void *handle)
 		/* API to access DAP registers */
 		flags |= STLINK_F_HAS_DAP_REG;
 
+		/* Memory R/W commands can be pipelined */
+		flags |= STLINK_F_HAS_MEM_PIPELINE;
+
 		/* API to read/write memory at 16 bit */
 		/* API to write memory without address increment */
 		flags |= STLINK_F_HAS_MEM_16BIT;
@@ -2839,6 +2916,113 @@ static uint32_t stlink_max_block_size(uint32_t tar_autoincr_block, uint32_t addr
 	return max_tar_block;
 }
 
+static bool stlink_usb_can_burst(void *handle, uint8_t ap_num, uint32_t csw)
+{
+	struct stlink_usb_handle_s *h = handle;
+
+	if (!h->backend->xfer_burst || !(h->version.flags & STLINK_F_HAS_MEM_PIPELINE))
+		return false;
+
+	return (ap_num == 0 && csw == 0) || (h->version.flags & STLINK_F_HAS_CSW);
+}
+
+/* Synchronous 16/32bit transfer of one chunk of a burst, to retry it alone */
+static int stlink_usb_chunk_ap_mem(void *handle, bool read, uint8_t ap_num, uint32_t csw,
+		uint32_t addr, uint32_t size, uint32_t len, uint8_t *buffer)
+{
+	if (size == 4)
+		return read ? stlink_usb_read_mem32(handle, ap_num, csw, addr, len, buffer)
+			: stlink_usb_write_mem32(handle, ap_num, csw, addr, len, buffer);
+
+	return read ? stlink_usb_read_mem16(handle, ap_num, csw, addr, len, buffer)
+		: stlink_usb_write_mem16(handle, ap_num, csw, addr, len, buffer);
+}
+
+/*
+ * Pipelined 16/32bit memory transfer of the aligned head of count bytes at
+ * the aligned address addr. Up to STLINK_BURST_DEPTH chunks are sent at once,
+ * each one followed by its GETLASTRWSTATUS2 request, and the statuses are only
+ * checked once the whole burst has completed.
+ * Every chunk has its own status, so a chunk which got WAIT is retried on its
+ * own: the chunks around it have completed and are not executed again.
+ * On success, done holds the bytes transferred.
+ */
+static int stlink_usb_burst_ap_mem(void *handle, bool read, uint8_t ap_num, uint32_t csw,
+		uint32_t addr, uint32_t size, uint32_t count, uint8_t *buffer, uint32_t *done)
+{
+	static const uint8_t get_status[STLINK_CMD_SIZE_V2] = {
+		STLINK_DEBUG_COMMAND, STLINK_DEBUG_APIV2_GETLASTRWSTATUS2,
+	};
+	struct stlink_usb_handle_s *h = handle;
+	uint8_t cmd[STLINK_BURST_DEPTH][STLINK_CMD_SIZE_V2];
+	uint8_t status[STLINK_BURST_DEPTH][12];
+	uint32_t off[STLINK_BURST_DEPTH];
+	uint32_t len[STLINK_BURST_DEPTH];
+	struct stlink_burst_xfer xfers[STLINK_BURST_MAX_XFERS];
+	uint32_t offset = 0;
+	unsigned int n;
+	uint8_t opcode;
+
+	assert(size == 2 || size == 4);
+
+	*done = 0;
+
+	if (size == 4)
+		opcode = read ? STLINK_DEBUG_READMEM_32BIT : STLINK_DEBUG_WRITEMEM_32BIT;
+	else
+		opcode = read ? STLINK_DEBUG_APIV2_READMEM_16BIT : STLINK_DEBUG_APIV2_WRITEMEM_16BIT;
+
+	for (n = 0; n < STLINK_BURST_DEPTH && count - offset >= size; n++) {
+		off[n] = offset;
+		len[n] = MIN(stlink_max_block_size(h->max_mem_packet, addr + offset), count - offset);
+		len[n] = MIN(len[n], STLINK_MAX_RW16_32) & ~(size - 1);
+
+		memset(cmd[n], 0, STLINK_CMD_SIZE_V2);
+		cmd[n][0] = STLINK_DEBUG_COMMAND;
+		cmd[n][1] = opcode;
+		h_u32_to_le(&cmd[n][2], addr + offset);
+		h_u16_to_le(&cmd[n][6], len[n]);
+		cmd[n][8] = ap_num;
+		h_u24_to_le(&cmd[n][9], csw >> 8);
+
+		xfers[2 * n] = (struct stlink_burst_xfer) {
+			.cmd = cmd[n],
+			.direction = read ? h->rx_ep : h->tx_ep,
+			.buf = buffer + offset,
+			.size = len[n],
+		};
+		xfers[2 * n + 1] = (struct stlink_burst_xfer) {
+			.cmd = get_status,
+			.direction = h->rx_ep,
+			.buf = status[n],
+			.size = sizeof(status[n]),
+		};
+
+		offset += len[n];
+	}
+
+	int retval = h->backend->xfer_burst(handle, xfers, 2 * n);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (unsigned int i = 0; i < n; i++) {
+		int retries = 0;
+
+		h->databuf[0] = status[i][0];
+		retval = stlink_usb_error_check(handle);
+		while (retval == ERROR_WAIT && retries < MAX_WAIT_RETRIES) {
+			usleep((1 << retries++) * 1000);
+			retval = stlink_usb_chunk_ap_mem(handle, read, ap_num, csw, addr + off[i],
+					size, len[i], buffer + off[i]);
+		}
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	*done = offset;
+	return ERROR_OK;
+}
+
 static int stlink_usb_read_ap_mem(void *handle, uint8_t ap_num, uint32_t csw,
 		uint32_t addr, uint32_t size, uint32_t count, uint8_t *buffer)
 {
@@ -2892,6 +3076,18 @@ static int stlink_usb_read_ap_mem(void *handle, uint8_t ap_num, uint32_t csw,
 				bytes_remaining -= head_bytes;
 			}
 
+			if (count >= size && stlink_usb_can_burst(handle, ap_num, csw)) {
+				uint32_t done;
+				retval = stlink_usb_burst_ap_mem(handle, true, ap_num, csw, addr, size,
+						count, buffer, &done);
+				if (retval != ERROR_OK)
+					return retval;
+				buffer += done;
+				addr += done;
+				count -= done;
+				continue;
+			}
+
 			if (bytes_remaining & (size - 1))
 				retval = stlink_usb_read_ap_mem(handle, ap_num, csw, addr, 1, bytes_remaining, buffer);
 			else if (size == 2)
@@ -2980,6 +3176,18 @@ static int stlink_usb_write_ap_mem(void *handle, uint8_t ap_num, uint32_t csw,
 				bytes_remaining -= head_bytes;
 			}
 
+			if (count >= size && stlink_usb_can_burst(handle, ap_num, csw)) {
+				uint32_t done;
+				retval = stlink_usb_burst_ap_mem(handle, false, ap_num, csw, addr, size,
+						count, (uint8_t *)buffer, &done);
+				if (retval != ERROR_OK)
+					return retval;
+				buffer += done;
+				addr += done;
+				count -= done;
+				continue;
+			}
+
 			if (bytes_remaining & (size - 1))
 				retval = stlink_usb_write_ap_mem(handle, ap_num, csw, addr, 1, bytes_remaining, buffer);
 			else if (size == 2)
@@ -3716,6 +3924,9 @@ static struct stlink_backend_s stlink_usb_backend = {
 	.close = stlink_usb_usb_close,
 	.xfer_noerrcheck = stlink_usb_usb_xfer_noerrcheck,
 	.read_trace = stlink_usb_usb_read_trace,
+#ifdef USE_LIBUSB_ASYNCIO
+	.xfer_burst = stlink_usb_usb_xfer_burst,
+#endif
 };
 
 static struct stlink_backend_s stlink_tcp_backend = {
@@ -4281,6 +4492,22 @@ static int stlink_dap_dp_read(struct adiv5_dap *dap, unsigned int reg, uint32_t
 	return retval;
 }
 
+/** Adjust the value written to a DP register to what ST-Link accepts */
+static uint32_t stlink_dap_dp_write_value(unsigned int reg, uint32_t data)
+{
+	if (reg == DP_SELECT && (data & DP_SELECT_DPBANK) != 0) {
+		/* ignored if STLINK_F_HAS_DPBANKSEL, not properly managed otherwise */
+		LOG_DEBUG("Ignoring DPBANKSEL while write SELECT");
+		data &= ~DP_SELECT_DPBANK;
+	}
+
+	/* ST-Link does not like that we set CORUNDETECT */
+	if (reg == DP_CTRL_STAT)
+		data &= ~CORUNDETECT;
+
+	return data;
+}
+
 /** */
 static int stlink_dap_dp_write(struct adiv5_dap *dap, unsigned int reg, uint32_t data)
 {
@@ -4292,15 +4519,7 @@ static int stlink_dap_dp_write(struct adiv5_dap *dap, unsigned int reg, uint32_t
 			return ERROR_COMMAND_NOTFOUND;
 		}
 
-	if (reg == DP_SELECT && (data & DP_SELECT_DPBANK) != 0) {
-		/* ignored if STLINK_F_HAS_DPBANKSEL, not properly managed otherwise */
-		LOG_DEBUG("Ignoring DPBANKSEL while write SELECT");
-		data &= ~DP_SELECT_DPBANK;
-	}
-
-	/* ST-Link does not like that we set CORUNDETECT */
-	if (reg == DP_CTRL_STAT)
-		data &= ~CORUNDETECT;
+	data = stlink_dap_dp_write_value(reg, data);
 
 	retval = stlink_write_dap_register(stlink_dap_handle,
 				STLINK_DEBUG_PORT_ACCESS, reg, data);
@@ -4608,6 +4827,194 @@ static int stlink_usb_mem_rw_queue(void *handle, const struct dap_queue *q, unsi
 	return ERROR_OK;
 }
 
+/*
+ * A write which changes how the following accesses are decoded: DP writes
+ * (SELECT above all) and the MEM-AP address and control registers.
+ */
+static bool stlink_usb_reg_rw_is_setup(const struct dap_queue *q)
+{
+	if (q->cmd == CMD_DP_WRITE)
+		return true;
+
+	return q->cmd == CMD_AP_WRITE && (q->ap_w.reg == ADIV5_MEM_AP_REG_CSW
+			|| q->ap_w.reg == ADIV5_MEM_AP_REG_TAR
+			|| q->ap_w.reg == ADIV5_MEM_AP_REG_TAR64);
+}
+
+/*
+ * Count the accesses at the head of the queue which can be sent as one burst.
+ * The burst ends with the first setup write, so that nothing which depends on
+ * it is sent before its status has been checked.
+ */
+static unsigned int stlink_usb_count_reg_rw_queue(void *handle, const struct dap_queue *q, unsigned int len)
+{
+	struct stlink_usb_handle_s *h = handle;
+	unsigned int i, n_cmd = 0;
+
+	if (!h->backend->xfer_burst || !(h->version.flags & STLINK_F_HAS_REG_PIPELINE))
+		return 0;
+
+	for (i = 0; i < len; i++) {
+		unsigned int count = 1;
+
+		switch (q[i].cmd) {
+		case CMD_DP_READ:
+			if ((q[i].dp_r.reg & 0x000000F0) && !(h->version.flags & STLINK_F_HAS_DPBANKSEL))
+				return i;
+			if (h->version.flags & STLINK_F_QUIRK_JTAG_DP_READ && h->st_mode == STLINK_MODE_DEBUG_JTAG)
+				count = 2;
+			break;
+		case CMD_DP_WRITE:
+			if ((q[i].dp_w.reg & 0x000000F0) && !(h->version.flags & STLINK_F_HAS_DPBANKSEL))
+				return i;
+			break;
+		case CMD_AP_READ:
+			if (is_adiv6(q[i].ap_r.ap->dap))
+				return i;
+			break;
+		case CMD_AP_WRITE:
+			if (is_adiv6(q[i].ap_w.ap->dap))
+				return i;
+			break;
+		default:
+			return i;
+		}
+
+		if (n_cmd + count > STLINK_BURST_MAX_XFERS)
+			break;
+		n_cmd += count;
+
+		if (stlink_usb_reg_rw_is_setup(&q[i]))
+			return i + 1;
+	}
+
+	return i;
+}
+
+static void stlink_usb_reg_rw_cmd(void *handle, struct stlink_burst_xfer *xfer, uint8_t *cmd,
+		uint8_t *reply, bool read, unsigned short dap_port, unsigned short addr, uint32_t val)
+{
+	struct stlink_usb_handle_s *h = handle;
+
+	memset(cmd, 0, STLINK_CMD_SIZE_V2);
+	cmd[0] = STLINK_DEBUG_COMMAND;
+	cmd[1] = read ? STLINK_DEBUG_APIV2_READ_DAP_REG : STLINK_DEBUG_APIV2_WRITE_DAP_REG;
+	h_u16_to_le(&cmd[2], dap_port);
+	h_u16_to_le(&cmd[4], addr);
+	if (!read)
+		h_u32_to_le(&cmd[6], val);
+
+	*xfer = (struct stlink_burst_xfer) {
+		.cmd = cmd,
+		.direction = h->rx_ep,
+		.buf = reply,
+		.size = read ? 8 : 2,
+	};
+}
+
+/*
+ * Send a run of DP/AP register accesses as one burst of READ_DAP_REG and
+ * WRITE_DAP_REG commands, then check the replies in order. The accesses that
+ * follow a failing one have already been sent by then; the run never holds
+ * them after a setup write though, see stlink_usb_count_reg_rw_queue(). As
+ * on the one by one path the first error is returned and ends the run of the
+ * queue.
+ */
+static int stlink_usb_reg_rw_segment(void *handle, const struct dap_queue *q, unsigned int len)
+{
+	struct stlink_usb_handle_s *h = handle;
+	uint8_t cmd[STLINK_BURST_MAX_XFERS][STLINK_CMD_SIZE_V2];
+	uint8_t reply[STLINK_BURST_MAX_XFERS][8];
+	struct stlink_burst_xfer xfers[STLINK_BURST_MAX_XFERS];
+	unsigned int n = 0;
+	int retval;
+
+	assert(len <= STLINK_BURST_MAX_XFERS);
+
+	LOG_DEBUG_IO("Queue: %u register accesses in burst", len);
+
+	for (unsigned int i = 0; i < len; i++) {
+		uint32_t data;
+
+		switch (q[i].cmd) {
+		case CMD_DP_READ:
+			stlink_usb_reg_rw_cmd(h, &xfers[n], cmd[n], reply[n], true,
+					STLINK_DEBUG_PORT_ACCESS, q[i].dp_r.reg, 0);
+			n++;
+			/* Quirk required in JTAG. Read RDBUFF to get the data */
+			if (h->version.flags & STLINK_F_QUIRK_JTAG_DP_READ && h->st_mode == STLINK_MODE_DEBUG_JTAG) {
+				stlink_usb_reg_rw_cmd(h, &xfers[n], cmd[n], reply[n], true,
+						STLINK_DEBUG_PORT_ACCESS, DP_RDBUFF, 0);
+				n++;
+			}
+			break;
+		case CMD_DP_WRITE:
+			data = stlink_dap_dp_write_value(q[i].dp_w.reg, q[i].dp_w.data);
+			stlink_usb_reg_rw_cmd(h, &xfers[n], cmd[n], reply[n], false,
+					STLINK_DEBUG_PORT_ACCESS, q[i].dp_w.reg, data);
+			n++;
+			break;
+		case CMD_AP_READ:
+			if (q[i].ap_r.reg != ADIV5_AP_REG_IDR) {
+				retval = stlink_dap_open_ap(q[i].ap_r.ap->ap_num);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+			stlink_usb_reg_rw_cmd(h, &xfers[n], cmd[n], reply[n], true,
+					q[i].ap_r.ap->ap_num, q[i].ap_r.reg, 0);
+			n++;
+			q[i].ap_r.ap->dap->stlink_flush_ap_write = false;
+			break;
+		case CMD_AP_WRITE:
+			retval = stlink_dap_open_ap(q[i].ap_w.ap->ap_num);
+			if (retval != ERROR_OK)
+				return retval;
+			data = q[i].ap_w.data;
+			/* ignore increment packed, not supported */
+			if (q[i].ap_w.reg == ADIV5_MEM_AP_REG_CSW)
+				data &= ~CSW_ADDRINC_PACKED;
+			stlink_usb_reg_rw_cmd(h, &xfers[n], cmd[n], reply[n], false,
+					q[i].ap_w.ap->ap_num, q[i].ap_w.reg, data);
+			n++;
+			q[i].ap_w.ap->dap->stlink_flush_ap_write = true;
+			break;
+		default:
+			/* Not supposed to happen */
+			return ERROR_FAIL;
+		}
+	}
+
+	retval = h->backend->xfer_burst(handle, xfers, n);
+	if (retval != ERROR_OK)
+		return retval;
+
+	n = 0;
+	for (unsigned int i = 0; i < len; i++) {
+		unsigned int count = 1;
+		uint32_t *p_data = NULL;
+
+		if (q[i].cmd == CMD_DP_READ) {
+			if (h->version.flags & STLINK_F_QUIRK_JTAG_DP_READ && h->st_mode == STLINK_MODE_DEBUG_JTAG)
+				count = 2;
+			p_data = q[i].dp_r.p_data;
+		} else if (q[i].cmd == CMD_AP_READ) {
+			p_data = q[i].ap_r.p_data;
+		}
+
+		for (; count; count--, n++) {
+			h->databuf[0] = reply[n][0];
+			retval = stlink_usb_error_check(handle);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+
+		if (p_data)
+			*p_data = le_to_h_u32(&reply[n - 1][4]);
+	}
+
+	return ERROR_OK;
+}
+
 static void stlink_dap_run_internal(struct adiv5_dap *dap)
 {
 	int retval = stlink_dap_check_reconnect(dap);
@@ -4621,8 +5028,17 @@ static void stlink_dap_run_internal(struct adiv5_dap *dap)
 	struct dap_queue *q = &stlink_dap_handle->queue[0];
 
 	while (i && stlink_dap_get_error() == ERROR_OK) {
-		unsigned int skip = 1;
+		unsigned int skip = stlink_usb_count_reg_rw_queue(stlink_dap_handle, q, i);
+
+		if (skip > 1) {
+			retval = stlink_usb_reg_rw_segment(stlink_dap_handle, q, skip);
+			stlink_dap_record_error(retval);
+			q += skip;
+			i -= skip;
+			continue;
+		}
 
+		skip = 1;
 		switch (q->cmd) {
 		case CMD_DP_READ:
 			retval = stlink_dap_dp_read(q->dp_r.dap, q->dp_r.reg, q->dp_r.p_data);
@@ -4675,19 +5091,31 @@ static int stlink_dap_run_finalize(struct adiv5_dap *dap)
 	 * to complete.
 	 * Run a dummy read to DP_RDBUFF, as suggested in
 	 * http://infocenter.arm.com/help/topic/com.arm.doc.faqs/ka16363.html
+	 * When possible, pipeline it with the read of CTRL/STAT.
 	 */
-	if (dap->stlink_flush_ap_write) {
+	const struct dap_queue status_q[] = {
+		{ .cmd = CMD_DP_READ, .dp_r = { .reg = DP_RDBUFF, .dap = dap, .p_data = NULL } },
+		{ .cmd = CMD_DP_READ, .dp_r = { .reg = DP_CTRL_STAT, .dap = dap, .p_data = &ctrlstat } },
+	};
+	if (dap->stlink_flush_ap_write &&
+			stlink_usb_count_reg_rw_queue(stlink_dap_handle, status_q, 2) == 2) {
 		dap->stlink_flush_ap_write = false;
-		retval = stlink_dap_dp_read(dap, DP_RDBUFF, NULL);
-		if (retval != ERROR_OK) {
-			dap->do_reconnect = true;
-			return retval;
+		saved_retval = stlink_dap_get_and_clear_error();
+		retval = stlink_usb_reg_rw_segment(stlink_dap_handle, status_q, 2);
+	} else {
+		if (dap->stlink_flush_ap_write) {
+			dap->stlink_flush_ap_write = false;
+			retval = stlink_dap_dp_read(dap, DP_RDBUFF, NULL);
+			if (retval != ERROR_OK) {
+				dap->do_reconnect = true;
+				return retval;
+			}
 		}
-	}
 
-	saved_retval = stlink_dap_get_and_clear_error();
+		saved_retval = stlink_dap_get_and_clear_error();
 
-	retval = stlink_dap_dp_read(dap, DP_CTRL_STAT, &ctrlstat);
+		retval = stlink_dap_dp_read(dap, DP_CTRL_STAT, &ctrlstat);
+	}
 	if (retval != ERROR_OK) {
 		LOG_ERROR("Fail reading CTRL/STAT register. Force reconnect");
 		dap->do_reconnect = true;
@@ -259,9 +259,8 @@ static bb_value_t sysfsgpio_read(void)
 {
 	char buf[1];
 
-	/* important to seek to signal sysfs of new read */
-	lseek(tdo_fd, 0, SEEK_SET);
-	int ret = read(tdo_fd, &buf, sizeof(buf));
+	/* important to read from offset 0 to signal sysfs of new read */
+	int ret = pread(tdo_fd, &buf, sizeof(buf), 0);
 
 	if (ret < 0) {
 		LOG_WARNING("reading tdo failed");
@@ -322,6 +321,31 @@ static int sysfsgpio_write(int tck, int tms, int tdi)
 	return ERROR_OK;
 }
 
+/*
+ * Bitbang interface write of a whole vector of TCK, TMS, TDI states
+ *
+ * Each line is a file here, so the cost is in the system calls: unchanged
+ * lines are skipped by sysfsgpio_write() and a TDO sample is a single read.
+ */
+static int sysfsgpio_write_edges(const uint8_t *edges, size_t count, uint8_t *tdo)
+{
+	unsigned int sampled = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		sysfsgpio_write(!!(edges[i] & BB_EDGE_TCK), !!(edges[i] & BB_EDGE_TMS),
+				!!(edges[i] & BB_EDGE_TDI));
+
+		if (edges[i] & BB_EDGE_SAMPLE) {
+			bb_value_t value = sysfsgpio_read();
+			if (value == BB_ERROR)
+				return ERROR_FAIL;
+			bitbang_edges_store_tdo(tdo, sampled++, value);
+		}
+	}
+
+	return ERROR_OK;
+}
+
 /*
  * Bitbang interface to manipulate reset lines SRST and TRST
  *
@@ -568,6 +592,7 @@ struct adapter_driver sysfsgpio_adapter_driver = {
 static struct bitbang_interface sysfsgpio_bitbang = {
 	.read = sysfsgpio_read,
 	.write = sysfsgpio_write,
+	.write_edges = sysfsgpio_write_edges,
 	.swdio_read = sysfsgpio_swdio_read,
 	.swdio_drive = sysfsgpio_swdio_drive,
 	.swd_write = sysfsgpio_swd_write,
@@ -9,6 +9,8 @@
  * and the simulated, emulated core. The openOCD client connects via TCP sockets
  * with vdebug server and over DPI-based transactor with the emulation or simulation
  * The vdebug debug driver supports JTAG and DAP-level transports
+ * When the emulator runs on the same host, the client and server can instead
+ * share the vd_shm block in memory, handing it over with the state word.
  *
 */
 
@@ -32,6 +34,14 @@
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#define VD_HAVE_SHM
+#endif
 #endif
 #include <stdio.h>
 #ifdef HAVE_STDINT_H
@@ -61,6 +71,7 @@
 #define VD_MAX_MEMORIES 20
 #define VD_POLL_INTERVAL 500
 #define VD_SCALE_PSTOMS 1000000000
+#define VD_SHM_SPIN 4000             /* polls of the shm state before sleeping */
 
 /**
  * @brief List of transactor types
@@ -145,6 +156,15 @@ enum {
 	VD_ASPACE_AB      = 0x04,
 };
 
+/**
+ * @brief Shared memory transport states, in vd_shm.state
+ */
+enum {
+	VD_SHM_DOWN       = 0,  /* no server attached */
+	VD_SHM_READY      = 1,  /* server idle, response available */
+	VD_SHM_REQUEST    = 2,  /* request posted by the client */
+};
+
 enum {
 	VD_BATCH_NO       = 0,
 	VD_BATCH_WO       = 1,
@@ -204,7 +224,9 @@ struct vd_client {
 	uint32_t poll_max;
 	uint32_t targ_time;
 	int hsocket;
+	int hshm;
 	char server_name[32];
+	char shm_path[128];
 	char bfm_path[128];
 	char mem_path[VD_MAX_MEMORIES][128];
 	struct vd_rdata rdataq;
@@ -230,7 +252,7 @@ struct vd_reg_hdr {
 };
 
 static struct vd_shm *pbuf;
-static struct vd_client vdc;
+static struct vd_client vdc = { .hshm = -1 };
 
 static int vdebug_socket_error(void)
 {
@@ -324,18 +346,113 @@ static int vdebug_socket_send(int hsock, struct vd_shm *pmem)
 	return rc;
 }
 
+#ifdef VD_HAVE_SHM
+static uint32_t *vdebug_shm_state(struct vd_shm *pmem)
+{
+	return (uint32_t *)(void *)pmem->state;
+}
+
+static long vdebug_futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout)
+{
+	return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+/* maps the vd_shm block created by the server; returns the file handle, -1 on error */
+static int vdebug_shm_open(const char *path, struct vd_shm **ppmem)
+{
+	struct stat st;
+	void *pm;
+	int hshm = open(path, O_RDWR);
+
+	if (hshm < 0) {
+		LOG_ERROR("shm_open: cannot open %s, error %d", path, errno);
+		return -1;
+	}
+	if (fstat(hshm, &st) < 0 || st.st_size < (off_t)sizeof(struct vd_shm)) {
+		LOG_ERROR("shm_open: %s is smaller than %zu bytes", path, sizeof(struct vd_shm));
+		close(hshm);
+		return -1;
+	}
+	pm = mmap(NULL, sizeof(struct vd_shm), PROT_READ | PROT_WRITE, MAP_SHARED, hshm, 0);
+	if (pm == MAP_FAILED) {
+		LOG_ERROR("shm_open: cannot map %s, error %d", path, errno);
+		close(hshm);
+		return -1;
+	}
+	if (__atomic_load_n(vdebug_shm_state(pm), __ATOMIC_ACQUIRE) != VD_SHM_READY) {
+		LOG_ERROR("shm_open: no vdebug server attached to %s", path);
+		munmap(pm, sizeof(struct vd_shm));
+		close(hshm);
+		return -1;
+	}
+	*ppmem = pm;
+
+	return hshm;
+}
+
+static void vdebug_shm_close(int hshm, struct vd_shm *pmem)
+{
+	munmap(pmem, sizeof(struct vd_shm));
+	close(hshm);
+}
+
+/*
+ * Hands the block over to the server and waits for it to come back. The request
+ * is in place already, so the exchange is a store of the state word, a wake-up
+ * of the server, then a short spin before sleeping on the state word.
+ */
+static int vdebug_shm_exchange(struct vd_shm *pmem)
+{
+	uint32_t *state = vdebug_shm_state(pmem);
+	uint32_t st;
+
+	h_u32_to_le(pmem->count, le_to_h_u32(pmem->count) + 1);
+	__atomic_store_n(state, VD_SHM_REQUEST, __ATOMIC_RELEASE);
+	vdebug_futex(state, FUTEX_WAKE, 1, NULL);
+
+	for (unsigned int spin = 0; (st = __atomic_load_n(state, __ATOMIC_ACQUIRE)) == VD_SHM_REQUEST; spin++) {
+		if (spin < VD_SHM_SPIN)
+			continue;
+		struct timespec timeout = { .tv_sec = 1 };
+		if (vdebug_futex(state, FUTEX_WAIT, VD_SHM_REQUEST, &timeout) < 0 &&
+			errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+			LOG_WARNING("shm_exchange: wait failed, error %d", errno);
+			return -1;
+		}
+	}
+	if (st != VD_SHM_READY) {
+		LOG_WARNING("shm_exchange: server detached, state %" PRIu32, st);
+		return -1;
+	}
+
+	return 0;
+}
+#endif
+
 static uint32_t vdebug_wait_server(int hsock, struct vd_shm *pmem)
 {
-	if (!hsock)
-		return VD_ERR_SOC_OPEN;
+	int st, rd;
+
+#ifdef VD_HAVE_SHM
+	if (vdc.hshm >= 0) {
+		if (vdebug_shm_exchange(pmem) < 0)
+			return VD_ERR_NOT_RUN;
+		st = VD_CHEADER_LEN + le_to_h_u16(pmem->wbytes);
+		rd = VD_SHEADER_LEN + le_to_h_u16(pmem->rbytes);
+	} else
+#endif
+	{
+		if (!hsock)
+			return VD_ERR_SOC_OPEN;
 
-	int st = vdebug_socket_send(hsock, pmem);
-	if (st <= 0)
-		return VD_ERR_SOC_SEND;
+		st = vdebug_socket_send(hsock, pmem);
+		if (st <= 0)
+			return VD_ERR_SOC_SEND;
 
-	int rd = vdebug_socket_receive(hsock, pmem);
-	if (rd  <= 0)
-		return VD_ERR_SOC_RECV;
+		rd = vdebug_socket_receive(hsock, pmem);
+		if (rd  <= 0)
+			return VD_ERR_SOC_RECV;
+	}
 
 	int rc = le_to_h_u32(pmem->status);
 	LOG_DEBUG_IO("wait_server: cmd %02" PRIx8 " done, sent %d, rcvd %d, status %d",
@@ -833,8 +950,30 @@ static void vdebug_mem_close(int hsock, struct vd_shm *pm, uint8_t ndx)
 }
 
 
-static int vdebug_init(void)
+static const char *vdebug_server_desc(void)
+{
+	static char desc[sizeof(vdc.shm_path) + sizeof(vdc.server_name) + 8];
+
+	if (vdc.hshm >= 0)
+		snprintf(desc, sizeof(desc), "%s", vdc.shm_path);
+	else
+		snprintf(desc, sizeof(desc), "%s:%" PRIu16, vdc.server_name, vdc.server_port);
+
+	return desc;
+}
+
+static int vdebug_transport_open(void)
 {
+#ifdef VD_HAVE_SHM
+	if (vdc.shm_path[0]) {
+		vdc.hshm = vdebug_shm_open(vdc.shm_path, &pbuf);
+		if (vdc.hshm < 0) {
+			LOG_ERROR("cannot attach to vdebug server through %s", vdc.shm_path);
+			return ERROR_FAIL;
+		}
+		return ERROR_OK;
+	}
+#endif
 	vdc.hsocket = vdebug_socket_open(vdc.server_name, vdc.server_port);
 	pbuf = calloc(1, sizeof(struct vd_shm));
 	if (!pbuf) {
@@ -850,6 +989,32 @@ static int vdebug_init(void)
 			vdc.server_name, vdc.server_port);
 		return ERROR_FAIL;
 	}
+
+	return ERROR_OK;
+}
+
+static void vdebug_transport_close(void)
+{
+#ifdef VD_HAVE_SHM
+	if (vdc.hshm >= 0) {
+		vdebug_shm_close(vdc.hshm, pbuf);
+		vdc.hshm = -1;
+		pbuf = NULL;
+		return;
+	}
+#endif
+	if (vdc.hsocket)
+		close_socket(vdc.hsocket);
+	vdc.hsocket = 0;
+	free(pbuf);
+	pbuf = NULL;
+}
+
+static int vdebug_init(void)
+{
+	if (vdebug_transport_open() != ERROR_OK)
+		return ERROR_FAIL;
+
 	vdc.trans_first = 1;
 	vdc.poll_cycles = vdc.poll_max;
 	uint32_t sig_mask = VD_SIG_RESET;
@@ -859,10 +1024,7 @@ static int vdebug_init(void)
 	int rc = vdebug_open(vdc.hsocket, pbuf, vdc.bfm_path, vdc.bfm_type, vdc.bfm_period, sig_mask);
 	if (rc != 0) {
 		LOG_ERROR("0x%x cannot connect to %s", rc, vdc.bfm_path);
-		close_socket(vdc.hsocket);
-		vdc.hsocket = 0;
-		free(pbuf);
-		pbuf = NULL;
+		vdebug_transport_close();
 	} else {
 		for (uint8_t i = 0; i < vdc.mem_ndx; i++) {
 			rc = vdebug_mem_open(vdc.hsocket, pbuf, vdc.mem_path[i], i);
@@ -870,8 +1032,8 @@ static int vdebug_init(void)
 				LOG_ERROR("0x%x cannot connect to %s", rc, vdc.mem_path[i]);
 		}
 
-		LOG_INFO("vdebug %d connected to %s through %s:%" PRIu16,
-				 VD_VERSION, vdc.bfm_path, vdc.server_name, vdc.server_port);
+		LOG_INFO("vdebug %d connected to %s through %s",
+				 VD_VERSION, vdc.bfm_path, vdebug_server_desc());
 	}
 
 	return rc;
@@ -883,12 +1045,9 @@ static int vdebug_quit(void)
 		if (vdc.mem_width[i])
 			vdebug_mem_close(vdc.hsocket, pbuf, i);
 	int rc = vdebug_close(vdc.hsocket, pbuf, vdc.bfm_type);
-	LOG_INFO("vdebug %d disconnected from %s through %s:%" PRIu16 " rc:%d", VD_VERSION,
-		vdc.bfm_path, vdc.server_name, vdc.server_port, rc);
-	if (vdc.hsocket)
-		close_socket(vdc.hsocket);
-	free(pbuf);
-	pbuf = NULL;
+	LOG_INFO("vdebug %d disconnected from %s through %s rc:%d", VD_VERSION,
+		vdc.bfm_path, vdebug_server_desc(), rc);
+	vdebug_transport_close();
 
 	return ERROR_OK;
 }
@@ -1150,6 +1309,26 @@ COMMAND_HANDLER(vdebug_set_server)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(vdebug_set_shm)
+{
+	if (CMD_ARGC != 1 || !CMD_ARGV[0][0])
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+#ifdef VD_HAVE_SHM
+	const char *name = CMD_ARGV[0];
+	if (strchr(name + 1, '/'))
+		snprintf(vdc.shm_path, sizeof(vdc.shm_path), "%s", name);
+	else /* POSIX shared memory object name */
+		snprintf(vdc.shm_path, sizeof(vdc.shm_path), "/dev/shm/%s", name[0] == '/' ? name + 1 : name);
+	LOG_DEBUG("shm: %s", vdc.shm_path);
+
+	return ERROR_OK;
+#else
+	LOG_ERROR("shared memory transport not supported on this host");
+	return ERROR_FAIL;
+#endif
+}
+
 COMMAND_HANDLER(vdebug_set_bfm)
 {
 	char prefix;
@@ -1236,6 +1415,13 @@ static const struct command_registration vdebug_command_handlers[] = {
 		.help = "set the vdebug server name or address",
 		.usage = "<host:port>",
 	},
+	{
+		.name = "shm",
+		.handler = &vdebug_set_shm,
+		.mode = COMMAND_CONFIG,
+		.help = "use the shared memory block of a vdebug server on the same host",
+		.usage = "<name|path>",
+	},
 	{
 		.name = "bfm_path",
 		.handler = &vdebug_set_bfm,
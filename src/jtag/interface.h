@@ -191,6 +191,24 @@ struct jtag_interface {
 	 * @returns ERROR_OK on success, or an error code on failure.
 	 */
 	int (*execute_queue)(void);
+
+	/**
+	 * Optional. Start executing queued commands without waiting for their
+	 * completion, so the next queue can be built in the meantime.
+	 * The commands and scan buffers of the queue stay valid until
+	 * execute_queue_finish() returns, but the driver can't be called for
+	 * anything else in between.
+	 * @returns ERROR_OK on success, or an error code on failure, in which
+	 * case nothing is left in flight.
+	 */
+	int (*execute_queue_start)(void);
+
+	/**
+	 * Wait for the completion of the commands started by
+	 * execute_queue_start(). Mandatory if execute_queue_start() is set.
+	 * @returns ERROR_OK on success, or an error code on failure.
+	 */
+	int (*execute_queue_finish)(void);
 };
 
 /**
@@ -130,6 +130,8 @@ struct jtag_tap {
 
 	/** current instruction */
 	uint8_t *cur_instr;
+	/** cur_instr is known to match the IR content, see jtag_set_ir_cache() */
+	bool cur_instr_valid;
 	/** Bypass register selected */
 	int bypass;
 
@@ -248,6 +250,24 @@ void jtag_set_verify(bool enable);
 /** @returns True if data scan verification will be performed. */
 bool jtag_will_verify(void);
 
+/**
+ * Enable or disable the IR cache. When enabled, jtag_add_ir_scan() and
+ * jtag_add_ir_scan_noverify() don't queue IR scans loading the instruction
+ * already held by the TAP, with all the other TAPs in BYPASS.
+ */
+void jtag_set_ir_cache(bool enable);
+/** @returns True if the IR cache is enabled. */
+bool jtag_will_cache_ir(void);
+/** Get the number of IR scans skipped and queued by the IR cache. */
+void jtag_get_ir_cache_stats(uint64_t *hits, uint64_t *misses);
+
+/** Enable or disable the peephole optimization of the queue. */
+void jtag_set_optimize_queue(bool enable);
+/** @returns True if the queue is optimized before reaching the driver. */
+bool jtag_will_optimize_queue(void);
+/** Get the number of commands and scan bits removed by the optimizer. */
+void jtag_get_optimize_queue_stats(uint64_t *commands, uint64_t *bits);
+
 /** Enable or disable verification of IR scan checking. */
 void jtag_set_verify_capture_ir(bool enable);
 /** @returns True if IR scan verification will be performed. */
@@ -519,6 +539,30 @@ int jtag_execute_queue(void);
 /** same as jtag_execute_queue() but does not clear the error flag */
 void jtag_execute_queue_noclear(void);
 
+/**
+ * Hand the queue to the adapter without waiting for its completion, so
+ * the next queue can be built while this one is on the wire. Only one
+ * queue is in flight at a time: it is completed by the next call to
+ * jtag_execute_queue_async(), jtag_execute_queue() or jtag_wait_queue().
+ *
+ * Until then, the in_value buffers of the queued scans are not updated,
+ * the callbacks are not run and errors are not reported, so this is only
+ * for callers that don't need the results right away. Adapters that
+ * can't run the queue in the background execute it synchronously.
+ */
+void jtag_execute_queue_async(void);
+
+/**
+ * Wait for the completion of the queue started by jtag_execute_queue_async(),
+ * if any.
+ * @returns ERROR_OK if all the queued operations succeeded, else the error
+ * code of the first failure since the error flag was last cleared.
+ */
+int jtag_wait_queue(void);
+
+/** same as jtag_wait_queue() but does not clear the error flag */
+void jtag_wait_queue_noclear(void);
+
 /** @returns the number of times the scan queue has been flushed */
 int jtag_get_flush_queue_count(void);
 
@@ -68,7 +68,40 @@ int interface_add_tms_seq(unsigned num_bits,
 int interface_jtag_add_reset(int trst, int srst);
 int interface_jtag_add_sleep(uint32_t us);
 int interface_jtag_add_clocks(int num_cycles);
+
+struct jtag_callback_entry;
+
+/** A captured value to check once the queue has been executed. */
+struct jtag_scan_check {
+	uint8_t *captured;
+	uint8_t *value;
+	/** NULL to check all the bits */
+	uint8_t *mask;
+	int num_bits;
+	/** last callback queued before the check, NULL if none */
+	const struct jtag_callback_entry *after;
+};
+
+/**
+ * Queue a check of the value captured by a scan. The checks keep their
+ * order with the queued callbacks; the checks queued between two callbacks
+ * are verified together, in a single pass.
+ */
+int interface_jtag_add_scan_check(uint8_t *captured, uint8_t *value,
+		uint8_t *mask, int num_bits);
+/** Release the memory used by the queued checks. */
+void jtag_scan_checks_free(void);
+
+/**
+ * Verify the checks queued by interface_jtag_add_scan_check().
+ * @returns ERROR_OK, or ERROR_JTAG_QUEUE_FAILED after logging the first
+ * mismatching check.
+ */
+int jtag_scan_checks_verify(const struct jtag_scan_check *checks, size_t count);
+
 int interface_jtag_execute_queue(void);
+int interface_jtag_execute_queue_async(void);
+int interface_jtag_wait_queue(void);
 
 /**
  * Calls the interface callback to execute the queue.  This routine
@@ -76,4 +109,20 @@ int interface_jtag_execute_queue(void);
  */
 int default_interface_jtag_execute_queue(void);
 
+/**
+ * Calls the interface callback to start executing the queue, without
+ * waiting for its completion. Falls back on execute_queue() if the
+ * interface can't do it.
+ * @param in_flight Set to true if default_interface_jtag_execute_queue_finish()
+ * has to be called to complete the queue.
+ */
+int default_interface_jtag_execute_queue_start(bool *in_flight);
+
+/**
+ * Waits for the completion of the queue started by
+ * default_interface_jtag_execute_queue_start().
+ * @param cmd The first command of the queue, for debug output.
+ */
+int default_interface_jtag_execute_queue_finish(struct jtag_command *cmd);
+
 #endif /* OPENOCD_JTAG_MINIDRIVER_H */
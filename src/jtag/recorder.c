@@ -0,0 +1,850 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Recorder and replay of the adapter driver traffic, see recorder.h.
+ *
+ * A recording starts with an 8 bytes header, "OCDREC" followed by the
+ * format version and a reserved byte, then holds a sequence of records.
+ * Each record starts with a one byte tag; all the integers are little
+ * endian. The JTAG records are:
+ *
+ *   QUEUE: u64 timestamp (us), u32 number of commands, then the commands.
+ *          Each command is its u8 type followed by:
+ *            SCAN         u8 ir_scan, u8 end_state, u32 num_fields, then
+ *                         per field u32 num_bits, u8 flags (bit 0: out
+ *                         data follows, bit 1: field captures data) and
+ *                         the out data.
+ *            TLR_RESET    u8 end_state
+ *            RUNTEST      u32 num_cycles, u8 end_state
+ *            RESET        u8 trst, u8 srst
+ *            PATHMOVE     u32 num_states, one u8 per state
+ *            SLEEP        u32 us
+ *            STABLECLOCKS u32 num_cycles
+ *            TMS          u32 num_bits, the bits
+ *   DONE:  u32 duration (us), u32 result, then the data captured by each
+ *          capturing field of the previous QUEUE, in order.
+ *
+ * The SWD records are:
+ *
+ *   SWD_SEQ:   u8 sequence, u32 result
+ *   SWD_READ:  u8 cmd, u32 ap_delay_hint
+ *   SWD_WRITE: u8 cmd, u32 value, u32 ap_delay_hint
+ *   SWD_RUN:   u64 timestamp (us), u32 duration (us), u32 result,
+ *              u32 number of reads, the values read since the previous run.
+ *
+ * Data fields are stored on the number of bytes needed for their bits.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "adapter.h"
+#include "jtag.h"
+#include "commands.h"
+#include "interface.h"
+#include "swd.h"
+#include "recorder.h"
+#include <helper/binarybuffer.h>
+#include <helper/command.h>
+#include <helper/time_support.h>
+#include <transport/transport.h>
+
+extern struct adapter_driver *adapter_driver;
+
+#define RECORDER_MAGIC		"OCDREC"
+#define RECORDER_VERSION	1
+
+enum recorder_tag {
+	RECORDER_JTAG_QUEUE = 1,
+	RECORDER_JTAG_DONE,
+	RECORDER_SWD_SEQ,
+	RECORDER_SWD_READ,
+	RECORDER_SWD_WRITE,
+	RECORDER_SWD_RUN,
+};
+
+#define RECORDER_FIELD_OUT	BIT(0)
+#define RECORDER_FIELD_IN	BIT(1)
+
+static FILE *recorder_file;
+static int64_t recorder_start_us;
+static int64_t recorder_queue_start_us;
+
+/* SWD driver of the adapter, when wrapped by the recorder */
+static const struct swd_driver *recorder_swd_inner;
+static struct swd_driver recorder_swd;
+
+/* destinations of the SWD reads queued since the last run */
+static uint32_t **recorder_swd_reads;
+static unsigned int recorder_swd_read_count;
+static unsigned int recorder_swd_read_size;
+
+static int64_t recorder_time_us(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static void recorder_write(const void *data, size_t len)
+{
+	if (!recorder_file)
+		return;
+
+	if (fwrite(data, 1, len, recorder_file) != len) {
+		LOG_ERROR("Error writing the recording, recording stopped");
+		jtag_recorder_stop();
+	}
+}
+
+static void recorder_write_u8(uint8_t value)
+{
+	recorder_write(&value, 1);
+}
+
+static void recorder_write_u32(uint32_t value)
+{
+	uint8_t buf[4];
+
+	h_u32_to_le(buf, value);
+	recorder_write(buf, sizeof(buf));
+}
+
+static void recorder_write_u64(uint64_t value)
+{
+	uint8_t buf[8];
+
+	h_u64_to_le(buf, value);
+	recorder_write(buf, sizeof(buf));
+}
+
+bool jtag_recorder_is_active(void)
+{
+	return recorder_file;
+}
+
+static void recorder_write_command(const struct jtag_command *cmd)
+{
+	recorder_write_u8(cmd->type);
+
+	switch (cmd->type) {
+	case JTAG_SCAN:
+		recorder_write_u8(cmd->cmd.scan->ir_scan);
+		recorder_write_u8(cmd->cmd.scan->end_state);
+		recorder_write_u32(cmd->cmd.scan->num_fields);
+		for (int i = 0; i < cmd->cmd.scan->num_fields; i++) {
+			const struct scan_field *field = &cmd->cmd.scan->fields[i];
+			uint8_t flags = 0;
+
+			if (field->out_value)
+				flags |= RECORDER_FIELD_OUT;
+			if (field->in_value)
+				flags |= RECORDER_FIELD_IN;
+			recorder_write_u32(field->num_bits);
+			recorder_write_u8(flags);
+			if (field->out_value)
+				recorder_write(field->out_value, DIV_ROUND_UP(field->num_bits, 8));
+		}
+		break;
+	case JTAG_TLR_RESET:
+		recorder_write_u8(cmd->cmd.statemove->end_state);
+		break;
+	case JTAG_RUNTEST:
+		recorder_write_u32(cmd->cmd.runtest->num_cycles);
+		recorder_write_u8(cmd->cmd.runtest->end_state);
+		break;
+	case JTAG_RESET:
+		recorder_write_u8(cmd->cmd.reset->trst);
+		recorder_write_u8(cmd->cmd.reset->srst);
+		break;
+	case JTAG_PATHMOVE:
+		recorder_write_u32(cmd->cmd.pathmove->num_states);
+		for (int i = 0; i < cmd->cmd.pathmove->num_states; i++)
+			recorder_write_u8(cmd->cmd.pathmove->path[i]);
+		break;
+	case JTAG_SLEEP:
+		recorder_write_u32(cmd->cmd.sleep->us);
+		break;
+	case JTAG_STABLECLOCKS:
+		recorder_write_u32(cmd->cmd.stableclocks->num_cycles);
+		break;
+	case JTAG_TMS:
+		recorder_write_u32(cmd->cmd.tms->num_bits);
+		recorder_write(cmd->cmd.tms->bits, DIV_ROUND_UP(cmd->cmd.tms->num_bits, 8));
+		break;
+	}
+}
+
+void jtag_recorder_queue(const struct jtag_command *cmd)
+{
+	if (!recorder_file)
+		return;
+
+	uint32_t count = 0;
+	for (const struct jtag_command *c = cmd; c; c = c->next)
+		count++;
+
+	recorder_queue_start_us = recorder_time_us();
+	recorder_write_u8(RECORDER_JTAG_QUEUE);
+	recorder_write_u64(recorder_queue_start_us - recorder_start_us);
+	recorder_write_u32(count);
+	for (; cmd; cmd = cmd->next)
+		recorder_write_command(cmd);
+}
+
+void jtag_recorder_queue_done(const struct jtag_command *cmd, int retval)
+{
+	if (!recorder_file)
+		return;
+
+	recorder_write_u8(RECORDER_JTAG_DONE);
+	recorder_write_u32(recorder_time_us() - recorder_queue_start_us);
+	recorder_write_u32(retval);
+	for (; cmd; cmd = cmd->next) {
+		if (cmd->type != JTAG_SCAN)
+			continue;
+		for (int i = 0; i < cmd->cmd.scan->num_fields; i++) {
+			const struct scan_field *field = &cmd->cmd.scan->fields[i];
+			if (field->in_value)
+				recorder_write(field->in_value, DIV_ROUND_UP(field->num_bits, 8));
+		}
+	}
+}
+
+static int recorder_swd_switch_seq(enum swd_special_seq seq)
+{
+	int retval = recorder_swd_inner->switch_seq(seq);
+
+	recorder_write_u8(RECORDER_SWD_SEQ);
+	recorder_write_u8(seq);
+	recorder_write_u32(retval);
+
+	return retval;
+}
+
+static void recorder_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_hint)
+{
+	if (recorder_file) {
+		if (recorder_swd_read_count == recorder_swd_read_size) {
+			unsigned int size = recorder_swd_read_size ? recorder_swd_read_size * 2 : 64;
+			uint32_t **reads = realloc(recorder_swd_reads, size * sizeof(*reads));
+			if (!reads) {
+				LOG_ERROR("Out of memory, recording stopped");
+				jtag_recorder_stop();
+			} else {
+				recorder_swd_reads = reads;
+				recorder_swd_read_size = size;
+			}
+		}
+		if (recorder_file) {
+			recorder_swd_reads[recorder_swd_read_count++] = value;
+			recorder_write_u8(RECORDER_SWD_READ);
+			recorder_write_u8(cmd);
+			recorder_write_u32(ap_delay_hint);
+		}
+	}
+
+	recorder_swd_inner->read_reg(cmd, value, ap_delay_hint);
+}
+
+static void recorder_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay_hint)
+{
+	recorder_write_u8(RECORDER_SWD_WRITE);
+	recorder_write_u8(cmd);
+	recorder_write_u32(value);
+	recorder_write_u32(ap_delay_hint);
+
+	recorder_swd_inner->write_reg(cmd, value, ap_delay_hint);
+}
+
+static int recorder_swd_run(void)
+{
+	int64_t start = recorder_time_us();
+	int retval = recorder_swd_inner->run();
+
+	recorder_write_u8(RECORDER_SWD_RUN);
+	recorder_write_u64(start - recorder_start_us);
+	recorder_write_u32(recorder_time_us() - start);
+	recorder_write_u32(retval);
+	recorder_write_u32(recorder_swd_read_count);
+	for (unsigned int i = 0; i < recorder_swd_read_count; i++)
+		recorder_write_u32(recorder_swd_reads[i] ? *recorder_swd_reads[i] : 0);
+	recorder_swd_read_count = 0;
+
+	return retval;
+}
+
+const struct swd_driver *jtag_recorder_swd_driver(const struct swd_driver *swd)
+{
+	if (!swd || (!recorder_file && !recorder_swd_inner))
+		return swd;
+
+	if (recorder_swd_inner != swd) {
+		recorder_swd_inner = swd;
+		recorder_swd = *swd;
+		recorder_swd.switch_seq = recorder_swd_switch_seq;
+		recorder_swd.read_reg = recorder_swd_read_reg;
+		recorder_swd.write_reg = recorder_swd_write_reg;
+		recorder_swd.run = recorder_swd_run;
+	}
+
+	return &recorder_swd;
+}
+
+static int jtag_recorder_start(const char *filename)
+{
+	jtag_recorder_stop();
+
+	recorder_file = fopen(filename, "wb");
+	if (!recorder_file) {
+		LOG_ERROR("Can't open \"%s\" for writing", filename);
+		return ERROR_FAIL;
+	}
+
+	const uint8_t header[8] = { 'O', 'C', 'D', 'R', 'E', 'C', RECORDER_VERSION, 0 };
+	recorder_write(header, sizeof(header));
+	recorder_start_us = recorder_time_us();
+
+	return recorder_file ? ERROR_OK : ERROR_FAIL;
+}
+
+void jtag_recorder_stop(void)
+{
+	FILE *file = recorder_file;
+
+	if (!file)
+		return;
+
+	recorder_file = NULL;
+	if (fclose(file) != 0)
+		LOG_ERROR("Error closing the recording");
+
+	free(recorder_swd_reads);
+	recorder_swd_reads = NULL;
+	recorder_swd_read_count = 0;
+	recorder_swd_read_size = 0;
+}
+
+/* Playback */
+
+struct replay_reader {
+	FILE *file;
+	bool error;
+	/* destinations of the SWD reads queued since the last run */
+	uint32_t **swd_reads;
+	unsigned int swd_read_count;
+	unsigned int swd_read_size;
+};
+
+static void replay_read(struct replay_reader *reader, void *data, size_t len)
+{
+	if (reader->error || fread(data, 1, len, reader->file) != len) {
+		reader->error = true;
+		memset(data, 0, len);
+	}
+}
+
+static uint8_t replay_read_u8(struct replay_reader *reader)
+{
+	uint8_t value;
+
+	replay_read(reader, &value, 1);
+	return value;
+}
+
+static uint32_t replay_read_u32(struct replay_reader *reader)
+{
+	uint8_t buf[4];
+
+	replay_read(reader, buf, sizeof(buf));
+	return le_to_h_u32(buf);
+}
+
+static uint64_t replay_read_u64(struct replay_reader *reader)
+{
+	uint8_t buf[8];
+
+	replay_read(reader, buf, sizeof(buf));
+	return le_to_h_u64(buf);
+}
+
+/* Read a data field, allocated from the command queue */
+static uint8_t *replay_read_bits(struct replay_reader *reader, uint32_t num_bits)
+{
+	uint8_t *data = cmd_queue_alloc(MAX(DIV_ROUND_UP(num_bits, 8), 1));
+
+	replay_read(reader, data, DIV_ROUND_UP(num_bits, 8));
+	return data;
+}
+
+struct replay_model {
+	/** Model the adapter timing instead of running the adapter driver. */
+	bool enabled;
+	/** Clock frequency, in kHz. */
+	unsigned int khz;
+	/** Round trip latency of each queue execution, in microseconds. */
+	unsigned int latency_us;
+	/** JTAG state at the end of the last command. */
+	tap_state_t state;
+	/** Modelled clock cycles and sleeps. */
+	uint64_t cycles;
+	uint64_t sleep_us;
+};
+
+struct replay_stats {
+	unsigned int queues;
+	unsigned int commands;
+	uint64_t scan_bits;
+	unsigned int swd_runs;
+	unsigned int swd_transfers;
+	/** Queues or runs that failed when recorded or when replayed. */
+	unsigned int failures;
+	/** Captured values that differ from the recorded ones. */
+	unsigned int mismatches;
+	/** Time the adapter took to execute the queues when recorded. */
+	uint64_t recorded_us;
+};
+
+static unsigned int replay_model_move(struct replay_model *model, tap_state_t state)
+{
+	unsigned int cycles = 0;
+
+	if (tap_is_state_stable(model->state) && tap_is_state_stable(state))
+		cycles = tap_get_tms_path_len(model->state, state);
+	model->state = state;
+
+	return cycles;
+}
+
+/* Clock cycles a command takes on the wire, roughly */
+static void replay_model_command(struct replay_model *model, const struct jtag_command *cmd)
+{
+	switch (cmd->type) {
+	case JTAG_SCAN:
+		model->cycles += replay_model_move(model,
+				cmd->cmd.scan->ir_scan ? TAP_IRSHIFT : TAP_DRSHIFT);
+		model->cycles += jtag_scan_size(cmd->cmd.scan);
+		model->cycles += replay_model_move(model, cmd->cmd.scan->end_state);
+		break;
+	case JTAG_TLR_RESET:
+		model->cycles += 5;
+		model->state = TAP_RESET;
+		model->cycles += replay_model_move(model, cmd->cmd.statemove->end_state);
+		break;
+	case JTAG_RUNTEST:
+		model->cycles += replay_model_move(model, TAP_IDLE);
+		model->cycles += cmd->cmd.runtest->num_cycles;
+		model->cycles += replay_model_move(model, cmd->cmd.runtest->end_state);
+		break;
+	case JTAG_PATHMOVE:
+		model->cycles += cmd->cmd.pathmove->num_states;
+		model->state = cmd->cmd.pathmove->path[cmd->cmd.pathmove->num_states - 1];
+		break;
+	case JTAG_SLEEP:
+		model->sleep_us += cmd->cmd.sleep->us;
+		break;
+	case JTAG_STABLECLOCKS:
+		model->cycles += cmd->cmd.stableclocks->num_cycles;
+		break;
+	case JTAG_TMS:
+		model->cycles += cmd->cmd.tms->num_bits;
+		break;
+	case JTAG_RESET:
+		break;
+	}
+}
+
+static struct jtag_command *replay_read_command(struct replay_reader *reader)
+{
+	struct jtag_command *cmd = cmd_queue_alloc(sizeof(*cmd));
+
+	cmd->type = replay_read_u8(reader);
+	cmd->next = NULL;
+
+	switch (cmd->type) {
+	case JTAG_SCAN:
+		cmd->cmd.scan = cmd_queue_alloc(sizeof(*cmd->cmd.scan));
+		cmd->cmd.scan->ir_scan = replay_read_u8(reader);
+		cmd->cmd.scan->end_state = (int8_t)replay_read_u8(reader);
+		cmd->cmd.scan->num_fields = replay_read_u32(reader);
+		if (cmd->cmd.scan->num_fields > 0xffff) {
+			reader->error = true;
+			return NULL;
+		}
+		cmd->cmd.scan->fields = cmd_queue_alloc(MAX(cmd->cmd.scan->num_fields, 1)
+				* sizeof(struct scan_field));
+		for (int i = 0; !reader->error && i < cmd->cmd.scan->num_fields; i++) {
+			struct scan_field *field = &cmd->cmd.scan->fields[i];
+
+			memset(field, 0, sizeof(*field));
+			field->num_bits = replay_read_u32(reader);
+			uint8_t flags = replay_read_u8(reader);
+			if (field->num_bits < 0) {
+				reader->error = true;
+				return NULL;
+			}
+			if (flags & RECORDER_FIELD_OUT)
+				field->out_value = replay_read_bits(reader, field->num_bits);
+			if (flags & RECORDER_FIELD_IN)
+				field->in_value = cmd_queue_alloc(MAX(DIV_ROUND_UP(field->num_bits, 8), 1));
+		}
+		break;
+	case JTAG_TLR_RESET:
+		cmd->cmd.statemove = cmd_queue_alloc(sizeof(*cmd->cmd.statemove));
+		cmd->cmd.statemove->end_state = (int8_t)replay_read_u8(reader);
+		break;
+	case JTAG_RUNTEST:
+		cmd->cmd.runtest = cmd_queue_alloc(sizeof(*cmd->cmd.runtest));
+		cmd->cmd.runtest->num_cycles = replay_read_u32(reader);
+		cmd->cmd.runtest->end_state = (int8_t)replay_read_u8(reader);
+		break;
+	case JTAG_RESET:
+		cmd->cmd.reset = cmd_queue_alloc(sizeof(*cmd->cmd.reset));
+		cmd->cmd.reset->trst = (int8_t)replay_read_u8(reader);
+		cmd->cmd.reset->srst = (int8_t)replay_read_u8(reader);
+		break;
+	case JTAG_PATHMOVE:
+		cmd->cmd.pathmove = cmd_queue_alloc(sizeof(*cmd->cmd.pathmove));
+		cmd->cmd.pathmove->num_states = replay_read_u32(reader);
+		if (cmd->cmd.pathmove->num_states <= 0 || cmd->cmd.pathmove->num_states > 0xffff) {
+			reader->error = true;
+			return NULL;
+		}
+		cmd->cmd.pathmove->path = cmd_queue_alloc(cmd->cmd.pathmove->num_states
+				* sizeof(tap_state_t));
+		for (int i = 0; i < cmd->cmd.pathmove->num_states; i++)
+			cmd->cmd.pathmove->path[i] = (int8_t)replay_read_u8(reader);
+		break;
+	case JTAG_SLEEP:
+		cmd->cmd.sleep = cmd_queue_alloc(sizeof(*cmd->cmd.sleep));
+		cmd->cmd.sleep->us = replay_read_u32(reader);
+		break;
+	case JTAG_STABLECLOCKS:
+		cmd->cmd.stableclocks = cmd_queue_alloc(sizeof(*cmd->cmd.stableclocks));
+		cmd->cmd.stableclocks->num_cycles = replay_read_u32(reader);
+		break;
+	case JTAG_TMS:
+		cmd->cmd.tms = cmd_queue_alloc(sizeof(*cmd->cmd.tms));
+		cmd->cmd.tms->num_bits = replay_read_u32(reader);
+		cmd->cmd.tms->bits = replay_read_bits(reader, cmd->cmd.tms->num_bits);
+		break;
+	default:
+		reader->error = true;
+		return NULL;
+	}
+
+	return reader->error ? NULL : cmd;
+}
+
+static int replay_jtag_queue(struct replay_reader *reader, struct replay_model *model,
+		struct replay_stats *stats)
+{
+	/* timestamp, only meaningful in the recording */
+	replay_read_u64(reader);
+	uint32_t count = replay_read_u32(reader);
+
+	for (uint32_t i = 0; !reader->error && i < count; i++) {
+		struct jtag_command *cmd = replay_read_command(reader);
+		if (!cmd)
+			break;
+		jtag_queue_command(cmd);
+		if (cmd->type == JTAG_SCAN)
+			stats->scan_bits += jtag_scan_size(cmd->cmd.scan);
+		if (model->enabled)
+			replay_model_command(model, cmd);
+	}
+
+	if (reader->error || replay_read_u8(reader) != RECORDER_JTAG_DONE) {
+		jtag_command_queue_reset();
+		return ERROR_FAIL;
+	}
+
+	int retval = ERROR_OK;
+	if (!model->enabled)
+		retval = adapter_driver->jtag_ops->execute_queue();
+
+	stats->queues++;
+	stats->commands += count;
+	stats->recorded_us += replay_read_u32(reader);
+	int recorded_retval = replay_read_u32(reader);
+	if (retval != ERROR_OK || recorded_retval != ERROR_OK)
+		stats->failures++;
+
+	for (struct jtag_command *cmd = jtag_command_queue; cmd; cmd = cmd->next) {
+		if (cmd->type != JTAG_SCAN)
+			continue;
+		for (int i = 0; i < cmd->cmd.scan->num_fields; i++) {
+			struct scan_field *field = &cmd->cmd.scan->fields[i];
+			if (!field->in_value)
+				continue;
+			uint8_t *captured = replay_read_bits(reader, field->num_bits);
+			if (!model->enabled && retval == ERROR_OK && recorded_retval == ERROR_OK
+					&& buf_cmp(captured, field->in_value, field->num_bits))
+				stats->mismatches++;
+		}
+	}
+
+	jtag_command_queue_reset();
+	return reader->error ? ERROR_FAIL : ERROR_OK;
+}
+
+static int replay_swd(struct replay_reader *reader, uint8_t tag, struct replay_model *model,
+		struct replay_stats *stats)
+{
+	const struct swd_driver *swd = adapter_driver ? adapter_driver->swd_ops : NULL;
+	int retval = ERROR_OK;
+
+	switch (tag) {
+	case RECORDER_SWD_SEQ: {
+		enum swd_special_seq seq = replay_read_u8(reader);
+		replay_read_u32(reader);
+		if (model->enabled) {
+			switch (seq) {
+			case LINE_RESET:
+				model->cycles += swd_seq_line_reset_len;
+				break;
+			case JTAG_TO_SWD:
+				model->cycles += swd_seq_jtag_to_swd_len;
+				break;
+			case JTAG_TO_DORMANT:
+				model->cycles += swd_seq_jtag_to_dormant_len;
+				break;
+			case SWD_TO_JTAG:
+				model->cycles += swd_seq_swd_to_jtag_len;
+				break;
+			case SWD_TO_DORMANT:
+				model->cycles += swd_seq_swd_to_dormant_len;
+				break;
+			case DORMANT_TO_SWD:
+				model->cycles += swd_seq_dormant_to_swd_len;
+				break;
+			case DORMANT_TO_JTAG:
+				model->cycles += swd_seq_dormant_to_jtag_len;
+				break;
+			}
+		} else {
+			retval = swd->switch_seq(seq);
+		}
+		break;
+	}
+	case RECORDER_SWD_READ: {
+		uint8_t cmd = replay_read_u8(reader);
+		uint32_t ap_delay_hint = replay_read_u32(reader);
+		stats->swd_transfers++;
+		if (model->enabled) {
+			/* request, turnaround, ack, data, parity, turnaround */
+			model->cycles += 46 + ap_delay_hint;
+			break;
+		}
+		if (reader->swd_read_count == reader->swd_read_size) {
+			unsigned int size = reader->swd_read_size ? reader->swd_read_size * 2 : 64;
+			uint32_t **reads = realloc(reader->swd_reads, size * sizeof(*reads));
+			if (!reads) {
+				LOG_ERROR("Out of memory");
+				return ERROR_FAIL;
+			}
+			reader->swd_reads = reads;
+			reader->swd_read_size = size;
+		}
+		uint32_t *value = cmd_queue_alloc(sizeof(uint32_t));
+		reader->swd_reads[reader->swd_read_count++] = value;
+		swd->read_reg(cmd, value, ap_delay_hint);
+		break;
+	}
+	case RECORDER_SWD_WRITE: {
+		uint8_t cmd = replay_read_u8(reader);
+		uint32_t value = replay_read_u32(reader);
+		uint32_t ap_delay_hint = replay_read_u32(reader);
+		stats->swd_transfers++;
+		if (model->enabled)
+			model->cycles += 46 + ap_delay_hint;
+		else
+			swd->write_reg(cmd, value, ap_delay_hint);
+		break;
+	}
+	case RECORDER_SWD_RUN: {
+		replay_read_u64(reader);
+		stats->recorded_us += replay_read_u32(reader);
+		int recorded_retval = replay_read_u32(reader);
+		uint32_t count = replay_read_u32(reader);
+
+		if (!model->enabled)
+			retval = swd->run();
+		stats->swd_runs++;
+		if (retval != ERROR_OK || recorded_retval != ERROR_OK)
+			stats->failures++;
+
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t value = replay_read_u32(reader);
+			if (!model->enabled && i < reader->swd_read_count && retval == ERROR_OK
+					&& recorded_retval == ERROR_OK && *reader->swd_reads[i] != value)
+				stats->mismatches++;
+		}
+		reader->swd_read_count = 0;
+		jtag_command_queue_reset();
+		/* a failed run is counted, it does not stop the replay */
+		retval = ERROR_OK;
+		break;
+	}
+	}
+
+	return reader->error ? ERROR_FAIL : retval;
+}
+
+static int jtag_recorder_replay(struct command_invocation *cmd, const char *filename,
+		struct replay_model *model)
+{
+	struct replay_reader reader = { .file = fopen(filename, "rb") };
+	struct replay_stats stats = { 0 };
+	uint8_t header[8];
+	int retval = ERROR_OK;
+
+	if (!reader.file) {
+		LOG_ERROR("Can't open \"%s\"", filename);
+		return ERROR_FAIL;
+	}
+
+	replay_read(&reader, header, sizeof(header));
+	if (reader.error || memcmp(header, RECORDER_MAGIC, strlen(RECORDER_MAGIC))
+			|| header[6] != RECORDER_VERSION) {
+		LOG_ERROR("\"%s\" is not a recording this version can replay", filename);
+		fclose(reader.file);
+		return ERROR_FAIL;
+	}
+
+	/* the replayed commands use the queue, start from an empty one */
+	if (!model->enabled && transport_is_jtag()) {
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK) {
+			fclose(reader.file);
+			return retval;
+		}
+	}
+
+	model->state = TAP_RESET;
+	int64_t start = timeval_ms();
+
+	while (retval == ERROR_OK) {
+		uint8_t tag;
+		if (fread(&tag, 1, 1, reader.file) != 1)
+			break;
+
+		switch (tag) {
+		case RECORDER_JTAG_QUEUE:
+			if (!model->enabled && (!adapter_driver->jtag_ops
+					|| !adapter_driver->jtag_ops->execute_queue)) {
+				LOG_ERROR("The recording holds JTAG queues, the adapter can't run them");
+				retval = ERROR_FAIL;
+				break;
+			}
+			retval = replay_jtag_queue(&reader, model, &stats);
+			break;
+		case RECORDER_SWD_SEQ:
+		case RECORDER_SWD_READ:
+		case RECORDER_SWD_WRITE:
+		case RECORDER_SWD_RUN:
+			if (!model->enabled && !adapter_driver->swd_ops) {
+				LOG_ERROR("The recording holds SWD operations, the adapter can't run them");
+				retval = ERROR_FAIL;
+				break;
+			}
+			retval = replay_swd(&reader, tag, model, &stats);
+			break;
+		default:
+			reader.error = true;
+			retval = ERROR_FAIL;
+			break;
+		}
+	}
+
+	int64_t elapsed_ms = timeval_ms() - start;
+	if (reader.error)
+		LOG_ERROR("\"%s\" is truncated or corrupted", filename);
+	fclose(reader.file);
+	free(reader.swd_reads);
+	/* drop what a truncated recording left in the queue */
+	jtag_command_queue_reset();
+
+	command_print(cmd, "replayed %u JTAG queues (%u commands, %" PRIu64 " scan bits), "
+			"%u SWD runs (%u transfers)",
+			stats.queues, stats.commands, stats.scan_bits,
+			stats.swd_runs, stats.swd_transfers);
+	command_print(cmd, "adapter time when recorded: %" PRIu64 " ms",
+			stats.recorded_us / 1000);
+	if (model->enabled) {
+		uint64_t model_us = model->cycles * 1000 / model->khz + model->sleep_us
+			+ (uint64_t)(stats.queues + stats.swd_runs) * model->latency_us;
+		command_print(cmd, "modelled adapter time: %" PRIu64 " ms "
+				"(%" PRIu64 " clock cycles at %u kHz), replay took %" PRId64 " ms",
+				model_us / 1000, model->cycles, model->khz, elapsed_ms);
+	} else {
+		command_print(cmd, "replay took %" PRId64 " ms", elapsed_ms);
+		command_print(cmd, "%u failed queues or runs, %u captured values differ",
+				stats.failures, stats.mismatches);
+	}
+
+	return retval;
+}
+
+COMMAND_HANDLER(handle_adapter_record_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!strcmp(CMD_ARGV[0], "off")) {
+		jtag_recorder_stop();
+		return ERROR_OK;
+	}
+
+	return jtag_recorder_start(CMD_ARGV[0]);
+}
+
+COMMAND_HANDLER(handle_adapter_replay_command)
+{
+	struct replay_model model = { 0 };
+
+	if (CMD_ARGC != 1 && CMD_ARGC != 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 3) {
+		model.enabled = true;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], model.khz);
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[2], model.latency_us);
+		if (model.khz == 0) {
+			command_print(CMD, "the modelled clock can't be 0 kHz");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	} else if (!is_adapter_initialized()) {
+		command_print(CMD, "replay needs an initialized adapter, or a timing model");
+		return ERROR_FAIL;
+	}
+
+	if (jtag_recorder_is_active()) {
+		command_print(CMD, "can't replay while recording");
+		return ERROR_FAIL;
+	}
+
+	return jtag_recorder_replay(CMD, CMD_ARGV[0], &model);
+}
+
+const struct command_registration jtag_recorder_command_handlers[] = {
+	{
+		.name = "record",
+		.handler = handle_adapter_record_command,
+		.mode = COMMAND_ANY,
+		.help = "Record the JTAG queues and SWD operations handed to "
+			"the adapter driver to a file, or stop recording.",
+		.usage = "filename|off",
+	},
+	{
+		.name = "replay",
+		.handler = handle_adapter_replay_command,
+		.mode = COMMAND_ANY,
+		.help = "Play a recording back through the adapter driver, or "
+			"through a timing model of the given clock and latency.",
+		.usage = "filename [khz latency_us]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/**
+ * @file
+ * Recorder of the traffic crossing the adapter driver boundary, and its
+ * offline replay.
+ *
+ * The recorder writes every JTAG command queue handed to the adapter
+ * driver, and every operation of its SWD driver, with timestamps and the
+ * data captured back, to a compact binary file. A recording can be played
+ * back through any adapter driver, or through a simple timing model, to
+ * benchmark queue handling without the original board.
+ */
+
+#ifndef OPENOCD_JTAG_RECORDER_H
+#define OPENOCD_JTAG_RECORDER_H
+
+#include <stdbool.h>
+
+struct jtag_command;
+struct swd_driver;
+
+/** @returns true while a recording is being written. */
+bool jtag_recorder_is_active(void);
+
+/**
+ * Record a command queue about to be handed to the adapter driver.
+ * Must be followed by jtag_recorder_queue_done() once the queue completed.
+ */
+void jtag_recorder_queue(const struct jtag_command *cmd);
+/** Record the result and the captured data of the recorded queue @a cmd. */
+void jtag_recorder_queue_done(const struct jtag_command *cmd, int retval);
+
+/**
+ * @returns the SWD driver to use in place of @a swd: a recording wrapper
+ * when the recording was started before the adapter init, else @a swd.
+ */
+const struct swd_driver *jtag_recorder_swd_driver(const struct swd_driver *swd);
+
+/** Close the recording, if any. */
+void jtag_recorder_stop(void);
+
+extern const struct command_registration jtag_recorder_command_handlers[];
+
+#endif /* OPENOCD_JTAG_RECORDER_H */
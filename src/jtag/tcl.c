@@ -215,6 +215,71 @@ COMMAND_HANDLER(handle_jtag_flush_count)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_jtag_ir_cache_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		jtag_set_ir_cache(enable);
+	}
+
+	uint64_t hits, misses;
+	jtag_get_ir_cache_stats(&hits, &misses);
+
+	const char *status = jtag_will_cache_ir() ? "enabled" : "disabled";
+	command_print(CMD, "jtag IR cache is %s, %" PRIu64 " hits, %" PRIu64
+		" misses", status, hits, misses);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_jtag_optimize_queue_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		jtag_set_optimize_queue(enable);
+	}
+
+	uint64_t commands, bits;
+	jtag_get_optimize_queue_stats(&commands, &bits);
+
+	const char *status = jtag_will_optimize_queue() ? "enabled" : "disabled";
+	command_print(CMD, "jtag queue optimization is %s, removed %" PRIu64
+		" commands and %" PRIu64 " scan bits", status, commands, bits);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_jtag_queue_stats)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct cmd_queue_stats stats;
+	cmd_queue_get_stats(&stats);
+
+	uint64_t page_requests = stats.page_allocs + stats.page_reuses;
+	unsigned int reuse_rate = page_requests ?
+		(unsigned int)((stats.page_reuses * 100) / page_requests) : 0;
+
+	command_print(CMD, "pages:           %u", stats.pages);
+	command_print(CMD, "bytes allocated: %zu", stats.bytes_allocated);
+	command_print(CMD, "bytes used:      %zu (peak %zu)",
+		stats.bytes_used, stats.bytes_used_max);
+	command_print(CMD, "queue resets:    %" PRIu64, stats.resets);
+	command_print(CMD, "page reuse rate: %u%% (%" PRIu64 " reused, %" PRIu64 " allocated)",
+		reuse_rate, stats.page_reuses, stats.page_allocs);
+
+	return ERROR_OK;
+}
+
 /* REVISIT Just what about these should "move" ... ?
  * These registrations, into the main JTAG table?
  *
@@ -801,6 +866,32 @@ static const struct command_registration jtag_subcommand_handlers[] = {
 		.help = "Returns list of all JTAG tap names.",
 		.usage = "",
 	},
+	{
+		.name = "ir_cache",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_ir_cache_command,
+		.help = "Display or assign flag controlling whether to "
+			"skip IR scans loading the instruction already "
+			"held by the TAP.",
+		.usage = "['enable'|'disable']",
+	},
+	{
+		.name = "optimize_queue",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_optimize_queue_command,
+		.help = "Display or assign flag controlling whether to "
+			"remove redundant commands from the JTAG queue "
+			"before sending it to the adapter.",
+		.usage = "['enable'|'disable']",
+	},
+	{
+		.name = "queue_stats",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_queue_stats,
+		.help = "Report memory usage and page reuse of the "
+			"JTAG command queue.",
+		.usage = "",
+	},
 	{
 		.chain = jtag_command_handlers_to_move,
 	},
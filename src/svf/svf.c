@@ -210,6 +210,7 @@ static int svf_check_tdo(void);
 static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len);
 static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str);
 static int svf_execute_tap(void);
+static int svf_wait_tap(void);
 
 static FILE *svf_fd;
 static char *svf_read_line;
@@ -217,6 +218,8 @@ static size_t svf_read_line_size;
 static char *svf_command_buffer;
 static size_t svf_command_buffer_size;
 static int svf_line_number;
+/* last line of the part sent in the background by svf_execute_tap(), or 0 */
+static int svf_async_line;
 static int svf_getline(char **lineptr, size_t *n, FILE *stream);
 
 #define SVF_MAX_BUFFER_SIZE_TO_COMMIT   (1024 * 1024)
@@ -485,6 +488,7 @@ COMMAND_HANDLER(handle_svf_command)
 
 	/* init */
 	svf_line_number = 0;
+	svf_async_line = 0;
 	svf_command_buffer_size = 0;
 
 	svf_check_tdo_para_index = 0;
@@ -594,7 +598,9 @@ COMMAND_HANDLER(handle_svf_command)
 		command_num++;
 	}
 
-	if ((!svf_nil) && (jtag_execute_queue() != ERROR_OK))
+	if (svf_wait_tap() != ERROR_OK)
+		ret = ERROR_FAIL;
+	else if ((!svf_nil) && (jtag_execute_queue() != ERROR_OK))
 		ret = ERROR_FAIL;
 	else if (svf_check_tdo() != ERROR_OK)
 		ret = ERROR_FAIL;
@@ -967,8 +973,36 @@ static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len)
 	return ERROR_OK;
 }
 
+/* complete the part sent in the background, and report its failure */
+static int svf_wait_tap(void)
+{
+	int line = svf_async_line;
+
+	if (!line)
+		return ERROR_OK;
+
+	svf_async_line = 0;
+	if (jtag_wait_queue() != ERROR_OK) {
+		LOG_ERROR("fail to run the commands up to line %d", line);
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
 static int svf_execute_tap(void)
 {
+	if (svf_wait_tap() != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (!svf_nil && !svf_check_tdo_para_index) {
+		/* nothing to check, build the next queue while this one runs */
+		jtag_execute_queue_async();
+		svf_async_line = svf_line_number;
+		svf_buffer_index = 0;
+		return ERROR_OK;
+	}
+
 	if ((!svf_nil) && (jtag_execute_queue() != ERROR_OK))
 		return ERROR_FAIL;
 	else if (svf_check_tdo() != ERROR_OK)
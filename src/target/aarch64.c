@@ -502,14 +502,45 @@ static int update_halt_gdb(struct target *target, enum target_debug_reason debug
  * Aarch64 Run control
  */
 
+static int aarch64_poll_queue(struct target *target)
+{
+	struct aarch64_common *aarch64 = target_to_aarch64(target);
+	struct armv8_common *armv8 = &aarch64->armv8_common;
+
+	return mem_ap_read_u32_poll_batch(armv8->debug_ap,
+			armv8->debug_base + CPUV8_DBG_PRSR, &aarch64->poll_prsr);
+}
+
+static int aarch64_poll_queue_drop(struct target *target)
+{
+	struct armv8_common *armv8 = target_to_armv8(target);
+
+	return dap_poll_batch_run(armv8->debug_ap->dap);
+}
+
 static int aarch64_poll(struct target *target)
 {
 	enum target_state prev_target_state;
 	int retval = ERROR_OK;
 	int halted;
 
-	retval = aarch64_check_state_one(target,
-				PRSR_HALT, PRSR_HALT, &halted, NULL);
+	if (target->poll_queued) {
+		/* queued along with the other targets by aarch64_poll_queue() */
+		struct aarch64_common *aarch64 = target_to_aarch64(target);
+
+		target->poll_queued = false;
+		retval = dap_poll_batch_run(aarch64->armv8_common.debug_ap->dap);
+		if (retval == ERROR_OK) {
+			halted = (aarch64->poll_prsr & PRSR_HALT) == PRSR_HALT;
+		} else {
+			/* the failing read may be another target's */
+			retval = aarch64_check_state_one(target,
+						PRSR_HALT, PRSR_HALT, &halted, NULL);
+		}
+	} else {
+		retval = aarch64_check_state_one(target,
+					PRSR_HALT, PRSR_HALT, &halted, NULL);
+	}
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -521,6 +552,9 @@ static int aarch64_poll(struct target *target)
 			/* We have a halting debug event */
 			target->state = TARGET_HALTED;
 			LOG_DEBUG("Target %s halted", target_name(target));
+
+			/* the SMP siblings get halted, their batched status is stale */
+			target_poll_batch_drop();
 			retval = aarch64_debug_entry(target);
 			if (retval != ERROR_OK)
 				return retval;
@@ -3214,6 +3248,8 @@ struct target_type aarch64_target = {
 	.name = "aarch64",
 
 	.poll = aarch64_poll,
+	.poll_queue = aarch64_poll_queue,
+	.poll_queue_drop = aarch64_poll_queue_drop,
 	.arch_state = armv8_arch_state,
 
 	.halt = aarch64_halt,
@@ -3255,6 +3291,8 @@ struct target_type armv8r_target = {
 	.name = "armv8r",
 
 	.poll = aarch64_poll,
+	.poll_queue = aarch64_poll_queue,
+	.poll_queue_drop = aarch64_poll_queue_drop,
 	.arch_state = armv8_arch_state,
 
 	.halt = aarch64_halt,
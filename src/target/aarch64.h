@@ -58,6 +58,9 @@ struct aarch64_common {
 	struct aarch64_brp *wp_list;
 
 	enum aarch64_isrmasking_mode isrmasking_mode;
+
+	/* PRSR read by aarch64_poll_queue() */
+	uint32_t poll_prsr;
 };
 
 static inline struct aarch64_common *
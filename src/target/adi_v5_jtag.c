@@ -109,7 +109,6 @@ static const char *dap_reg_name(struct adiv5_dap *dap, uint8_t instr, uint16_t r
 #endif
 
 struct dap_cmd {
-	struct list_head lh;
 	uint8_t instr;
 	uint16_t reg_addr;
 	uint8_t rnw;
@@ -117,6 +116,8 @@ struct dap_cmd {
 	uint8_t ack;
 	uint32_t memaccess_tck;
 	uint64_t dp_select;
+	/* AP accessed by an APACC command, NULL otherwise */
+	struct adiv5_ap *ap;
 
 	struct scan_field fields[2];
 	uint8_t out_addr_buf;
@@ -124,12 +125,23 @@ struct dap_cmd {
 	uint8_t outvalue_buf[4];
 };
 
-#define MAX_DAP_COMMAND_NUM 65536
+/*
+ * The commands queued since the last run are kept, in order, in a ring
+ * allocated once per DAP: the JTAG layer keeps pointers in them until the
+ * queue is executed, and they are needed again to replay the queue after
+ * a WAIT. The queue is run before the ring is full; a queued access can
+ * add a few commands (DP SELECT, SELECT1, the access, the final RDBUFF).
+ * During long transfers, the first half of the ring is sent to the adapter
+ * in the background while the second half is queued, see
+ * jtag_limit_queue_size().
+ */
+#define MAX_DAP_COMMAND_NUM 4096
+#define DAP_COMMAND_MARGIN 8
+#define DAP_COMMAND_ASYNC_NUM (MAX_DAP_COMMAND_NUM / 2)
 
-struct dap_cmd_pool {
-	struct list_head lh;
-	struct dap_cmd cmd;
-};
+/* Limits of the extra idle cycles added after AP accesses on WAIT */
+#define WAIT_TCK_MIN 8
+#define WAIT_TCK_MAX 256
 
 static void log_dap_cmd(struct adiv5_dap *dap, const char *header, struct dap_cmd *el)
 {
@@ -166,12 +178,25 @@ static void log_dap_cmd(struct adiv5_dap *dap, const char *header, struct dap_cm
 #endif
 }
 
-static int jtag_limit_queue_size(struct adiv5_dap *dap)
+static void dap_cmd_init(struct dap_cmd *cmd, uint8_t instr,
+		uint16_t reg_addr, uint8_t rnw,
+		uint8_t *outvalue, uint8_t *invalue,
+		uint32_t memaccess_tck)
 {
-	if (dap->cmd_pool_size < MAX_DAP_COMMAND_NUM)
-		return ERROR_OK;
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->instr = instr;
+	cmd->reg_addr = reg_addr;
+	cmd->rnw = rnw;
+	if (outvalue)
+		memcpy(cmd->outvalue_buf, outvalue, 4);
+	cmd->invalue = (invalue) ? invalue : cmd->invalue_buf;
+	cmd->memaccess_tck = memaccess_tck;
+}
 
-	return dap_run(dap);
+/* Return the i-th oldest queued command */
+static struct dap_cmd *dap_cmd_at(struct adiv5_dap *dap, size_t i)
+{
+	return &dap->cmd_ring[(dap->cmd_ring_head + i) % MAX_DAP_COMMAND_NUM];
 }
 
 static struct dap_cmd *dap_cmd_new(struct adiv5_dap *dap, uint8_t instr,
@@ -179,64 +204,47 @@ static struct dap_cmd *dap_cmd_new(struct adiv5_dap *dap, uint8_t instr,
 		uint8_t *outvalue, uint8_t *invalue,
 		uint32_t memaccess_tck)
 {
-
-	struct dap_cmd_pool *pool = NULL;
-
-	if (list_empty(&dap->cmd_pool)) {
-		pool = calloc(1, sizeof(struct dap_cmd_pool));
-		if (!pool)
+	if (!dap->cmd_ring) {
+		dap->cmd_ring = calloc(MAX_DAP_COMMAND_NUM, sizeof(struct dap_cmd));
+		if (!dap->cmd_ring) {
+			LOG_ERROR("Out of memory");
 			return NULL;
-	} else {
-		pool = list_first_entry(&dap->cmd_pool, struct dap_cmd_pool, lh);
-		list_del(&pool->lh);
+		}
+		dap->cmd_ring_head = 0;
+		dap->cmd_ring_count = 0;
 	}
 
-	INIT_LIST_HEAD(&pool->lh);
-	dap->cmd_pool_size++;
+	if (dap->cmd_ring_count == MAX_DAP_COMMAND_NUM) {
+		LOG_ERROR("BUG: DAP command queue full");
+		return NULL;
+	}
 
-	struct dap_cmd *cmd = &pool->cmd;
-	INIT_LIST_HEAD(&cmd->lh);
-	cmd->instr = instr;
-	cmd->reg_addr = reg_addr;
-	cmd->rnw = rnw;
-	if (outvalue)
-		memcpy(cmd->outvalue_buf, outvalue, 4);
-	cmd->invalue = (invalue) ? invalue : cmd->invalue_buf;
-	cmd->memaccess_tck = memaccess_tck;
+	struct dap_cmd *cmd = dap_cmd_at(dap, dap->cmd_ring_count++);
+	dap_cmd_init(cmd, instr, reg_addr, rnw, outvalue, invalue, memaccess_tck);
 
 	return cmd;
 }
 
-static void dap_cmd_release(struct adiv5_dap *dap, struct dap_cmd *cmd)
+/* Drop the n oldest queued commands, that are complete */
+static void dap_cmd_retire(struct adiv5_dap *dap, size_t n)
 {
-	struct dap_cmd_pool *pool = container_of(cmd, struct dap_cmd_pool, cmd);
-	if (dap->cmd_pool_size > MAX_DAP_COMMAND_NUM)
-		free(pool);
-	else
-		list_add(&pool->lh, &dap->cmd_pool);
-
-	dap->cmd_pool_size--;
+	dap->cmd_ring_head = (dap->cmd_ring_head + n) % MAX_DAP_COMMAND_NUM;
+	dap->cmd_ring_count -= n;
 }
 
-static void flush_journal(struct adiv5_dap *dap, struct list_head *lh)
+static void flush_journal(struct adiv5_dap *dap)
 {
-	struct dap_cmd *el, *tmp;
-
-	list_for_each_entry_safe(el, tmp, lh, lh) {
-		list_del(&el->lh);
-		dap_cmd_release(dap, el);
-	}
+	dap_cmd_retire(dap, dap->cmd_ring_count);
+	dap->cmd_ring_in_flight = 0;
 }
 
 static void jtag_quit(struct adiv5_dap *dap)
 {
-	struct dap_cmd_pool *el, *tmp;
-	struct list_head *lh = &dap->cmd_pool;
-
-	list_for_each_entry_safe(el, tmp, lh, lh) {
-		list_del(&el->lh);
-		free(el);
-	}
+	free(dap->cmd_ring);
+	dap->cmd_ring = NULL;
+	dap->cmd_ring_head = 0;
+	dap->cmd_ring_count = 0;
+	dap->cmd_ring_in_flight = 0;
 }
 
 /***************************************************************************
@@ -331,8 +339,8 @@ static int adi_jtag_dp_scan(struct adiv5_dap *dap,
 		return ERROR_JTAG_DEVICE_ERROR;
 
 	retval = adi_jtag_dp_scan_cmd(dap, cmd, ack);
-	if (retval == ERROR_OK)
-		list_add_tail(&cmd->lh,	&dap->cmd_journal);
+	if (retval != ERROR_OK)
+		dap->cmd_ring_count--;
 
 	return retval;
 }
@@ -417,221 +425,316 @@ static int adi_jtag_scan_inout_check_u32(struct adiv5_dap *dap,
 	return jtag_execute_queue();
 }
 
-static int jtagdp_overrun_check(struct adiv5_dap *dap)
+/*
+ * JTAG_ACK_OK_FAULT (ADIv5) and JTAG_ACK_FAULT (ADIv6) are equal so this is
+ * checking to see if an acknowledgment of OK or FAULT is generated for ADIv5
+ * or ADIv6
+ */
+static bool dap_cmd_ack_ok(struct adiv5_dap *dap, struct dap_cmd *el)
 {
-	int retval;
-	struct dap_cmd *el, *tmp, *prev = NULL;
-	int found_wait = 0;
-	int64_t time_now;
-	LIST_HEAD(replay_list);
+	return el->ack == JTAG_ACK_OK_FAULT || (is_adiv6(dap) && el->ack == JTAG_ACK_OK);
+}
 
-	/* make sure all queued transactions are complete */
-	retval = jtag_execute_queue();
-	if (retval != ERROR_OK)
-		goto done;
+/*
+ * Hand the queued commands to the adapter without waiting for them, so
+ * that the next ones are queued while they are on the wire. Only when
+ * the last queued command is a write: the result of a read comes with
+ * the next command, and a WAIT on that one could not recover it once the
+ * read is retired.
+ */
+static void jtagdp_start_async(struct adiv5_dap *dap)
+{
+	if (dap->cmd_ring_in_flight || dap->cmd_ring_count < DAP_COMMAND_ASYNC_NUM)
+		return;
 
-	/* skip all completed transactions up to the first WAIT */
-	list_for_each_entry(el, &dap->cmd_journal, lh) {
-		/*
-		 * JTAG_ACK_OK_FAULT (ADIv5) and JTAG_ACK_FAULT (ADIv6) are equal so
-		 * the following statement is checking to see if an acknowledgment of
-		 * OK or FAULT is generated for ADIv5 or ADIv6
-		 */
-		if (el->ack == JTAG_ACK_OK_FAULT || (is_adiv6(dap) && el->ack == JTAG_ACK_OK)) {
-			log_dap_cmd(dap, "LOG", el);
-		} else if (el->ack == JTAG_ACK_WAIT) {
-			found_wait = 1;
-			break;
-		} else {
-			LOG_ERROR("Invalid ACK (%1x) in DAP response", el->ack);
-			log_dap_cmd(dap, "ERR", el);
-			retval = ERROR_JTAG_DEVICE_ERROR;
-			goto done;
+	if (dap->last_read || dap_cmd_at(dap, dap->cmd_ring_count - 1)->rnw != DPAP_WRITE)
+		return;
+
+	jtag_execute_queue_async();
+	dap->cmd_ring_in_flight = dap->cmd_ring_count;
+}
+
+/*
+ * Complete the commands sent by jtagdp_start_async() and retire them if
+ * they all got OK. Otherwise leave them in the ring: dap_run() then gets
+ * the WAIT replayed, together with the commands queued after, that the
+ * DAP ignored because of the sticky overrun.
+ */
+static void jtagdp_finish_async(struct adiv5_dap *dap)
+{
+	size_t n = dap->cmd_ring_in_flight;
+
+	dap->cmd_ring_in_flight = 0;
+
+	int retval = jtag_wait_queue();
+	if (retval != ERROR_OK) {
+		/* report it from dap_run() */
+		jtag_set_error(retval);
+		return;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (!dap_cmd_ack_ok(dap, dap_cmd_at(dap, i)))
+			return;
+	}
+
+	dap_cmd_retire(dap, n);
+}
+
+static int jtag_limit_queue_size(struct adiv5_dap *dap)
+{
+	if (dap->cmd_ring_count + DAP_COMMAND_MARGIN >= MAX_DAP_COMMAND_NUM &&
+			dap->cmd_ring_in_flight)
+		jtagdp_finish_async(dap);
+
+	if (dap->cmd_ring_count + DAP_COMMAND_MARGIN < MAX_DAP_COMMAND_NUM) {
+		jtagdp_start_async(dap);
+		return ERROR_OK;
+	}
+
+	return dap_run(dap);
+}
+
+/* Synchronous write of a DP register that is not kept in the journal */
+static int jtagdp_recovery_write(struct adiv5_dap *dap, unsigned int reg, uint32_t value)
+{
+	size_t count = dap->cmd_ring_count;
+
+	int retval = adi_jtag_scan_inout_check_u32(dap, JTAG_DP_DPACC,
+			reg, DPAP_WRITE, value, NULL, 0);
+	dap->cmd_ring_count = count;
+	return retval;
+}
+
+/*
+ * The read before the stalled command @a el is still pending: collect its
+ * result, either from a later command that completed or by polling RDBUFF.
+ */
+static int jtagdp_recover_pending_read(struct adiv5_dap *dap, size_t wait_idx)
+{
+	struct dap_cmd *el = dap_cmd_at(dap, wait_idx);
+	int64_t time_now;
+	int retval = ERROR_OK;
+
+	log_dap_cmd(dap, "PND", dap_cmd_at(dap, wait_idx - 1));
+
+	/* search for the next OK transaction, it contains
+	 * the result of the previous READ */
+	for (size_t i = wait_idx + 1; i < dap->cmd_ring_count; i++) {
+		struct dap_cmd *tmp = dap_cmd_at(dap, i);
+		if (dap_cmd_ack_ok(dap, tmp)) {
+			/* recover the read value */
+			log_dap_cmd(dap, "FND", tmp);
+			if (el->invalue != el->invalue_buf) {
+				uint32_t invalue = le_to_h_u32(tmp->invalue);
+				memcpy(el->invalue, &invalue, sizeof(uint32_t));
+			}
+			return ERROR_OK;
 		}
 	}
 
+	log_dap_cmd(dap, "LST", el);
+
 	/*
-	 * If we found a stalled transaction and a previous transaction
-	 * exists, check if it's a READ access.
+	 * At this point we're sure that no previous
+	 * transaction completed and the DAP/AP is still
+	 * in busy state. We know that the next "OK" scan
+	 * will return the READ result we need to recover.
+	 * To complete the READ, we just keep polling RDBUFF
+	 * until the WAIT condition clears
 	 */
-	if (found_wait && el != list_first_entry(&dap->cmd_journal, struct dap_cmd, lh)) {
-		prev = list_entry(el->lh.prev, struct dap_cmd, lh);
-		if (prev->rnw == DPAP_READ) {
-			log_dap_cmd(dap, "PND", prev);
-			/* search for the next OK transaction, it contains
-			 * the result of the previous READ */
-			tmp = el;
-			list_for_each_entry_from(tmp, &dap->cmd_journal, lh) {
-				/* The following check covers OK and FAULT ACKs for both ADIv5 and ADIv6 */
-				if (tmp->ack == JTAG_ACK_OK_FAULT || (is_adiv6(dap) && tmp->ack == JTAG_ACK_OK)) {
-					/* recover the read value */
-					log_dap_cmd(dap, "FND", tmp);
-					if (el->invalue != el->invalue_buf) {
-						uint32_t invalue = le_to_h_u32(tmp->invalue);
-						memcpy(el->invalue, &invalue, sizeof(uint32_t));
-					}
-					prev = NULL;
-					break;
-				}
+	struct dap_cmd tmp;
+	dap_cmd_init(&tmp, JTAG_DP_DPACC, DP_RDBUFF, DPAP_READ, NULL, NULL, 0);
+
+	/* synchronously retry the command until it succeeds */
+	time_now = timeval_ms();
+	do {
+		retval = adi_jtag_dp_scan_cmd_sync(dap, &tmp, NULL);
+		if (retval != ERROR_OK)
+			break;
+		if (dap_cmd_ack_ok(dap, &tmp)) {
+			log_dap_cmd(dap, "FND", &tmp);
+			if (el->invalue != el->invalue_buf) {
+				uint32_t invalue = le_to_h_u32(tmp.invalue);
+				memcpy(el->invalue, &invalue, sizeof(uint32_t));
 			}
+			break;
+		}
+		if (tmp.ack != JTAG_ACK_WAIT) {
+			LOG_ERROR("Invalid ACK (%1x) in DAP response", tmp.ack);
+			log_dap_cmd(dap, "ERR", &tmp);
+			retval = ERROR_JTAG_DEVICE_ERROR;
+			break;
+		}
 
-			if (prev) {
-				log_dap_cmd(dap, "LST", el);
-
-				/*
-				* At this point we're sure that no previous
-				* transaction completed and the DAP/AP is still
-				* in busy state. We know that the next "OK" scan
-				* will return the READ result we need to recover.
-				* To complete the READ, we just keep polling RDBUFF
-				* until the WAIT condition clears
-				*/
-				tmp = dap_cmd_new(dap, JTAG_DP_DPACC,
-						DP_RDBUFF, DPAP_READ, NULL, NULL, 0);
-				if (!tmp) {
-					retval = ERROR_JTAG_DEVICE_ERROR;
-					goto done;
-				}
-				/* synchronously retry the command until it succeeds */
-				time_now = timeval_ms();
-				do {
-					retval = adi_jtag_dp_scan_cmd_sync(dap, tmp, NULL);
-					if (retval != ERROR_OK)
-						break;
-					/* The following check covers OK and FAULT ACKs for both ADIv5 and ADIv6 */
-					if (tmp->ack == JTAG_ACK_OK_FAULT || (is_adiv6(dap) && tmp->ack == JTAG_ACK_OK)) {
-						log_dap_cmd(dap, "FND", tmp);
-						if (el->invalue != el->invalue_buf) {
-							uint32_t invalue = le_to_h_u32(tmp->invalue);
-							memcpy(el->invalue, &invalue, sizeof(uint32_t));
-						}
-						break;
-					}
-					if (tmp->ack != JTAG_ACK_WAIT) {
-						LOG_ERROR("Invalid ACK (%1x) in DAP response", tmp->ack);
-						log_dap_cmd(dap, "ERR", tmp);
-						retval = ERROR_JTAG_DEVICE_ERROR;
-						break;
-					}
-
-				} while (timeval_ms() - time_now < 1000);
-
-				if (retval == ERROR_OK) {
-					/* timeout happened */
-					if (tmp->ack == JTAG_ACK_WAIT) {
-						LOG_ERROR("Timeout during WAIT recovery");
-						dap->select = DP_SELECT_INVALID;
-						jtag_ap_q_abort(dap, NULL);
-						/* clear the sticky overrun condition */
-						adi_jtag_scan_inout_check_u32(dap, JTAG_DP_DPACC,
-							DP_CTRL_STAT, DPAP_WRITE,
-							dap->dp_ctrl_stat | SSTICKYORUN, NULL, 0);
-						retval = ERROR_JTAG_DEVICE_ERROR;
-					}
-				}
+	} while (timeval_ms() - time_now < 1000);
 
-				/* we're done with this command, release it */
-				dap_cmd_release(dap, tmp);
+	if (retval == ERROR_OK && tmp.ack == JTAG_ACK_WAIT) {
+		/* timeout happened */
+		LOG_ERROR("Timeout during WAIT recovery");
+		dap->select = DP_SELECT_INVALID;
+		jtag_ap_q_abort(dap, NULL);
+		/* clear the sticky overrun condition */
+		jtagdp_recovery_write(dap, DP_CTRL_STAT, dap->dp_ctrl_stat | SSTICKYORUN);
+		retval = ERROR_JTAG_DEVICE_ERROR;
+	}
 
-				if (retval != ERROR_OK)
-					goto done;
+	return retval;
+}
+
+/*
+ * Slow down the accesses to the AP that stalled: the extra idle cycles are
+ * doubled at each WAIT, and lowered back by one at each run without WAIT.
+ */
+static void jtagdp_wait_tck_raise(struct adiv5_ap *ap)
+{
+	if (!ap)
+		return;
+
+	ap->wait_tck = MIN(MAX(2 * ap->wait_tck, WAIT_TCK_MIN), WAIT_TCK_MAX);
+	LOG_DEBUG("AP # 0x%" PRIx64 ": %" PRIu32 " extra tck after WAIT",
+		ap->ap_num, ap->wait_tck);
+}
+
+static void jtagdp_wait_tck_lower(struct adiv5_dap *dap)
+{
+	dap->wait_tck_run++;
+
+	for (size_t i = 0; i < dap->cmd_ring_count; i++) {
+		struct adiv5_ap *ap = dap_cmd_at(dap, i)->ap;
+		if (ap && ap->wait_tck && ap->wait_tck_run != dap->wait_tck_run) {
+			ap->wait_tck--;
+			ap->wait_tck_run = dap->wait_tck_run;
+		}
+	}
+}
+
+static int jtagdp_overrun_check(struct adiv5_dap *dap)
+{
+	int retval;
+	struct dap_cmd *el;
+	struct dap_cmd select_cmd;
+	bool replay = false;
+	int64_t time_start = 0;
+
+	/* make sure all queued transactions are complete */
+	retval = jtag_execute_queue();
+	dap->cmd_ring_in_flight = 0;
+	if (retval != ERROR_OK)
+		goto done;
 
+	while (true) {
+		size_t wait_idx;
+
+		/* skip all completed transactions up to the first WAIT */
+		for (wait_idx = 0; wait_idx < dap->cmd_ring_count; wait_idx++) {
+			el = dap_cmd_at(dap, wait_idx);
+			if (dap_cmd_ack_ok(dap, el)) {
+				log_dap_cmd(dap, replay ? "REC" : "LOG", el);
+				/* replayed commands have no endianness callback */
+				if (replay && el->invalue != el->invalue_buf) {
+					uint32_t invalue = le_to_h_u32(el->invalue);
+					memcpy(el->invalue, &invalue, sizeof(uint32_t));
+				}
+			} else if (el->ack == JTAG_ACK_WAIT) {
+				break;
+			} else {
+				LOG_ERROR("Invalid ACK (%1x) in DAP response", el->ack);
+				log_dap_cmd(dap, "ERR", el);
+				retval = ERROR_JTAG_DEVICE_ERROR;
+				goto done;
 			}
+		}
+
+		if (wait_idx == dap->cmd_ring_count) {
+			if (!replay)
+				jtagdp_wait_tck_lower(dap);
+			break;
+		}
+
+		if (!replay) {
+			LOG_INFO("DAP transaction stalled (WAIT) - slowing down and resending");
+			time_start = timeval_ms();
+		} else if (timeval_ms() - time_start >= 1000) {
+			LOG_ERROR("Timeout during WAIT recovery");
+			dap->select = DP_SELECT_INVALID;
+			jtag_ap_q_abort(dap, NULL);
+			/* clear the sticky overrun condition */
+			jtagdp_recovery_write(dap, DP_CTRL_STAT, dap->dp_ctrl_stat | SSTICKYORUN);
+			retval = ERROR_JTAG_DEVICE_ERROR;
+			goto done;
+		} else {
+			LOG_DEBUG("DAP transaction stalled during replay (WAIT) - resending");
+		}
+
+		/*
+		 * If a previous transaction exists, check if it's a READ access.
+		 * The first replayed transaction follows a SELECT write.
+		 */
+		struct dap_cmd *prev = wait_idx ? dap_cmd_at(dap, wait_idx - 1) : NULL;
+		if (prev && prev->rnw == DPAP_READ) {
+			retval = jtagdp_recover_pending_read(dap, wait_idx);
+			if (retval != ERROR_OK)
+				goto done;
 			/* make el->invalue point to the default invalue
 			* so that we can safely retry it without clobbering
 			* the result we just recovered */
 			el->invalue = el->invalue_buf;
 		}
-	}
 
-	/* move all remaining transactions over to the replay list */
-	list_for_each_entry_safe_from(el, tmp, &dap->cmd_journal, lh) {
-		log_dap_cmd(dap, "REP", el);
-		list_move_tail(&el->lh, &replay_list);
-	}
+		jtagdp_wait_tck_raise(el->ap ? el->ap : prev ? prev->ap : NULL);
 
-	/* we're done with the journal, flush it */
-	flush_journal(dap, &dap->cmd_journal);
+		/* the transactions before the WAIT are complete */
+		dap_cmd_retire(dap, wait_idx);
 
-	/* check for overrun condition in the last batch of transactions */
-	if (found_wait) {
-		LOG_INFO("DAP transaction stalled (WAIT) - slowing down and resending");
 		/* clear the sticky overrun condition */
-		retval = adi_jtag_scan_inout_check_u32(dap, JTAG_DP_DPACC,
-				DP_CTRL_STAT, DPAP_WRITE,
-				dap->dp_ctrl_stat | SSTICKYORUN, NULL, 0);
+		retval = jtagdp_recovery_write(dap, DP_CTRL_STAT, dap->dp_ctrl_stat | SSTICKYORUN);
 		if (retval != ERROR_OK)
 			goto done;
 
 		/* restore SELECT register first */
-		if (!list_empty(&replay_list)) {
-			el = list_first_entry(&replay_list, struct dap_cmd, lh);
+		uint8_t out_value_buf[4];
+		el = dap_cmd_at(dap, 0);
+		buf_set_u32(out_value_buf, 0, 32, (uint32_t)(el->dp_select));
+		dap_cmd_init(&select_cmd, JTAG_DP_DPACC, DP_SELECT, DPAP_WRITE, out_value_buf, NULL, 0);
+		retval = adi_jtag_dp_scan_cmd(dap, &select_cmd, NULL);
+		if (retval != ERROR_OK)
+			goto done;
 
-			uint8_t out_value_buf[4];
-			buf_set_u32(out_value_buf, 0, 32, (uint32_t)(el->dp_select));
+		/* TODO: ADIv6 DP SELECT1 handling */
 
-			tmp = dap_cmd_new(dap, JTAG_DP_DPACC,
-					  DP_SELECT, DPAP_WRITE, out_value_buf, NULL, 0);
-			if (!tmp) {
-				retval = ERROR_JTAG_DEVICE_ERROR;
+		dap->select = DP_SELECT_INVALID;
+
+		/* resend all the remaining transactions at once */
+		for (size_t i = 0; i < dap->cmd_ring_count; i++) {
+			el = dap_cmd_at(dap, i);
+			log_dap_cmd(dap, "REP", el);
+			if (el->ap)
+				el->memaccess_tck = el->ap->memaccess_tck + el->ap->wait_tck;
+			retval = adi_jtag_dp_scan_cmd(dap, el, NULL);
+			if (retval != ERROR_OK)
 				goto done;
-			}
-			list_add(&tmp->lh, &replay_list);
+		}
 
-			/* TODO: ADIv6 DP SELECT1 handling */
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK)
+			goto done;
 
-			dap->select = DP_SELECT_INVALID;
+		if (select_cmd.ack == JTAG_ACK_WAIT) {
+			/* nothing was done, resend everything */
+			dap_cmd_at(dap, 0)->ack = JTAG_ACK_WAIT;
+		} else if (!dap_cmd_ack_ok(dap, &select_cmd)) {
+			LOG_ERROR("Invalid ACK (%1x) in DAP response", select_cmd.ack);
+			log_dap_cmd(dap, "ERR", &select_cmd);
+			retval = ERROR_JTAG_DEVICE_ERROR;
+			goto done;
 		}
 
-		list_for_each_entry_safe(el, tmp, &replay_list, lh) {
-			time_now = timeval_ms();
-			do {
-				retval = adi_jtag_dp_scan_cmd_sync(dap, el, NULL);
-				if (retval != ERROR_OK)
-					break;
-				log_dap_cmd(dap, "REC", el);
-				if (el->ack == JTAG_ACK_OK_FAULT || (is_adiv6(dap) && el->ack == JTAG_ACK_OK)) {
-					if (el->invalue != el->invalue_buf) {
-						uint32_t invalue = le_to_h_u32(el->invalue);
-						memcpy(el->invalue, &invalue, sizeof(uint32_t));
-					}
-					break;
-				}
-				if (el->ack != JTAG_ACK_WAIT) {
-					LOG_ERROR("Invalid ACK (%1x) in DAP response", el->ack);
-					log_dap_cmd(dap, "ERR", el);
-					retval = ERROR_JTAG_DEVICE_ERROR;
-					break;
-				}
-				LOG_DEBUG("DAP transaction stalled during replay (WAIT) - resending");
-				/* clear the sticky overrun condition */
-				retval = adi_jtag_scan_inout_check_u32(dap, JTAG_DP_DPACC,
-						DP_CTRL_STAT, DPAP_WRITE,
-						dap->dp_ctrl_stat | SSTICKYORUN, NULL, 0);
-				if (retval != ERROR_OK)
-					break;
-			} while (timeval_ms() - time_now < 1000);
-
-			if (retval == ERROR_OK) {
-				if (el->ack == JTAG_ACK_WAIT) {
-					LOG_ERROR("Timeout during WAIT recovery");
-					dap->select = DP_SELECT_INVALID;
-					jtag_ap_q_abort(dap, NULL);
-					/* clear the sticky overrun condition */
-					adi_jtag_scan_inout_check_u32(dap, JTAG_DP_DPACC,
-						DP_CTRL_STAT, DPAP_WRITE,
-						dap->dp_ctrl_stat | SSTICKYORUN, NULL, 0);
-					retval = ERROR_JTAG_DEVICE_ERROR;
-					break;
-				}
-			} else
-				break;
-		}
+		replay = true;
 	}
 
  done:
-	flush_journal(dap, &replay_list);
-	flush_journal(dap, &dap->cmd_journal);
+	flush_journal(dap);
 	return retval;
 }
 
@@ -680,7 +783,7 @@ static int jtagdp_transaction_endcheck(struct adiv5_dap *dap)
 	}
 
  done:
-	flush_journal(dap, &dap->cmd_journal);
+	flush_journal(dap);
 	return retval;
 }
 
@@ -801,7 +904,9 @@ static int jtag_ap_q_read(struct adiv5_ap *ap, unsigned reg,
 		return retval;
 
 	retval =  adi_jtag_dp_scan_u32(ap->dap, JTAG_DP_APACC, reg,
-			DPAP_READ, 0, ap->dap->last_read, ap->memaccess_tck, NULL);
+			DPAP_READ, 0, ap->dap->last_read, ap->memaccess_tck + ap->wait_tck, NULL);
+	if (retval == ERROR_OK)
+		dap_cmd_at(ap->dap, ap->dap->cmd_ring_count - 1)->ap = ap;
 	ap->dap->last_read = data;
 
 	return retval;
@@ -823,7 +928,9 @@ static int jtag_ap_q_write(struct adiv5_ap *ap, unsigned reg,
 		return retval;
 
 	retval =  adi_jtag_dp_scan_u32(ap->dap, JTAG_DP_APACC, reg,
-			DPAP_WRITE, data, ap->dap->last_read, ap->memaccess_tck, NULL);
+			DPAP_WRITE, data, ap->dap->last_read, ap->memaccess_tck + ap->wait_tck, NULL);
+	if (retval == ERROR_OK)
+		dap_cmd_at(ap->dap, ap->dap->cmd_ring_count - 1)->ap = ap;
 	ap->dap->last_read = NULL;
 	return retval;
 }
@@ -42,6 +42,7 @@
 #include <jtag/interface.h>
 
 #include <jtag/swd.h>
+#include <jtag/recorder.h>
 
 /* for debug, set do_sync to true to force synchronous transfers */
 static bool do_sync;
@@ -686,7 +687,7 @@ static int swd_select(struct command_context *ctx)
 {
 	/* FIXME: only place where global 'adapter_driver' is still needed */
 	extern struct adapter_driver *adapter_driver;
-	const struct swd_driver *swd = adapter_driver->swd_ops;
+	const struct swd_driver *swd = jtag_recorder_swd_driver(adapter_driver->swd_ops);
 	int retval;
 
 	retval = register_commands(ctx, NULL, swd_handlers);
@@ -187,6 +187,34 @@ static void mem_ap_update_tar_cache(struct adiv5_ap *ap)
 		ap->tar_value += inc;
 }
 
+/**
+ * Plan the next DRW transfer of a block transfer.
+ *
+ * Byte and halfword blocks are moved four bytes per DRW transfer in packed
+ * mode, when the MEM-AP supports it. Packed transfers are only started at
+ * word aligned addresses: the unaligned head of the block and its tail use
+ * single transfers. A packed transfer then never straddles a TAR
+ * auto-increment boundary, and the CSW is programmed at most three times
+ * for the whole block, whatever its alignment and length.
+ *
+ * @param ap The MEM-AP.
+ * @param size The access size requested, in bytes.
+ * @param address Address of the next transfer.
+ * @param nbytes Bytes left in the block.
+ * @param addrinc Whether the block uses address increment.
+ *
+ * @return the bytes moved by the next transfer; it is a packed transfer if
+ * this differs from @a size.
+ */
+static uint32_t mem_ap_transfer_size(struct adiv5_ap *ap, uint32_t size,
+		target_addr_t address, size_t nbytes, bool addrinc)
+{
+	if (addrinc && ap->packed_transfers && size < 4 && nbytes >= 4 && (address & 3) == 0)
+		return 4;
+
+	return size;
+}
+
 /**
  * Queue transactions setting up transfer parameters for the
  * currently selected MEM-AP.
@@ -268,6 +296,47 @@ int mem_ap_read_atomic_u32(struct adiv5_ap *ap, target_addr_t address,
 	return dap_run(ap->dap);
 }
 
+/**
+ * Queued read of a word for a batched poll of the targets. The reads queued
+ * on a DAP by all the targets are executed together by the first call to
+ * dap_poll_batch_run(), from the poll of any of them.
+ *
+ * @param ap The MEM-AP to access.
+ * @param address Address of the 32-bit word to read.
+ * @param value points to where the result will be stored.
+ *
+ * @return ERROR_OK for success. Otherwise a fault code.
+ */
+int mem_ap_read_u32_poll_batch(struct adiv5_ap *ap, target_addr_t address,
+		uint32_t *value)
+{
+	int retval = mem_ap_read_u32(ap, address, value);
+	if (retval != ERROR_OK)
+		return retval;
+
+	ap->dap->poll_batch_queued = true;
+	return ERROR_OK;
+}
+
+/**
+ * Execute the reads of a batched poll, unless another target did already.
+ *
+ * @param dap The DAP the reads were queued on.
+ *
+ * @return the result of the execution of the batch of reads. An error does
+ * not tell which of the reads failed: each target should then read its own
+ * word again on its own, so that only a faulting one reports the error.
+ */
+int dap_poll_batch_run(struct adiv5_dap *dap)
+{
+	if (dap->poll_batch_queued) {
+		dap->poll_batch_queued = false;
+		dap->poll_batch_retval = dap_run(dap);
+	}
+
+	return dap->poll_batch_retval;
+}
+
 /**
  * Asynchronous (queued) write of a word to memory or a system register.
  *
@@ -371,16 +440,13 @@ static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t siz
 		return ERROR_TARGET_UNALIGNED_ACCESS;
 
 	while (nbytes > 0) {
-		uint32_t this_size = size;
+		uint32_t this_size = mem_ap_transfer_size(ap, size, address, nbytes, addrinc);
 
-		/* Select packed transfer if possible */
-		if (addrinc && ap->packed_transfers && nbytes >= 4
-				&& max_tar_block_size(ap->tar_autoincr_block, address) >= 4) {
-			this_size = 4;
+		/* Select packed transfer if planned */
+		if (this_size != size)
 			retval = mem_ap_setup_csw(ap, csw_size | CSW_ADDRINC_PACKED);
-		} else {
+		else
 			retval = mem_ap_setup_csw(ap, csw_size | csw_addrincr);
-		}
 
 		if (retval != ERROR_OK)
 			break;
@@ -525,16 +591,13 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 	 * useful bytes it contains, and their location in the word, depends on the type of transfer
 	 * and alignment. */
 	while (nbytes > 0) {
-		uint32_t this_size = size;
+		uint32_t this_size = mem_ap_transfer_size(ap, size, address, nbytes, addrinc);
 
-		/* Select packed transfer if possible */
-		if (addrinc && ap->packed_transfers && nbytes >= 4
-				&& max_tar_block_size(ap->tar_autoincr_block, address) >= 4) {
-			this_size = 4;
+		/* Select packed transfer if planned */
+		if (this_size != size)
 			retval = mem_ap_setup_csw(ap, csw_size | CSW_ADDRINC_PACKED);
-		} else {
+		else
 			retval = mem_ap_setup_csw(ap, csw_size | csw_addrincr);
-		}
 		if (retval != ERROR_OK)
 			break;
 
@@ -578,12 +641,7 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 
 	/* Replay loop to populate caller's buffer from the correct word and byte lane */
 	while (nbytes > 0) {
-		uint32_t this_size = size;
-
-		if (addrinc && ap->packed_transfers && nbytes >= 4
-				&& max_tar_block_size(ap->tar_autoincr_block, address) >= 4) {
-			this_size = 4;
-		}
+		uint32_t this_size = mem_ap_transfer_size(ap, size, address, nbytes, addrinc);
 
 		if (dap->ti_be_32_quirks) {
 			switch (this_size) {
@@ -1661,6 +1719,12 @@ struct rtp_ops {
 	 */
 	int (*rom_table_entry)(int retval, int depth, unsigned int offset, uint64_t romentry,
 			void *priv);
+	/**
+	 * Allow the components behind a MEM-AP to be replayed from the DAP's ROM
+	 * table cache, when enabled. A replayed walk calls neither mem_ap_header
+	 * nor rom_table_entry for the cached components.
+	 */
+	bool cacheable;
 	/**
 	 * Private data
 	 */
@@ -1879,6 +1943,402 @@ static int rtp_cs_component(enum coresight_access_mode mode, const struct rtp_op
 	return ERROR_OK;
 }
 
+/*
+ * ROM table cache.
+ *
+ * Walking the ROM tables behind a MEM-AP reads a dozen registers for each
+ * CoreSight component; on large SoCs, with hundreds of components, this is
+ * a noticeable part of the target examination. The cache keeps, per MEM-AP,
+ * the registers of the components found by a walk and stores them in a file
+ * (command "$dap_name romtable_cache"). Entries are keyed by DPIDR, TARGETID,
+ * AP number, AP IDR and debug base address, and are revalidated by reading
+ * back a few components before being replayed.
+ */
+
+/* One CoreSight component of a cached walk */
+struct rtp_cache_component {
+	/* ROM table depth, relative to the MEM-AP */
+	int depth;
+	target_addr_t component_base;
+	uint64_t pid;
+	uint32_t cid;
+	uint32_t devarch;
+	uint32_t devid;
+	uint32_t devtype_memtype;
+};
+
+/* Components found behind the debug base address of a MEM-AP */
+struct rtp_cache_entry {
+	uint32_t dpidr;
+	uint32_t targetid;
+	uint64_t ap_num;
+	uint32_t apid;
+	target_addr_t dbgbase;
+
+	unsigned int num_components;
+	struct rtp_cache_component *components;
+};
+
+struct adiv5_romtable_cache {
+	/* the file has been read */
+	bool loaded;
+	unsigned int num_entries;
+	struct rtp_cache_entry *entries;
+};
+
+static bool rtp_cache_same_key(const struct rtp_cache_entry *a, const struct rtp_cache_entry *b)
+{
+	return a->dpidr == b->dpidr && a->targetid == b->targetid && a->ap_num == b->ap_num &&
+		a->apid == b->apid && a->dbgbase == b->dbgbase;
+}
+
+static void rtp_cache_remove(struct adiv5_romtable_cache *cache, struct rtp_cache_entry *e)
+{
+	free(e->components);
+	*e = cache->entries[--cache->num_entries];
+}
+
+static void rtp_cache_clear(struct adiv5_romtable_cache *cache)
+{
+	while (cache->num_entries)
+		rtp_cache_remove(cache, &cache->entries[0]);
+	free(cache->entries);
+	cache->entries = NULL;
+}
+
+/* Add an entry without components, replacing any entry with the same key */
+static struct rtp_cache_entry *rtp_cache_add(struct adiv5_romtable_cache *cache,
+		const struct rtp_cache_entry *key)
+{
+	for (unsigned int i = 0; i < cache->num_entries; i++) {
+		if (rtp_cache_same_key(&cache->entries[i], key)) {
+			rtp_cache_remove(cache, &cache->entries[i]);
+			break;
+		}
+	}
+
+	struct rtp_cache_entry *entries = realloc(cache->entries,
+			(cache->num_entries + 1) * sizeof(*entries));
+	if (!entries) {
+		LOG_ERROR("Out of memory");
+		return NULL;
+	}
+	cache->entries = entries;
+
+	struct rtp_cache_entry *e = &entries[cache->num_entries++];
+	*e = *key;
+	e->num_components = 0;
+	e->components = NULL;
+	return e;
+}
+
+static int rtp_cache_add_component(struct rtp_cache_entry *e,
+		const struct rtp_cache_component *c)
+{
+	struct rtp_cache_component *components = realloc(e->components,
+			(e->num_components + 1) * sizeof(*components));
+	if (!components) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	e->components = components;
+	components[e->num_components++] = *c;
+	return ERROR_OK;
+}
+
+static void rtp_cache_load(struct adiv5_dap *dap)
+{
+	struct adiv5_romtable_cache *cache = dap->romtable_cache;
+	const char *filename = dap->romtable_cache_file;
+
+	cache->loaded = true;
+
+	FILE *f = fopen(filename, "r");
+	if (!f) {
+		LOG_DEBUG("No ROM table cache in %s", filename);
+		return;
+	}
+
+	struct rtp_cache_entry *e = NULL;
+	unsigned int line_num = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		struct rtp_cache_entry key;
+		struct rtp_cache_component c;
+		uint64_t dbgbase, component_base;
+
+		line_num++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		if (sscanf(line, "ap %" SCNx32 " %" SCNx32 " %" SCNx64 " %" SCNx32 " %" SCNx64,
+				&key.dpidr, &key.targetid, &key.ap_num, &key.apid, &dbgbase) == 5) {
+			key.dbgbase = dbgbase;
+			e = rtp_cache_add(cache, &key);
+			if (!e)
+				break;
+			continue;
+		}
+
+		if (e && sscanf(line, "component %d %" SCNx64 " %" SCNx64 " %" SCNx32 " %" SCNx32
+				" %" SCNx32 " %" SCNx32, &c.depth, &component_base, &c.pid, &c.cid,
+				&c.devarch, &c.devid, &c.devtype_memtype) == 7) {
+			c.component_base = component_base;
+			if (rtp_cache_add_component(e, &c) != ERROR_OK)
+				break;
+			continue;
+		}
+
+		LOG_WARNING("%s:%u: invalid ROM table cache entry, ignoring the cache", filename, line_num);
+		rtp_cache_clear(cache);
+		break;
+	}
+	fclose(f);
+
+	LOG_DEBUG("Loaded %u MEM-AP from ROM table cache %s", cache->num_entries, filename);
+}
+
+static void rtp_cache_save(struct adiv5_dap *dap)
+{
+	struct adiv5_romtable_cache *cache = dap->romtable_cache;
+	const char *filename = dap->romtable_cache_file;
+
+	FILE *f = fopen(filename, "w");
+	if (!f) {
+		LOG_WARNING("Cannot write ROM table cache %s: %s", filename, strerror(errno));
+		return;
+	}
+
+	fprintf(f, "# OpenOCD CoreSight ROM table cache\n");
+	fprintf(f, "# ap dpidr targetid ap_num apid dbgbase\n");
+	fprintf(f, "# component depth base pid cid devarch devid devtype\n");
+	for (unsigned int i = 0; i < cache->num_entries; i++) {
+		const struct rtp_cache_entry *e = &cache->entries[i];
+
+		fprintf(f, "ap %08" PRIx32 " %08" PRIx32 " %" PRIx64 " %08" PRIx32 " %" PRIx64 "\n",
+			e->dpidr, e->targetid, e->ap_num, e->apid, (uint64_t)e->dbgbase);
+		for (unsigned int j = 0; j < e->num_components; j++) {
+			const struct rtp_cache_component *c = &e->components[j];
+
+			fprintf(f, "component %d %" PRIx64 " %" PRIx64 " %08" PRIx32 " %08" PRIx32
+				" %08" PRIx32 " %08" PRIx32 "\n", c->depth, (uint64_t)c->component_base,
+				c->pid, c->cid, c->devarch, c->devid, c->devtype_memtype);
+		}
+	}
+
+	if (fclose(f) != 0)
+		LOG_WARNING("Cannot write ROM table cache %s: %s", filename, strerror(errno));
+}
+
+void dap_romtable_cache_free(struct adiv5_dap *dap)
+{
+	if (dap->romtable_cache)
+		rtp_cache_clear(dap->romtable_cache);
+	free(dap->romtable_cache);
+	dap->romtable_cache = NULL;
+	free(dap->romtable_cache_file);
+	dap->romtable_cache_file = NULL;
+}
+
+static int rtp_cache_read_key(struct adiv5_ap *ap, uint32_t apid, target_addr_t dbgbase,
+		struct rtp_cache_entry *key)
+{
+	struct adiv5_dap *dap = ap->dap;
+
+	key->targetid = 0;
+	int retval = dap_dp_read_atomic(dap, DP_DPIDR, &key->dpidr);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* TARGETID is only present from DPv2 */
+	if ((key->dpidr & DP_DPIDR_VERSION_MASK) >= (2UL << DP_DPIDR_VERSION_SHIFT)) {
+		retval = dap_dp_read_atomic(dap, DP_TARGETID, &key->targetid);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	key->ap_num = ap->ap_num;
+	key->apid = apid;
+	key->dbgbase = dbgbase;
+	key->num_components = 0;
+	key->components = NULL;
+	return ERROR_OK;
+}
+
+/* Read back a cached component and check it has not changed */
+static bool rtp_cache_check_component(struct adiv5_ap *ap, const struct rtp_cache_component *c)
+{
+	struct cs_component_vals v;
+
+	if (rtp_read_cs_regs(CS_ACCESS_MEM_AP, ap, c->component_base, &v) != ERROR_OK)
+		return false;
+
+	return v.pid == c->pid && v.cid == c->cid && v.devarch == c->devarch &&
+		v.devid == c->devid && v.devtype_memtype == c->devtype_memtype;
+}
+
+/*
+ * Spot check an entry before trusting it: the root component, the last one
+ * and one in the middle are read back.
+ */
+static bool rtp_cache_validate(struct adiv5_ap *ap, const struct rtp_cache_entry *e)
+{
+	if (e->num_components == 0)
+		return false;
+
+	unsigned int last = e->num_components - 1;
+	if (!rtp_cache_check_component(ap, &e->components[0]))
+		return false;
+	if (last / 2 != 0 && !rtp_cache_check_component(ap, &e->components[last / 2]))
+		return false;
+	if (last != 0 && !rtp_cache_check_component(ap, &e->components[last]))
+		return false;
+
+	return true;
+}
+
+static int rtp_cache_replay(const struct rtp_ops *ops, struct adiv5_ap *ap,
+		const struct rtp_cache_entry *e, int depth)
+{
+	for (unsigned int i = 0; i < e->num_components; i++) {
+		const struct rtp_cache_component *c = &e->components[i];
+		struct cs_component_vals v = {
+			.ap              = ap,
+			.component_base  = c->component_base,
+			.pid             = c->pid,
+			.cid             = c->cid,
+			.devarch         = c->devarch,
+			.devid           = c->devid,
+			.devtype_memtype = c->devtype_memtype,
+			.mode            = CS_ACCESS_MEM_AP,
+		};
+
+		int retval = rtp_ops_cs_component(ops, ERROR_OK, &v, depth + c->depth);
+		if (retval == CORESIGHT_COMPONENT_FOUND)
+			return CORESIGHT_COMPONENT_FOUND;
+	}
+
+	return ERROR_OK;
+}
+
+/* Actions recording a complete walk, while forwarding it to the caller's ops */
+struct rtp_cache_recorder {
+	const struct rtp_ops *ops;
+	struct rtp_cache_entry *entry;
+	int depth;
+	/* result of the caller's ops */
+	int retval;
+	/* the walk is incomplete, don't cache it */
+	bool failed;
+};
+
+static int rtp_cache_record_cs_component(int retval, struct cs_component_vals *v,
+		int depth, void *priv)
+{
+	struct rtp_cache_recorder *rec = priv;
+
+	if (retval == ERROR_OK) {
+		struct rtp_cache_component c = {
+			.depth           = depth - rec->depth,
+			.component_base  = v->component_base,
+			.pid             = v->pid,
+			.cid             = v->cid,
+			.devarch         = v->devarch,
+			.devid           = v->devid,
+			.devtype_memtype = v->devtype_memtype,
+		};
+		if (rtp_cache_add_component(rec->entry, &c) != ERROR_OK)
+			rec->failed = true;
+	} else {
+		rec->failed = true;
+	}
+
+	/* keep walking after a match, to record the whole tree */
+	if (rec->retval != CORESIGHT_COMPONENT_FOUND &&
+			rtp_ops_cs_component(rec->ops, retval, v, depth) == CORESIGHT_COMPONENT_FOUND)
+		rec->retval = CORESIGHT_COMPONENT_FOUND;
+
+	return retval;
+}
+
+static int rtp_cache_record_rom_table_entry(int retval, int depth,
+		unsigned int offset, uint64_t romentry, void *priv)
+{
+	struct rtp_cache_recorder *rec = priv;
+
+	if (retval != ERROR_OK)
+		rec->failed = true;
+
+	return retval;
+}
+
+/*
+ * Walk the components behind the debug base address of a MEM-AP, going
+ * through the ROM table cache when enabled.
+ */
+static int rtp_mem_ap(const struct rtp_ops *ops, struct adiv5_ap *ap,
+		target_addr_t dbgbase, uint32_t apid, int depth)
+{
+	struct adiv5_dap *dap = ap->dap;
+	struct rtp_cache_entry key;
+
+	if (!ops->cacheable || !dap->romtable_cache_file ||
+			rtp_cache_read_key(ap, apid, dbgbase, &key) != ERROR_OK)
+		return rtp_cs_component(CS_ACCESS_MEM_AP, ops, ap, dbgbase, NULL, depth);
+
+	struct adiv5_romtable_cache *cache = dap->romtable_cache;
+	if (!cache->loaded)
+		rtp_cache_load(dap);
+
+	for (unsigned int i = 0; i < cache->num_entries; i++) {
+		struct rtp_cache_entry *e = &cache->entries[i];
+		if (!rtp_cache_same_key(e, &key))
+			continue;
+
+		if (rtp_cache_validate(ap, e)) {
+			LOG_DEBUG("AP # 0x%" PRIx64 ": %u components from ROM table cache",
+				ap->ap_num, e->num_components);
+			return rtp_cache_replay(ops, ap, e, depth);
+		}
+
+		LOG_INFO("AP # 0x%" PRIx64 ": ROM table cache is stale, rescanning", ap->ap_num);
+		rtp_cache_remove(cache, e);
+		break;
+	}
+
+	struct rtp_cache_entry *e = rtp_cache_add(cache, &key);
+	if (!e)
+		return rtp_cs_component(CS_ACCESS_MEM_AP, ops, ap, dbgbase, NULL, depth);
+
+	struct rtp_cache_recorder rec = {
+		.ops    = ops,
+		.entry  = e,
+		.depth  = depth,
+		.retval = ERROR_OK,
+		.failed = false,
+	};
+	struct rtp_ops rec_ops = {
+		.ap_header       = NULL,
+		.mem_ap_header   = NULL,
+		.cs_component    = rtp_cache_record_cs_component,
+		.rom_table_entry = rtp_cache_record_rom_table_entry,
+		.priv            = &rec,
+	};
+
+	int retval = rtp_cs_component(CS_ACCESS_MEM_AP, &rec_ops, ap, dbgbase, NULL, depth);
+	if (retval != ERROR_OK)
+		rec.failed = true;
+
+	if (rec.failed || e->num_components == 0) {
+		/* a read failed, don't keep an incomplete tree */
+		rtp_cache_remove(cache, e);
+	} else {
+		rtp_cache_save(dap);
+	}
+
+	return rec.retval;
+}
+
 static int rtp_ap(const struct rtp_ops *ops, struct adiv5_ap *ap, int depth)
 {
 	uint32_t apid;
@@ -1924,8 +2384,7 @@ static int rtp_ap(const struct rtp_ops *ops, struct adiv5_ap *ap, int depth)
 			invalid_entry = 0xFFFFFFFFul;
 
 		if (dbgbase != invalid_entry && (dbgbase & 0x3) != 0x2) {
-			retval = rtp_cs_component(CS_ACCESS_MEM_AP, ops, ap,
-					dbgbase & 0xFFFFFFFFFFFFF000ull, NULL, depth);
+			retval = rtp_mem_ap(ops, ap, dbgbase & 0xFFFFFFFFFFFFF000ull, apid, depth);
 			if (retval == CORESIGHT_COMPONENT_FOUND)
 				return CORESIGHT_COMPONENT_FOUND;
 		}
@@ -2187,6 +2646,7 @@ int dap_lookup_cs_component(struct adiv5_ap *ap, uint8_t type,
 		.mem_ap_header   = NULL,
 		.cs_component    = dap_lookup_cs_component_cs_component,
 		.rom_table_entry = NULL,
+		.cacheable       = true,
 		.priv            = &lookup,
 	};
 
@@ -2782,6 +3242,34 @@ COMMAND_HANDLER(dap_nu_npcx_quirks_command)
 								"Nuvoton NPCX quirks mode");
 }
 
+COMMAND_HANDLER(dap_romtable_cache_command)
+{
+	struct adiv5_dap *dap = adiv5_get_dap(CMD_DATA);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		dap_romtable_cache_free(dap);
+		if (strcmp(CMD_ARGV[0], "off") != 0) {
+			dap->romtable_cache = calloc(1, sizeof(*dap->romtable_cache));
+			dap->romtable_cache_file = strdup(CMD_ARGV[0]);
+			if (!dap->romtable_cache || !dap->romtable_cache_file) {
+				LOG_ERROR("Out of memory");
+				dap_romtable_cache_free(dap);
+				return ERROR_FAIL;
+			}
+		}
+	}
+
+	if (dap->romtable_cache_file)
+		command_print(CMD, "ROM table cache in %s", dap->romtable_cache_file);
+	else
+		command_print(CMD, "ROM table cache disabled");
+
+	return ERROR_OK;
+}
+
 const struct command_registration dap_instance_commands[] = {
 	{
 		.name = "info",
@@ -2861,5 +3349,13 @@ const struct command_registration dap_instance_commands[] = {
 		.help = "set/get quirks mode for Nuvoton NPCX controllers",
 		.usage = "[enable]",
 	},
+	{
+		.name = "romtable_cache",
+		.handler = dap_romtable_cache_command,
+		.mode = COMMAND_ANY,
+		.help = "set/get the file caching the CoreSight components "
+			"found in the ROM tables",
+		.usage = "[filename | 'off']",
+	},
 	COMMAND_REGISTRATION_DONE
 };
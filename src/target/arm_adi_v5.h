@@ -278,6 +278,15 @@ struct adiv5_ap {
 	 */
 	uint32_t memaccess_tck;
 
+	/**
+	 * Extra tck clocks added to memaccess_tck by the JTAG-DP after WAIT
+	 * responses from this AP. Raised at each WAIT, slowly lowered back.
+	 */
+	uint32_t wait_tck;
+
+	/* value of dap->wait_tck_run when wait_tck was last lowered */
+	unsigned int wait_tck_run;
+
 	/* Size of TAR autoincrement block, ARM ADI Specification requires at least 10 bits */
 	uint32_t tar_autoincr_block;
 
@@ -320,14 +329,21 @@ struct adiv5_ap {
 struct adiv5_dap {
 	const struct dap_ops *ops;
 
-	/* dap transaction list for WAIT support */
-	struct list_head cmd_journal;
+	/* ring of the dap transactions queued since last run, for WAIT support */
+	struct dap_cmd *cmd_ring;
+
+	/* index in cmd_ring of the oldest queued transaction */
+	size_t cmd_ring_head;
+
+	/* number of queued transactions in cmd_ring */
+	size_t cmd_ring_count;
 
-	/* pool for dap_cmd objects */
-	struct list_head cmd_pool;
+	/* number of the oldest transactions in cmd_ring handed to the adapter
+	 * with jtag_execute_queue_async(), whose ACK is not checked yet */
+	size_t cmd_ring_in_flight;
 
-	/* number of dap_cmd objects in the pool */
-	size_t cmd_pool_size;
+	/* count of runs completed without WAIT, to lower each AP once per run */
+	unsigned int wait_tck_run;
 
 	struct jtag_tap *tap;
 	/* Control config */
@@ -396,6 +412,16 @@ struct adiv5_dap {
 
 	/* ADIv6 only field indicating ROM Table address size */
 	unsigned int asize;
+
+	/** File of the ROM table cache, NULL when the cache is disabled */
+	char *romtable_cache_file;
+	/** Content of the ROM table cache, loaded from the file on first use */
+	struct adiv5_romtable_cache *romtable_cache;
+
+	/** Reads of a batched poll are queued, see dap_poll_batch_run() */
+	bool poll_batch_queued;
+	/** Result of the last run of the reads of a batched poll */
+	int poll_batch_retval;
 };
 
 /**
@@ -671,6 +697,11 @@ int mem_ap_read_atomic_u32(struct adiv5_ap *ap,
 int mem_ap_write_atomic_u32(struct adiv5_ap *ap,
 		target_addr_t address, uint32_t value);
 
+/* MEM-AP single word reads shared by the targets polled in a batch. */
+int mem_ap_read_u32_poll_batch(struct adiv5_ap *ap,
+		target_addr_t address, uint32_t *value);
+int dap_poll_batch_run(struct adiv5_dap *dap);
+
 /* Synchronous MEM-AP memory mapped bus block transfers. */
 int mem_ap_read_buf(struct adiv5_ap *ap,
 		uint8_t *buffer, uint32_t size, uint32_t count, target_addr_t address);
@@ -721,6 +752,9 @@ static inline bool dap_is_multidrop(struct adiv5_dap *dap)
 int dap_lookup_cs_component(struct adiv5_ap *ap,
 			uint8_t type, target_addr_t *addr, int32_t idx);
 
+/* Disable the ROM table cache and free its content */
+void dap_romtable_cache_free(struct adiv5_dap *dap);
+
 struct target;
 
 /* Put debug link into SWD mode */
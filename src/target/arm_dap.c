@@ -17,6 +17,7 @@
 #include "helper/command.h"
 #include "transport/transport.h"
 #include "jtag/interface.h"
+#include "jtag/recorder.h"
 
 static LIST_HEAD(all_dap);
 
@@ -47,8 +48,6 @@ static void dap_instance_init(struct adiv5_dap *dap)
 		dap->ap[i].refcount = 0;
 		dap->ap[i].config_ap_never_release = false;
 	}
-	INIT_LIST_HEAD(&dap->cmd_journal);
-	INIT_LIST_HEAD(&dap->cmd_pool);
 }
 
 const char *adiv5_dap_name(struct adiv5_dap *self)
@@ -107,7 +106,7 @@ static int dap_init_all(void)
 
 		if (transport_is_swd()) {
 			dap->ops = &swd_dap_ops;
-			obj->swd = adapter_driver->swd_ops;
+			obj->swd = jtag_recorder_swd_driver(adapter_driver->swd_ops);
 		} else if (transport_is_dapdirect_swd()) {
 			dap->ops = adapter_driver->dap_swd_ops;
 		} else if (transport_is_dapdirect_jtag()) {
@@ -162,6 +161,7 @@ int dap_cleanup_all(void)
 		if (dap->ops && dap->ops->quit)
 			dap->ops->quit(dap);
 
+		dap_romtable_cache_free(dap);
 		free(obj->name);
 		free(obj);
 	}
@@ -746,6 +746,22 @@ static int update_halt_gdb(struct target *target)
  * Cortex-A Run control
  */
 
+static int cortex_a_poll_queue(struct target *target)
+{
+	struct cortex_a_common *cortex_a = target_to_cortex_a(target);
+	struct armv7a_common *armv7a = &cortex_a->armv7a_common;
+
+	return mem_ap_read_u32_poll_batch(armv7a->debug_ap,
+			armv7a->debug_base + CPUDBG_DSCR, &cortex_a->poll_dscr);
+}
+
+static int cortex_a_poll_queue_drop(struct target *target)
+{
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+
+	return dap_poll_batch_run(armv7a->debug_ap->dap);
+}
+
 static int cortex_a_poll(struct target *target)
 {
 	int retval = ERROR_OK;
@@ -762,11 +778,24 @@ static int cortex_a_poll(struct target *target)
 		(!target->gdb_service->target)) {
 		target->gdb_service->target =
 			get_cortex_a(target, target->gdb_service->core[1]);
+		target_poll_batch_drop();
 		target_call_event_callbacks(target, TARGET_EVENT_HALTED);
 		return retval;
 	}
-	retval = mem_ap_read_atomic_u32(armv7a->debug_ap,
-			armv7a->debug_base + CPUDBG_DSCR, &dscr);
+	if (target->poll_queued) {
+		/* queued along with the other targets by cortex_a_poll_queue() */
+		target->poll_queued = false;
+		retval = dap_poll_batch_run(armv7a->debug_ap->dap);
+		dscr = cortex_a->poll_dscr;
+		if (retval != ERROR_OK) {
+			/* the failing read may be another target's */
+			retval = mem_ap_read_atomic_u32(armv7a->debug_ap,
+					armv7a->debug_base + CPUDBG_DSCR, &dscr);
+		}
+	} else {
+		retval = mem_ap_read_atomic_u32(armv7a->debug_ap,
+				armv7a->debug_base + CPUDBG_DSCR, &dscr);
+	}
 	if (retval != ERROR_OK)
 		return retval;
 	cortex_a->cpudbg_dscr = dscr;
@@ -777,6 +806,9 @@ static int cortex_a_poll(struct target *target)
 			LOG_DEBUG("Target halted");
 			target->state = TARGET_HALTED;
 
+			/* the SMP siblings get halted, their batched status is stale */
+			target_poll_batch_drop();
+
 			retval = cortex_a_debug_entry(target);
 			if (retval != ERROR_OK)
 				return retval;
@@ -3403,6 +3435,8 @@ struct target_type cortexa_target = {
 	.name = "cortex_a",
 
 	.poll = cortex_a_poll,
+	.poll_queue = cortex_a_poll_queue,
+	.poll_queue_drop = cortex_a_poll_queue_drop,
 	.arch_state = armv7a_arch_state,
 
 	.halt = cortex_a_halt,
@@ -3483,6 +3517,8 @@ struct target_type cortexr4_target = {
 	.name = "cortex_r4",
 
 	.poll = cortex_a_poll,
+	.poll_queue = cortex_a_poll_queue,
+	.poll_queue_drop = cortex_a_poll_queue_drop,
 	.arch_state = armv7a_arch_state,
 
 	.halt = cortex_a_halt,
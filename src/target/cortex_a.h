@@ -73,6 +73,8 @@ struct cortex_a_common {
 
 	/* Context information */
 	uint32_t cpudbg_dscr;
+	/* DSCR read by cortex_a_poll_queue() */
+	uint32_t poll_dscr;
 
 	/* Saved cp15 registers */
 	uint32_t cp15_control_reg;
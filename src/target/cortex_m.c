@@ -895,7 +895,20 @@ static int cortex_m_poll_one(struct target *target)
 	struct armv7m_common *armv7m = &cortex_m->armv7m;
 
 	/* Read from Debug Halting Control and Status Register */
-	retval = cortex_m_read_dhcsr_atomic_sticky(target);
+	if (target->poll_queued) {
+		/* queued along with the other targets by cortex_m_poll_queue() */
+		target->poll_queued = false;
+		retval = dap_poll_batch_run(armv7m->debug_ap->dap);
+		if (retval == ERROR_OK) {
+			cortex_m->dcb_dhcsr = cortex_m->poll_dhcsr;
+			cortex_m_cumulate_dhcsr_sticky(cortex_m, cortex_m->dcb_dhcsr);
+		} else {
+			/* the failing read may be another target's */
+			retval = cortex_m_read_dhcsr_atomic_sticky(target);
+		}
+	} else {
+		retval = cortex_m_read_dhcsr_atomic_sticky(target);
+	}
 	if (retval != ERROR_OK) {
 		target->state = TARGET_UNKNOWN;
 		return retval;
@@ -906,6 +919,8 @@ static int cortex_m_poll_one(struct target *target)
 	 */
 	if (cortex_m->dcb_dhcsr & S_LOCKUP) {
 		LOG_TARGET_ERROR(target, "clearing lockup after double fault");
+		/* the state changes, the batched status of the others may be stale */
+		target_poll_batch_drop();
 		cortex_m_write_debug_halt_mask(target, C_HALT, 0);
 		target->debug_reason = DBG_REASON_DBGRQ;
 
@@ -923,6 +938,7 @@ static int cortex_m_poll_one(struct target *target)
 	if (cortex_m->dcb_dhcsr_cumulated_sticky & S_RESET_ST) {
 		cortex_m->dcb_dhcsr_cumulated_sticky &= ~S_RESET_ST;
 		if (target->state != TARGET_RESET) {
+			target_poll_batch_drop();
 			target->state = TARGET_RESET;
 			LOG_TARGET_INFO(target, "external reset detected");
 		}
@@ -945,6 +961,8 @@ static int cortex_m_poll_one(struct target *target)
 	}
 
 	if (cortex_m->dcb_dhcsr & S_HALT) {
+		if (prev_target_state != TARGET_HALTED)
+			target_poll_batch_drop();
 		target->state = TARGET_HALTED;
 
 		if ((prev_target_state == TARGET_RUNNING) || (prev_target_state == TARGET_RESET)) {
@@ -989,6 +1007,7 @@ static int cortex_m_poll_one(struct target *target)
 		/* registers are now invalid */
 		register_cache_invalidate(armv7m->arm.core_cache);
 
+		target_poll_batch_drop();
 		target->state = TARGET_RUNNING;
 		LOG_TARGET_WARNING(target, "external resume detected");
 		target_call_event_callbacks(target, TARGET_EVENT_RESUMED);
@@ -1057,6 +1076,8 @@ static int cortex_m_poll_smp(struct list_head *smp_targets)
 	}
 
 	if (halted) {
+		/* the targets get halted, their batched status is stale */
+		target_poll_batch_drop();
 		retval = cortex_m_smp_halt_all(smp_targets);
 
 		int ret2 = cortex_m_smp_post_halt_poll(smp_targets);
@@ -1082,6 +1103,29 @@ static int cortex_m_poll_smp(struct list_head *smp_targets)
 	return retval;
 }
 
+static int cortex_m_poll_queue(struct target *target)
+{
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	struct armv7m_common *armv7m = &cortex_m->armv7m;
+
+	return mem_ap_read_u32_poll_batch(armv7m->debug_ap, DCB_DHCSR,
+			&cortex_m->poll_dhcsr);
+}
+
+static int cortex_m_poll_queue_drop(struct target *target)
+{
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	struct armv7m_common *armv7m = &cortex_m->armv7m;
+
+	int retval = dap_poll_batch_run(armv7m->debug_ap->dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* keep the cleared-on-read S_RESET_ST for the next poll */
+	cortex_m_cumulate_dhcsr_sticky(cortex_m, cortex_m->poll_dhcsr);
+	return ERROR_OK;
+}
+
 static int cortex_m_poll(struct target *target)
 {
 	int retval = cortex_m_poll_one(target);
@@ -3078,6 +3122,8 @@ struct target_type cortexm_target = {
 	.name = "cortex_m",
 
 	.poll = cortex_m_poll,
+	.poll_queue = cortex_m_poll_queue,
+	.poll_queue_drop = cortex_m_poll_queue_drop,
 	.arch_state = armv7m_arch_state,
 
 	.target_request_data = cortex_m_target_request_data,
@@ -223,6 +223,8 @@ struct cortex_m_common {
 	/* Context information */
 	uint32_t dcb_dhcsr;
 	uint32_t dcb_dhcsr_cumulated_sticky;
+	/* DHCSR read by cortex_m_poll_queue() */
+	uint32_t poll_dhcsr;
 	/* DCB DHCSR has been at least once read, so the sticky bits have been reset */
 	bool dcb_dhcsr_sticky_is_recent;
 	uint32_t nvic_dfsr;  /* Debug Fault Status Register - shows reason for debug halt */
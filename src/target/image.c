@@ -23,6 +23,7 @@
 
 #include "image.h"
 #include "target.h"
+#include <helper/crc32.h>
 #include <helper/log.h>
 
 /* convert ELF header field to host endianness */
@@ -1269,31 +1270,12 @@ int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes, uint32_t *c
 	uint32_t crc = 0xffffffff;
 	LOG_DEBUG("Calculating checksum");
 
-	static uint32_t crc32_table[256];
-
-	static bool first_init;
-	if (!first_init) {
-		/* Initialize the CRC table and the decoding table.  */
-		unsigned int i, j, c;
-		for (i = 0; i < 256; i++) {
-			/* as per gdb */
-			for (c = i << 24, j = 8; j > 0; --j)
-				c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
-			crc32_table[i] = c;
-		}
-
-		first_init = true;
-	}
-
 	while (nbytes > 0) {
-		int run = nbytes;
-		if (run > 32768)
-			run = 32768;
+		uint32_t run = MIN(nbytes, 1024 * 1024);
+		/* as per gdb */
+		crc = crc32_be(CRC32_POLY_BE, crc, buffer, run);
+		buffer += run;
 		nbytes -= run;
-		while (run--) {
-			/* as per gdb */
-			crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buffer++) & 255];
-		}
 		keep_alive();
 	}
 
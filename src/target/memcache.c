@@ -0,0 +1,412 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/align.h>
+#include <helper/command.h>
+#include <helper/log.h>
+#include "target.h"
+#include "target_type.h"
+#include "memcache.h"
+
+/* Unit of caching; missing pages are read with 32-bit accesses */
+#define MEMCACHE_PAGE_SIZE	256
+#define MEMCACHE_HASH_SIZE	256
+/* The content of a cache is dropped when it would grow above this */
+#define MEMCACHE_MAX_PAGES	4096
+
+struct memcache_region {
+	target_addr_t address;
+	uint64_t size;
+	bool is_volatile;
+};
+
+struct memcache_page {
+	struct memcache_page *next;
+	target_addr_t address;
+	uint8_t data[MEMCACHE_PAGE_SIZE];
+};
+
+struct target_memcache {
+	unsigned int num_regions;
+	struct memcache_region *regions;
+
+	unsigned int num_pages;
+	struct memcache_page *pages[MEMCACHE_HASH_SIZE];
+
+	/* pages read from the cache */
+	uint64_t hits;
+	/* pages read from the target */
+	uint64_t misses;
+	/* reads not eligible to the cache */
+	uint64_t bypassed;
+	/* times cached pages were dropped */
+	uint64_t invalidations;
+};
+
+static struct memcache_page **memcache_bucket(struct target_memcache *cache,
+		target_addr_t address)
+{
+	return &cache->pages[(address / MEMCACHE_PAGE_SIZE) % MEMCACHE_HASH_SIZE];
+}
+
+static struct memcache_page *memcache_find(struct target_memcache *cache,
+		target_addr_t address)
+{
+	struct memcache_page *page = *memcache_bucket(cache, address);
+
+	while (page && page->address != address)
+		page = page->next;
+	return page;
+}
+
+static void memcache_flush(struct target_memcache *cache)
+{
+	if (cache->num_pages == 0)
+		return;
+
+	for (unsigned int i = 0; i < MEMCACHE_HASH_SIZE; i++) {
+		while (cache->pages[i]) {
+			struct memcache_page *page = cache->pages[i];
+			cache->pages[i] = page->next;
+			free(page);
+		}
+	}
+	cache->num_pages = 0;
+	cache->invalidations++;
+}
+
+/* Drop the pages overlapping len bytes at address */
+static void memcache_drop(struct target_memcache *cache, target_addr_t address, uint32_t len)
+{
+	if (cache->num_pages == 0 || len == 0)
+		return;
+
+	target_addr_t first = ALIGN_DOWN(address, MEMCACHE_PAGE_SIZE);
+	target_addr_t last = ALIGN_DOWN(address + len - 1, MEMCACHE_PAGE_SIZE);
+	if (last < first) {
+		/* wraps around */
+		memcache_flush(cache);
+		return;
+	}
+
+	bool dropped = false;
+	for (target_addr_t n = (last - first) / MEMCACHE_PAGE_SIZE + 1, i = 0; i < n; i++) {
+		target_addr_t page_address = first + i * MEMCACHE_PAGE_SIZE;
+		struct memcache_page **p = memcache_bucket(cache, page_address);
+
+		while (*p && (*p)->address != page_address)
+			p = &(*p)->next;
+		if (*p) {
+			struct memcache_page *page = *p;
+			*p = page->next;
+			free(page);
+			cache->num_pages--;
+			dropped = true;
+		}
+	}
+	if (dropped)
+		cache->invalidations++;
+}
+
+/*
+ * Pages first to last are cacheable when they are all in a cacheable region
+ * and none of their bytes is in a volatile one.
+ */
+static bool memcache_is_cacheable(struct target_memcache *cache,
+		target_addr_t first, target_addr_t last)
+{
+	target_addr_t end = last + MEMCACHE_PAGE_SIZE - 1;
+	bool cacheable = false;
+
+	for (unsigned int i = 0; i < cache->num_regions; i++) {
+		const struct memcache_region *r = &cache->regions[i];
+		target_addr_t r_end = r->address + r->size - 1;
+
+		if (r->is_volatile) {
+			if (r->address <= end && first <= r_end)
+				return false;
+		} else if (r->address <= first && end <= r_end) {
+			cacheable = true;
+		}
+	}
+
+	return cacheable;
+}
+
+/* Memory can change behind the cache as long as a target runs */
+static bool memcache_targets_halted(void)
+{
+	for (struct target *target = all_targets; target; target = target->next) {
+		if (target_was_examined(target) && target->state != TARGET_HALTED)
+			return false;
+	}
+	return true;
+}
+
+/* Read n consecutive pages from the target, in a single access */
+static int memcache_fill(struct target *target, struct target_memcache *cache,
+		target_addr_t address, unsigned int n)
+{
+	uint8_t *data = malloc(n * MEMCACHE_PAGE_SIZE);
+	if (!data) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	int retval = target->type->read_memory(target, address, 4,
+			n * MEMCACHE_PAGE_SIZE / 4, data);
+
+	for (unsigned int i = 0; retval == ERROR_OK && i < n; i++) {
+		struct memcache_page *page = malloc(sizeof(*page));
+		if (!page) {
+			LOG_ERROR("Out of memory");
+			retval = ERROR_FAIL;
+			break;
+		}
+		page->address = address + i * MEMCACHE_PAGE_SIZE;
+		memcpy(page->data, data + i * MEMCACHE_PAGE_SIZE, MEMCACHE_PAGE_SIZE);
+
+		struct memcache_page **bucket = memcache_bucket(cache, page->address);
+		page->next = *bucket;
+		*bucket = page;
+		cache->num_pages++;
+	}
+
+	free(data);
+	return retval;
+}
+
+int target_memcache_read(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer)
+{
+	struct target_memcache *cache = target->memcache;
+	uint32_t len = size * count;
+
+	if (!cache || cache->num_regions == 0 || len == 0)
+		return target->type->read_memory(target, address, size, count, buffer);
+
+	target_addr_t first = ALIGN_DOWN(address, MEMCACHE_PAGE_SIZE);
+	target_addr_t last = ALIGN_DOWN(address + len - 1, MEMCACHE_PAGE_SIZE);
+	if (last < first || (last - first) / MEMCACHE_PAGE_SIZE >= MEMCACHE_MAX_PAGES / 2 ||
+			!memcache_is_cacheable(cache, first, last)) {
+		cache->bypassed++;
+		return target->type->read_memory(target, address, size, count, buffer);
+	}
+
+	if (!memcache_targets_halted()) {
+		target_memcache_invalidate_all();
+		cache->bypassed++;
+		return target->type->read_memory(target, address, size, count, buffer);
+	}
+
+	unsigned int num = (last - first) / MEMCACHE_PAGE_SIZE + 1;
+	if (cache->num_pages + num > MEMCACHE_MAX_PAGES)
+		memcache_flush(cache);
+
+	/* fetch the missing pages, each run of consecutive ones at once */
+	for (unsigned int i = 0; i < num; ) {
+		if (memcache_find(cache, first + i * MEMCACHE_PAGE_SIZE)) {
+			cache->hits++;
+			i++;
+			continue;
+		}
+
+		unsigned int n = 1;
+		while (i + n < num && !memcache_find(cache, first + (i + n) * MEMCACHE_PAGE_SIZE))
+			n++;
+
+		if (memcache_fill(target, cache, first + i * MEMCACHE_PAGE_SIZE, n) != ERROR_OK) {
+			/* let the target report the error, with the access size asked */
+			LOG_TARGET_DEBUG(target, "memory cache fill failed at " TARGET_ADDR_FMT,
+				first + i * MEMCACHE_PAGE_SIZE);
+			cache->bypassed++;
+			return target->type->read_memory(target, address, size, count, buffer);
+		}
+		cache->misses += n;
+		i += n;
+	}
+
+	for (unsigned int i = 0; i < num; i++) {
+		target_addr_t page_address = first + i * MEMCACHE_PAGE_SIZE;
+		const struct memcache_page *page = memcache_find(cache, page_address);
+		target_addr_t start = MAX(page_address, address);
+		target_addr_t end = MIN(page_address + MEMCACHE_PAGE_SIZE - 1, address + len - 1);
+
+		memcpy(buffer + (start - address), page->data + (start - page_address), end - start + 1);
+	}
+
+	return ERROR_OK;
+}
+
+void target_memcache_write(struct target *target, target_addr_t address, uint32_t len)
+{
+	/* other targets may see the same memory at other addresses */
+	for (struct target *t = all_targets; t; t = t->next) {
+		if (!t->memcache)
+			continue;
+		if (t == target)
+			memcache_drop(t->memcache, address, len);
+		else
+			memcache_flush(t->memcache);
+	}
+}
+
+void target_memcache_invalidate_all(void)
+{
+	for (struct target *target = all_targets; target; target = target->next) {
+		if (target->memcache)
+			memcache_flush(target->memcache);
+	}
+}
+
+void target_memcache_free(struct target *target)
+{
+	struct target_memcache *cache = target->memcache;
+
+	if (!cache)
+		return;
+
+	memcache_flush(cache);
+	free(cache->regions);
+	free(cache);
+	target->memcache = NULL;
+}
+
+COMMAND_HANDLER(handle_memcache_region_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct target_memcache *cache = target->memcache;
+
+	if (CMD_ARGC == 0) {
+		for (unsigned int i = 0; cache && i < cache->num_regions; i++) {
+			const struct memcache_region *r = &cache->regions[i];
+			command_print(CMD, TARGET_ADDR_FMT " 0x%08" PRIx64 " %s", r->address, r->size,
+				r->is_volatile ? "volatile" : "cacheable");
+		}
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct memcache_region region;
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], region.address);
+	COMMAND_PARSE_NUMBER(u64, CMD_ARGV[1], region.size);
+	if (strcmp(CMD_ARGV[2], "cacheable") == 0)
+		region.is_volatile = false;
+	else if (strcmp(CMD_ARGV[2], "volatile") == 0)
+		region.is_volatile = true;
+	else
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (region.size == 0 || region.address + region.size - 1 < region.address) {
+		command_print(CMD, "invalid region size");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	if (!region.is_volatile && (!IS_ALIGNED(region.address, MEMCACHE_PAGE_SIZE) ||
+			!IS_ALIGNED(region.size, MEMCACHE_PAGE_SIZE))) {
+		command_print(CMD, "cacheable regions must be aligned to %d bytes", MEMCACHE_PAGE_SIZE);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	if (!cache) {
+		cache = calloc(1, sizeof(*cache));
+		if (!cache) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		target->memcache = cache;
+	}
+
+	struct memcache_region *regions = realloc(cache->regions,
+			(cache->num_regions + 1) * sizeof(*regions));
+	if (!regions) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	regions[cache->num_regions++] = region;
+	cache->regions = regions;
+
+	memcache_flush(cache);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_clear_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	target_memcache_free(get_current_target(CMD_CTX));
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_flush_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	if (target->memcache)
+		memcache_flush(target->memcache);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_stats_command)
+{
+	if (CMD_ARGC > 1 || (CMD_ARGC == 1 && strcmp(CMD_ARGV[0], "reset") != 0))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target_memcache *cache = get_current_target(CMD_CTX)->memcache;
+	if (!cache) {
+		command_print(CMD, "memory cache disabled");
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "%u pages cached, %" PRIu64 " hits, %" PRIu64 " misses, "
+		"%" PRIu64 " bypassed reads, %" PRIu64 " invalidations",
+		cache->num_pages, cache->hits, cache->misses, cache->bypassed,
+		cache->invalidations);
+
+	if (CMD_ARGC == 1) {
+		cache->hits = 0;
+		cache->misses = 0;
+		cache->bypassed = 0;
+		cache->invalidations = 0;
+	}
+	return ERROR_OK;
+}
+
+const struct command_registration target_memcache_command_handlers[] = {
+	{
+		.name = "region",
+		.handler = handle_memcache_region_command,
+		.mode = COMMAND_ANY,
+		.help = "list the regions of the memory cache, or add one",
+		.usage = "[address size ('cacheable'|'volatile')]",
+	},
+	{
+		.name = "clear",
+		.handler = handle_memcache_clear_command,
+		.mode = COMMAND_ANY,
+		.help = "remove all the regions, disabling the memory cache",
+		.usage = "",
+	},
+	{
+		.name = "flush",
+		.handler = handle_memcache_flush_command,
+		.mode = COMMAND_ANY,
+		.help = "drop the content of the memory cache",
+		.usage = "",
+	},
+	{
+		.name = "stats",
+		.handler = handle_memcache_stats_command,
+		.mode = COMMAND_ANY,
+		.help = "display the statistics of the memory cache, optionally resetting them",
+		.usage = "['reset']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
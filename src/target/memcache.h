@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_MEMCACHE_H
+#define OPENOCD_TARGET_MEMCACHE_H
+
+#include "helper/types.h"
+
+struct target;
+struct command_registration;
+
+/**
+ * @file
+ * Host-side cache of target memory.
+ *
+ * While all the targets are halted, reads of target memory falling in the
+ * regions configured as cacheable are served from a per-target cache, filled
+ * page by page. Any target event (resume, step, halt, reset...), algorithm
+ * run or write through a physical address drops the content of all caches;
+ * a write through a target drops the pages it overlaps, and the content of
+ * the other targets' caches.
+ */
+
+/** Read target memory, through the cache of the target when possible. */
+int target_memcache_read(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer);
+
+/** Update the caches before @a len bytes are written at @a address. */
+void target_memcache_write(struct target *target, target_addr_t address, uint32_t len);
+
+/** Drop the content of the caches of all targets. */
+void target_memcache_invalidate_all(void);
+
+/** Release the cache of a target. */
+void target_memcache_free(struct target *target);
+
+extern const struct command_registration target_memcache_command_handlers[];
+
+#endif /* OPENOCD_TARGET_MEMCACHE_H */
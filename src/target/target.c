@@ -48,6 +48,7 @@
 #include "transport/transport.h"
 #include "arm_cti.h"
 #include "smp.h"
+#include "memcache.h"
 #include "semihosting_common.h"
 
 /* default halt wait timeout (ms) */
@@ -788,12 +789,14 @@ int target_run_algorithm(struct target *target,
 		goto done;
 	}
 
+	target_memcache_invalidate_all();
 	target->running_alg = true;
 	retval = target->type->run_algorithm(target,
 			num_mem_params, mem_params,
 			num_reg_params, reg_param,
 			entry_point, exit_point, timeout_ms, arch_info);
 	target->running_alg = false;
+	target_memcache_invalidate_all();
 
 done:
 	return retval;
@@ -833,6 +836,7 @@ int target_start_algorithm(struct target *target,
 		goto done;
 	}
 
+	target_memcache_invalidate_all();
 	target->running_alg = true;
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
@@ -879,6 +883,7 @@ int target_wait_algorithm(struct target *target,
 			exit_point, timeout_ms, arch_info);
 	if (retval != ERROR_TARGET_TIMEOUT)
 		target->running_alg = false;
+	target_memcache_invalidate_all();
 
 done:
 	return retval;
@@ -1245,6 +1250,8 @@ int target_read_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support read_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	if (target->memcache)
+		return target_memcache_read(target, address, size, count, buffer);
 	return target->type->read_memory(target, address, size, count, buffer);
 }
 
@@ -1273,6 +1280,7 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	target_memcache_write(target, address, size * count);
 	return target->type->write_memory(target, address, size, count, buffer);
 }
 
@@ -1287,6 +1295,7 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	target_memcache_invalidate_all();
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1766,6 +1775,9 @@ int target_call_event_callbacks(struct target *target, enum target_event event)
 	struct target_event_callback *callback = target_event_callbacks;
 	struct target_event_callback *next_callback;
 
+	/* memory may have changed behind the cached copies */
+	target_memcache_invalidate_all();
+
 	if (event == TARGET_EVENT_HALTED) {
 		/* execute early halted first */
 		target_call_event_callbacks(target, TARGET_EVENT_GDB_HALT);
@@ -2183,6 +2195,7 @@ static void target_destroy(struct target *target)
 {
 	breakpoint_remove_all(target);
 	watchpoint_remove_all(target);
+	target_memcache_free(target);
 
 	if (target->type->deinit_target)
 		target->type->deinit_target(target);
@@ -2360,6 +2373,7 @@ int target_write_buffer(struct target *target, target_addr_t address, uint32_t s
 		return ERROR_FAIL;
 	}
 
+	target_memcache_write(target, address, size);
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
@@ -2905,6 +2919,90 @@ static int sense_handler(void)
 	return ERROR_OK;
 }
 
+/**
+ * Stop using the status reads queued by poll_queue() in handle_target().
+ * Called at the end of the polling and by a poll that sees a state change
+ * or halts other targets, since the batched status of the targets not yet
+ * polled may be stale then: their next poll reads the status again.
+ */
+void target_poll_batch_drop(void)
+{
+	for (struct target *target = all_targets; target; target = target->next) {
+		if (!target->poll_queued)
+			continue;
+
+		target->poll_queued = false;
+		/* errors are reported by the next poll */
+		target->type->poll_queue_drop(target);
+	}
+}
+
+/* Whether handle_target() should poll the target now, without backoff update */
+static bool target_poll_is_due(struct target *target)
+{
+	return target_was_examined(target) && target->tap->enabled &&
+		target->backoff.times <= target->backoff.count;
+}
+
+/* Poll a target from handle_target(); sets *stop when the polling of the
+ * other targets should be skipped this time */
+static int handle_target_poll_one(struct target *target, bool *stop)
+{
+	int retval = ERROR_OK;
+
+	*stop = false;
+
+	if (!target_was_examined(target))
+		return retval;
+
+	if (!target->tap->enabled)
+		return retval;
+
+	if (target->backoff.times > target->backoff.count) {
+		/* do not poll this time as we failed previously */
+		target->backoff.count++;
+		return retval;
+	}
+	target->backoff.count = 0;
+
+	/* only poll target if we've got power and srst isn't asserted */
+	if (!power_dropout && !srst_asserted) {
+		/* polling may fail silently until the target has been examined */
+		retval = target_poll(target);
+		if (retval != ERROR_OK) {
+			/* 100ms polling interval. Increase interval between polling up to 5000ms */
+			if (target->backoff.times * polling_interval < 5000) {
+				target->backoff.times *= 2;
+				target->backoff.times++;
+			}
+
+			/* Tell GDB to halt the debugger. This allows the user to
+			 * run monitor commands to handle the situation.
+			 */
+			target_call_event_callbacks(target, TARGET_EVENT_GDB_HALT);
+		}
+		if (target->backoff.times > 0) {
+			LOG_USER("Polling target %s failed, trying to reexamine", target_name(target));
+			target_reset_examined(target);
+			retval = target_examine_one(target);
+			/* Target examination could have failed due to unstable connection,
+			 * but we set the examined flag anyway to repoll it later */
+			if (retval != ERROR_OK) {
+				target_set_examined(target);
+				LOG_USER("Examination failed, GDB will be halted. Polling again in %dms",
+					 target->backoff.times * polling_interval);
+				*stop = true;
+				return retval;
+			}
+		}
+
+		/* Since we succeeded, we reset backoff count */
+		target->backoff.times = 0;
+	}
+
+	return retval;
+}
+
 /* process target state changes */
 static int handle_target(void *priv)
 {
@@ -2963,58 +3061,38 @@ static int handle_target(void *priv)
 	/* Poll targets for state changes unless that's globally disabled.
 	 * Skip targets that are currently disabled.
 	 */
-	for (struct target *target = all_targets;
-			is_jtag_poll_safe() && target;
-			target = target->next) {
-
-		if (!target_was_examined(target))
-			continue;
-
-		if (!target->tap->enabled)
-			continue;
-
-		if (target->backoff.times > target->backoff.count) {
-			/* do not poll this time as we failed previously */
-			target->backoff.count++;
-			continue;
-		}
-		target->backoff.count = 0;
-
-		/* only poll target if we've got power and srst isn't asserted */
-		if (!power_dropout && !srst_asserted) {
-			/* polling may fail silently until the target has been examined */
-			retval = target_poll(target);
-			if (retval != ERROR_OK) {
-				/* 100ms polling interval. Increase interval between polling up to 5000ms */
-				if (target->backoff.times * polling_interval < 5000) {
-					target->backoff.times *= 2;
-					target->backoff.times++;
-				}
+	if (!is_jtag_poll_safe())
+		return retval;
 
-				/* Tell GDB to halt the debugger. This allows the user to
-				 * run monitor commands to handle the situation.
-				 */
-				target_call_event_callbacks(target, TARGET_EVENT_GDB_HALT);
-			}
-			if (target->backoff.times > 0) {
-				LOG_USER("Polling target %s failed, trying to reexamine", target_name(target));
-				target_reset_examined(target);
-				retval = target_examine_one(target);
-				/* Target examination could have failed due to unstable connection,
-				 * but we set the examined flag anyway to repoll it later */
-				if (retval != ERROR_OK) {
-					target_set_examined(target);
-					LOG_USER("Examination failed, GDB will be halted. Polling again in %dms",
-						 target->backoff.times * polling_interval);
-					return retval;
-				}
-			}
+	/* First let the targets that can queue their status reads, so that they
+	 * share the execution of the queue, then poll them ahead of the others
+	 * that could run the queue in between.
+	 */
+	for (struct target *target = all_targets; target; target = target->next) {
+		if (target->type->poll_queue && target_poll_is_due(target) &&
+				!power_dropout && !srst_asserted)
+			target->poll_queued = target->type->poll_queue(target) == ERROR_OK;
+	}
+
+	for (int pass = 0; pass < 2; pass++) {
+		for (struct target *target = all_targets;
+				is_jtag_poll_safe() && target;
+				target = target->next) {
+			bool batched = target->type->poll_queue;
+			if (batched != (pass == 0))
+				continue;
 
-			/* Since we succeeded, we reset backoff count */
-			target->backoff.times = 0;
+			bool stop;
+			retval = handle_target_poll_one(target, &stop);
+			if (stop)
+				goto done;
 		}
 	}
 
+done:
+	/* drop what was not consumed, e.g. when polling was stopped */
+	target_poll_batch_drop();
+
 	return retval;
 }
 
@@ -6002,6 +6080,13 @@ static const struct command_registration target_instance_command_handlers[] = {
 		.help = "Write Tcl list of 8/16/32/64 bit numbers to target memory",
 		.usage = "address width data ['phys']",
 	},
+	{
+		.name = "memcache",
+		.mode = COMMAND_ANY,
+		.help = "host-side cache of target memory",
+		.usage = "",
+		.chain = target_memcache_command_handlers,
+	},
 	{
 		.name = "eventlist",
 		.handler = handle_target_event_list,
@@ -35,6 +35,7 @@ struct mem_param;
 struct reg_param;
 struct target_list;
 struct gdb_fileio_info;
+struct target_memcache;
 
 /*
  * TARGET_UNKNOWN = 0: we don't know anything about the target yet
@@ -183,6 +184,7 @@ struct target {
 	bool rtos_auto_detect;				/* A flag that indicates that the RTOS has been specified as "auto"
 										 * and must be detected when symbols are offered */
 	struct backoff_timer backoff;
+	bool poll_queued;					/* poll_queue() queued the status reads of the next poll */
 	int smp;							/* Unique non-zero number for each SMP group */
 	struct list_head *smp_targets;		/* list all targets in this smp group/cluster
 										 * The head of the list is shared between the
@@ -206,6 +208,9 @@ struct target {
 
 	/* The semihosting information, extracted from the target. */
 	struct semihosting *semihosting;
+
+	/* Host-side cache of target memory, NULL when disabled */
+	struct target_memcache *memcache;
 };
 
 struct target_list {
@@ -385,6 +390,7 @@ int target_unregister_trace_callback(
  * yet it is possible to detect error conditions.
  */
 int target_poll(struct target *target);
+void target_poll_batch_drop(void);
 int target_resume(struct target *target, int current, target_addr_t address,
 		int handle_breakpoints, int debug_execution);
 int target_halt(struct target *target);
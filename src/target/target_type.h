@@ -32,6 +32,22 @@ struct target_type {
 
 	/* poll current target status */
 	int (*poll)(struct target *target);
+	/**
+	 * Optional. Queue, without executing them, the reads the next call to
+	 * poll() needs. handle_target() calls it on all the targets it is about
+	 * to poll, sets target->poll_queued on success, then polls them before
+	 * the targets without this hook: poll() runs the queue once for all the
+	 * targets sharing it, and clears target->poll_queued when it uses the
+	 * queued results.
+	 */
+	int (*poll_queue)(struct target *target);
+	/**
+	 * Required with poll_queue(). Called by target_poll_batch_drop() on the
+	 * targets whose queued reads were not used by poll(): execute them, so
+	 * that they don't run later along with unrelated accesses, and keep any
+	 * state that reading the status consumes.
+	 */
+	int (*poll_queue_drop)(struct target *target);
 	/* Invoked only from target_arch_state().
 	 * Issue USER() w/architecture specific status.  */
 	int (*arch_state)(struct target *target);